@@ -0,0 +1,95 @@
+#pragma once
+
+// NOTE(ubsan): a compact version of `Ast`
+// the whole term lives in a few contiguous vectors, and nodes refer to each
+// other by 32-bit index instead of by `shared_ptr`. Nodes may be shared, so
+// the term is a DAG, but there are no refcounts; dropping the arena frees
+// everything at once.
+
+#include <lambda/ast.h>
+#include <lambda/parse_ast.h>
+
+#include <ublib/shared_string.h>
+
+#include <cstdint>
+#include <iosfwd>
+#include <limits>
+#include <vector>
+
+namespace lambda {
+
+class Arena_ast {
+public:
+  using Index = std::uint32_t;
+  constexpr static Index no_index = std::numeric_limits<Index>::max();
+
+  enum class Tag : std::uint8_t {
+    variable,
+    free_variable,
+    call,
+    lambda,
+  };
+
+  Arena_ast() = default;
+  explicit Arena_ast(Ast const&);
+
+  // each of these adds a node to the arena, and returns its index
+  // the children must already be in the arena
+  // @throw std::length_error if the arena is full
+  Index variable(int index);
+  Index free_variable(ublib::Shared_string name);
+  Index call(Index callee, Index argument);
+  Index lambda(ublib::Shared_string variable, Index expression);
+
+  // the node that the term starts at; usually, the last node added
+  Index root() const noexcept { return root_; }
+  void set_root(Index root) noexcept { root_ = root; }
+
+  std::size_t size() const noexcept { return tags_.size(); }
+  void reserve(std::size_t nodes);
+
+  Tag tag(Index idx) const noexcept { return tags_[idx]; }
+
+  // valid for `Tag::variable`
+  int index(Index idx) const noexcept {
+    return static_cast<int>(nodes_[idx].first);
+  }
+  // valid for `Tag::free_variable` and `Tag::lambda`
+  ublib::Shared_string const& name(Index idx) const noexcept {
+    return names_[nodes_[idx].first];
+  }
+  // valid for `Tag::call`
+  Index callee(Index idx) const noexcept { return nodes_[idx].first; }
+  Index argument(Index idx) const noexcept { return nodes_[idx].second; }
+  // valid for `Tag::lambda`
+  Index expression(Index idx) const noexcept { return nodes_[idx].second; }
+
+private:
+  struct Node {
+    Index first;
+    Index second;
+  };
+
+  Index push(Tag tag, Index first, Index second);
+  Index push_name(ublib::Shared_string name);
+
+  std::vector<Tag> tags_;
+  std::vector<Node> nodes_;
+  std::vector<ublib::Shared_string> names_;
+  Index root_ = no_index;
+
+  friend Arena_ast eval(Arena_ast const&);
+};
+
+Ast to_ast(Arena_ast const&);
+
+// @throw reduce_error if the Parse_ast is not well-formed
+Arena_ast reduce_to_arena(Parse_ast const&);
+
+// gives the same results as `eval(Ast const&)`
+// @throw Eval_error if the ast is not well-formed
+Arena_ast eval(Arena_ast const&);
+
+std::ostream& operator<<(std::ostream&, Arena_ast const&);
+
+} // namespace lambda
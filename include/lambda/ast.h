@@ -3,13 +3,19 @@
 // NOTE(ubsan): not yet typed (if it'll ever be typed)
 // at this point, it's just a de-bruijnified version
 
+#include <lambda/error.h>
 #include <lambda/parse_ast.h>
 
 #include <ublib/shared_string.h>
 #include <ublib/utility.h>
 
+#include <algorithm>
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
 #include <exception>
+#include <functional>
+#include <limits>
 #include <memory>
 #include <string_view>
 #include <variant>
@@ -31,10 +37,49 @@ public:
   Ast(Call e);
   Ast(Lambda e);
 
+  Ast(Ast const&) noexcept = default;
+  Ast(Ast&&) noexcept = default;
+  Ast& operator=(Ast const&) noexcept = default;
+  Ast& operator=(Ast&&) noexcept = default;
+  ~Ast();
+
+  // the number of nodes in the term, counting a shared node once for every
+  // place it's used; saturates, instead of overflowing
+  std::size_t size() const noexcept;
+
+  // the greatest index of a variable which isn't bound inside the term,
+  // or -1 if there isn't one; a term where this is -1 is closed, and
+  // substituting into it, or shifting it, gives back the same term
+  int max_free_index() const noexcept;
+
+  // a structural hash, over the de Bruijn indices, so alpha-equivalent
+  // terms hash the same; each node works it out from its children's once,
+  // when it's made
+  std::uint64_t hash() const noexcept;
+
+  // whether both refer to the same node
+  // for `Ast`s built by the same `Ast_factory`, this is alpha-equivalence
+  friend bool same_node(Ast const& lhs, Ast const& rhs) noexcept {
+    return lhs.underlying_.get() == rhs.underlying_.get();
+  }
+
   template <typename T>
   friend struct ::ublib::Visit_for;
+  friend class Ast_factory;
 
 private:
+  // NOTE(ubsan): frees deep terms without recursing
+  void free_unique() noexcept;
+
+  // one step of splitmix64; every kind of node mixes its own constant in,
+  // so that different kinds of nodes don't collide by construction
+  constexpr static std::uint64_t hash_step(std::uint64_t h) noexcept {
+    h += 0x9E3779B97F4A7C15;
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EB;
+    return h ^ (h >> 31);
+  }
+
   std::shared_ptr<Underlying_type> underlying_;
 };
 
@@ -51,11 +96,16 @@ inline Ast::Ast(Variable e)
 
 class Ast::Free_variable {
   ublib::Shared_string name_;
+  std::uint64_t hash_;
 
 public:
-  ublib::Shared_string name() const noexcept { return name_; }
+  ublib::Shared_string const& name() const noexcept { return name_; }
+  std::uint64_t hash() const noexcept { return hash_; }
 
-  explicit Free_variable(ublib::Shared_string name) : name_(std::move(name)) {}
+  // the name is interned, if it isn't already
+  explicit Free_variable(ublib::Shared_string name)
+      : name_(ublib::Shared_string::interned(std::move(name))),
+        hash_(hash_step(0x46524545 ^ name_.hash())) {}
 };
 inline Ast::Ast(Free_variable e)
     : underlying_(std::make_shared<Underlying_type>(std::move(e))) {}
@@ -63,13 +113,30 @@ inline Ast::Ast(Free_variable e)
 class Ast::Call {
   Ast callee_;
   Ast argument_;
+  // NOTE(ubsan): cached, so that `Ast::size` is cheap; a Lambda doesn't
+  // cache its size, so `Ast::size` counts through lambdas to the first node
+  // which isn't one
+  std::size_t size_;
+  int max_free_index_;
+  std::uint64_t hash_;
 
 public:
   Ast const& callee() const noexcept { return callee_; }
   Ast const& argument() const noexcept { return argument_; }
+  std::size_t size() const noexcept { return size_; }
+  int max_free_index() const noexcept { return max_free_index_; }
+  std::uint64_t hash() const noexcept { return hash_; }
 
   Call(Ast callee, Ast argument)
-      : callee_(std::move(callee)), argument_(std::move(argument)) {}
+      : callee_(std::move(callee)), argument_(std::move(argument)) {
+    auto const max = std::numeric_limits<std::size_t>::max();
+    auto const lhs = callee_.size();
+    auto const rhs = argument_.size();
+    size_ = lhs >= max - 1 - rhs ? max : lhs + rhs + 1;
+    max_free_index_ =
+        std::max(callee_.max_free_index(), argument_.max_free_index());
+    hash_ = hash_step(hash_step(0x43414C4C ^ callee_.hash()) ^ argument_.hash());
+  }
 };
 inline Ast::Ast(Call e)
     : underlying_(std::make_shared<Underlying_type>(std::move(e))) {}
@@ -77,17 +144,78 @@ inline Ast::Ast(Call e)
 class Ast::Lambda {
   ublib::Shared_string parameter_;
   Ast expression_;
+  // cached, like a Call's size
+  int max_free_index_;
+  // the parameter's name isn't part of it
+  std::uint64_t hash_;
 
 public:
-  ublib::Shared_string variable() const noexcept { return parameter_; }
+  ublib::Shared_string const& variable() const noexcept {
+    return parameter_;
+  }
   Ast const& expression() const noexcept { return expression_; }
+  int max_free_index() const noexcept { return max_free_index_; }
+  std::uint64_t hash() const noexcept { return hash_; }
 
+  // the variable is interned, like a free variable's name
   Lambda(ublib::Shared_string variable, Ast expression)
-      : parameter_(std::move(variable)), expression_(std::move(expression)) {}
+      : parameter_(ublib::Shared_string::interned(std::move(variable))),
+        expression_(std::move(expression)),
+        max_free_index_(std::max(expression_.max_free_index() - 1, -1)),
+        hash_(hash_step(0x4C414D42 ^ expression_.hash())) {}
 };
 inline Ast::Ast(Lambda e)
     : underlying_(std::make_shared<Underlying_type>(std::move(e))) {}
 
+inline std::size_t Ast::size() const noexcept {
+  // lambdas don't cache their size, so count through them to the first
+  // node which isn't one
+  auto lambdas = std::size_t(0);
+  for (auto cur = underlying_.get();; ++lambdas) {
+    if (auto lambda = std::get_if<Lambda>(cur)) {
+      cur = lambda->expression().underlying_.get();
+    } else if (auto call = std::get_if<Call>(cur)) {
+      auto const max = std::numeric_limits<std::size_t>::max();
+      return call->size() >= max - lambdas ? max : call->size() + lambdas;
+    } else {
+      return lambdas + 1;
+    }
+  }
+}
+
+inline int Ast::max_free_index() const noexcept {
+  auto const cur = underlying_.get();
+  if (auto variable = std::get_if<Variable>(cur)) {
+    return variable->index();
+  } else if (auto call = std::get_if<Call>(cur)) {
+    return call->max_free_index();
+  } else if (auto lambda = std::get_if<Lambda>(cur)) {
+    return lambda->max_free_index();
+  } else {
+    return -1;
+  }
+}
+
+inline std::uint64_t Ast::hash() const noexcept {
+  auto const cur = underlying_.get();
+  if (auto variable = std::get_if<Variable>(cur)) {
+    return hash_step(
+        0x56415200 ^ static_cast<std::uint64_t>(variable->index()));
+  } else if (auto free_variable = std::get_if<Free_variable>(cur)) {
+    return free_variable->hash();
+  } else if (auto call = std::get_if<Call>(cur)) {
+    return call->hash();
+  } else {
+    return std::get<Lambda>(*cur).hash();
+  }
+}
+
+inline Ast::~Ast() {
+  if (underlying_ and underlying_.use_count() == 1) {
+    free_unique();
+  }
+}
+
 class reduce_error : public std::exception {
   ublib::Shared_string what_;
 
@@ -99,6 +227,20 @@ public:
 // @throw reduce_error if the Parse_ast is not well-formed
 Ast reduce(Parse_ast const&);
 
+// like `reduce`, but gives back the error instead of throwing it. Every
+// `Parse_ast` reduces today, since a name that isn't bound is a free
+// variable; this is here so that the stages chain with `and_then`
+Result<Ast> try_reduce(Parse_ast const&);
+
+// parses and reduces in one pass, without building a `Parse_ast`;
+// gives the same term as `reduce(parse_from(source))`
+// @throw Parse_error if the input is invalid lambda calculus
+Ast parse_to_ast(std::string_view source);
+
+// like `parse_to_ast`, but gives back the error, with the offset it was
+// found at, instead of throwing it
+Result<Ast> try_parse_to_ast(std::string_view source);
+
 class Eval_error : public std::exception {
   ublib::Shared_string what_;
 
@@ -107,10 +249,14 @@ public:
   virtual char const* what() const noexcept { return what_.c_str(); }
 };
 
+// Church numerals and booleans are computed natively; see lambda/jets.h
 // @throw Eval_error if the ast is not well-formed
 // if the ast is taken from `make_typed`, then this should not happen
 Ast eval(Ast const&);
 
+// like `eval`, but gives back the error instead of throwing it
+Result<Ast> try_eval(Ast const&);
+
 std::ostream& operator<<(std::ostream&, Ast const&);
 
 } // namespace lambda
@@ -0,0 +1,93 @@
+#pragma once
+
+// NOTE(ubsan): hash-consing for `Ast`
+// every node the factory hands out is unique up to alpha-equivalence;
+// building a term that's already been built gives back the old node.
+// Therefore, `same_node` on two `Ast`s from the same factory is a full
+// (alpha-)equality check.
+//
+// binder names aren't part of a lambda's identity; a shared lambda keeps the
+// name of the first one built, so printing might use different names than
+// the source did.
+
+#include <lambda/ast.h>
+#include <lambda/parse_ast.h>
+
+#include <ublib/shared_string.h>
+
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace lambda {
+
+class Ast_factory {
+public:
+  struct Stats {
+    // the number of nodes asked for
+    std::size_t requested = 0;
+    // the number of nodes actually allocated
+    std::size_t created = 0;
+
+    // an estimate of the size of one node, including the control block
+    constexpr static std::size_t node_size =
+        sizeof(Ast::Underlying_type) + 2 * sizeof(void*);
+
+    // requested / created; 1.0 means nothing was shared
+    double sharing_ratio() const noexcept {
+      return created == 0 ? 1.0
+                          : static_cast<double>(requested) /
+                                static_cast<double>(created);
+    }
+    std::size_t bytes_saved() const noexcept {
+      return (requested - created) * node_size;
+    }
+  };
+
+  Ast variable(int index);
+  Ast free_variable(ublib::Shared_string name);
+  // `callee` and `argument` should come from this factory;
+  // if they don't, the result is still correct, but shares less
+  Ast call(Ast callee, Ast argument);
+  Ast lambda(ublib::Shared_string variable, Ast expression);
+
+  // rebuilds `ast` out of this factory's nodes
+  Ast intern(Ast const& ast);
+
+  Stats const& stats() const noexcept { return stats_; }
+
+private:
+  using Node = void const*;
+  static Node node(Ast const& ast) noexcept { return ast.underlying_.get(); }
+
+  struct Hash_call {
+    std::size_t operator()(std::pair<Node, Node> const& p) const noexcept {
+      auto const h = std::hash<Node>();
+      return h(p.first) * 31 + h(p.second);
+    }
+  };
+
+  Stats stats_;
+  std::vector<std::optional<Ast>> variables_;
+  // the key points into the name of the mapped Free_variable
+  std::unordered_map<ublib::Shared_string, Ast> free_variables_;
+  std::unordered_map<std::pair<Node, Node>, Ast, Hash_call> calls_;
+  std::unordered_map<Node, Ast> lambdas_;
+};
+
+// builds the `Ast` out of the factory's nodes
+// @throw reduce_error if the Parse_ast is not well-formed
+Ast reduce(Parse_ast const&, Ast_factory&);
+
+// like `parse_to_ast(std::string_view)`, building out of the factory's nodes
+// @throw Parse_error if the input is invalid lambda calculus
+Ast parse_to_ast(std::string_view source, Ast_factory&);
+
+// evaluates like `eval(Ast const&)`, building new nodes out of the factory
+// @throw Eval_error if the ast is not well-formed
+Ast eval(Ast const&, Ast_factory&);
+
+} // namespace lambda
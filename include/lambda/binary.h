@@ -0,0 +1,62 @@
+#pragma once
+
+// NOTE(ubsan): an on-disk form of a reduced `Ast`, so that a program only
+// has to be parsed once
+//
+//   "LMBD"                         magic
+//   varint version                 `binary_version`
+//   varint count, count strings    each is a varint length, then the bytes
+//   varint count, count nodes      children always come before parents
+//
+// a node is a tag byte, followed by varint operands:
+//
+//   variable       the de Bruijn index
+//   free_variable  the string
+//   call           the callee and the argument
+//   lambda         the binder's string, and the body
+//
+// strings are indices into the string table; children are written as the
+// distance back from the node that uses them, so they're usually one byte.
+// The root is the last node. Shared subterms are written once.
+//
+// since children come first, loading is one pass from front to back, and
+// the loaders work on any buffer, including a file that's been `mmap`ped.
+
+#include <lambda/arena_ast.h>
+#include <lambda/ast.h>
+
+#include <ublib/shared_string.h>
+
+#include <cstdint>
+#include <exception>
+#include <iosfwd>
+#include <string_view>
+
+namespace lambda {
+
+constexpr std::uint32_t binary_version = 1;
+
+class Binary_error : public std::exception {
+  ublib::Shared_string what_;
+
+public:
+  Binary_error(ublib::Shared_string what) : what_(std::move(what)) {}
+  virtual char const* what() const noexcept { return what_.c_str(); }
+};
+
+std::ostream& operator<<(std::ostream&, Binary_error const&);
+
+// writes the term, in the format above
+void write_binary(std::ostream&, Ast const&);
+
+// @return whether `bytes` starts like a binary term
+bool is_binary(std::string_view bytes) noexcept;
+
+// @throw Binary_error if `bytes` isn't a binary term of this version
+Ast read_binary(std::string_view bytes);
+
+// loads straight into an arena, without building any `Ast` nodes
+// @throw Binary_error if `bytes` isn't a binary term of this version
+Arena_ast read_binary_arena(std::string_view bytes);
+
+} // namespace lambda
@@ -0,0 +1,91 @@
+#pragma once
+
+// NOTE(ubsan): a flat compiled form of `Ast`
+// every lambda body is compiled to a straight run of instructions, so
+// evaluation is one `switch` per instruction, instead of a `std::visit`
+// through a `shared_ptr` per node.
+//
+// the machine has a stack of values, an environment, and a stack of return
+// frames. A lambda body starts with `grab`, which moves the argument from
+// the stack into the environment, and ends in `ret`, or in a `tail_apply`.
+//
+// it has the same jets as `eval` (see lambda/jets.h): a Church numeral that
+// is given both of its arguments applies the first to the second, in a
+// loop, without running its body.
+
+#include <lambda/ast.h>
+
+#include <cstdint>
+#include <iosfwd>
+#include <limits>
+#include <vector>
+
+namespace lambda {
+
+class Bytecode {
+public:
+  using Index = std::uint32_t;
+  constexpr static Index no_index = std::numeric_limits<Index>::max();
+
+  enum class Opcode : std::uint8_t {
+    // push the variable with de Bruijn index `operand`
+    access,
+    // push the free variable `free_variables()[operand]`
+    free_variable,
+    // push a closure of `functions()[operand]` over the environment
+    closure,
+    // pop an argument, then a callee, and call the callee;
+    // the operand is `called` if the result is the callee of another
+    // `apply`, which is when the jets are tried
+    apply,
+    // `apply`, replacing the current frame; always ends a function
+    tail_apply,
+    // pop the argument into the environment
+    grab,
+    // return the value on top of the stack to the caller
+    ret,
+  };
+
+  struct Instruction {
+    Opcode opcode;
+    Index operand;
+  };
+
+  constexpr static Index called = 1;
+
+  struct Function {
+    // where the code for the body starts
+    Index entry;
+    // the lambda it was compiled from, for reading values back out
+    Ast source;
+    // whether a closure of it might be true, or a numeral, once it's read
+    // back; the jets don't bother reading back any others
+    bool has_shape;
+  };
+
+  // @throw std::length_error if the code doesn't fit 32-bit indices
+  explicit Bytecode(Ast const&);
+
+  // the top-level code starts at 0
+  std::vector<Instruction> const& code() const noexcept { return code_; }
+  std::vector<Function> const& functions() const noexcept {
+    return functions_;
+  }
+  std::vector<Ast> const& free_variables() const noexcept {
+    return free_variables_;
+  }
+
+private:
+  std::vector<Instruction> code_;
+  std::vector<Function> functions_;
+  std::vector<Ast> free_variables_;
+};
+
+// gives the same results as `eval(Ast const&)`
+// @throw Eval_error if the ast is not well-formed
+Ast eval(Bytecode const&);
+
+// prints one instruction per line, with a label where each function starts
+void disassemble(std::ostream&, Bytecode const&);
+
+} // namespace lambda
@@ -0,0 +1,28 @@
+#pragma once
+
+// NOTE(ubsan): an ahead-of-time backend; a term is compiled to a C program
+// which evaluates it the way `eval` does, and prints the result the way
+// `operator<<` does
+//
+// every lambda becomes a C function, which takes its argument, and a flat
+// array of just the variables it uses from outside (closure conversion).
+// Its body is a straight run of statements, one for each call and lambda,
+// in the order `eval` evaluates them; a call in tail position goes back to
+// a trampoline, so loops don't grow the C stack. Values come from a bump
+// allocator, and aren't freed until the program is done. Unlike `eval`,
+// Church numerals aren't computed natively.
+//
+// the program takes an optional count; it evaluates the term that many
+// times, then prints the result once, so that it can be timed.
+
+#include <lambda/ast.h>
+
+#include <iosfwd>
+
+namespace lambda {
+
+// writes a C99 program, which builds with no other files
+// @throw Eval_error if the ast has a variable that isn't bound
+void emit_c(std::ostream&, Ast const&);
+
+} // namespace lambda
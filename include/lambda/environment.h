@@ -0,0 +1,58 @@
+#pragma once
+
+// NOTE(ubsan): top-level definitions, for the REPL
+// a definition is parsed, reduced and evaluated once, and its value is kept
+// as an `Ast`. Later terms refer to it by name, which parses as a
+// `Free_variable`; `resolve` swaps those for the values, before evaluating.
+// Values are closed, so they can go under binders without any shifting, and
+// resolving a term only walks that term, however many definitions there are.
+//
+// definitions are resolved when they're made: redefining a name changes
+// what later terms see, but not the definitions that already used it.
+// A definition that mentions its own name is left with it free; recursion
+// goes through a fixpoint combinator, as usual.
+
+#include <lambda/ast.h>
+
+#include <ublib/shared_string.h>
+
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+
+namespace lambda {
+
+class Environment {
+public:
+  // @param value should be closed, like what `eval` gives back for a term
+  // `parse_to_ast` built
+  void define(ublib::Shared_string name, Ast value);
+
+  // replaces every free variable in `ast` which names a definition with its
+  // value; subterms which don't change are shared with `ast`
+  Ast resolve(Ast const& ast) const;
+
+  std::size_t size() const noexcept { return definitions_.size(); }
+
+private:
+  std::unordered_map<ublib::Shared_string, Ast> definitions_;
+};
+
+// a line of the form `let name = term`
+struct Definition {
+  std::string_view name;
+  std::string_view term;
+};
+
+// @return whether `line` is only whitespace and comments
+// @throw Parse_error if a comment isn't closed
+bool is_blank(std::string_view line);
+
+// `let` is only a keyword at the start of a line; anywhere else, it's just
+// a name
+// @return the definition `line` is, or nothing if it's just a term
+// @throw Parse_error if `line` starts with `let`, but isn't a definition
+std::optional<Definition> parse_definition(std::string_view line);
+
+} // namespace lambda
@@ -0,0 +1,71 @@
+#pragma once
+
+// NOTE(ubsan): the errors of the `try_` functions, which give them back
+// instead of throwing. An `Error` is a code and an offset, so making one
+// doesn't allocate; the message for a code is a string literal. The
+// throwing functions are wrappers around these, and throw an exception
+// with that same message.
+
+#include <ublib/expected.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <limits>
+#include <utility>
+
+namespace lambda {
+
+enum class Error_code : std::uint8_t {
+  // from parsing; see `Parse_error`
+  unexpected_end_of_file,
+  unexpected_character,
+  expected_variable,
+  lambda_in_callee,
+  // from evaluating; see `Eval_error`
+  unbound_variable,
+};
+
+// @return the message the throwing functions use
+char const* message(Error_code) noexcept;
+
+struct Error {
+  constexpr static std::size_t no_offset =
+      std::numeric_limits<std::size_t>::max();
+
+  Error_code code;
+  // in bytes, into the source; `no_offset` for errors from an `Ast`, which
+  // doesn't remember where it came from
+  std::size_t offset = no_offset;
+
+  bool is_parse_error() const noexcept {
+    return code != Error_code::unbound_variable;
+  }
+};
+
+// like the exception it stands for, with the offset after it
+std::ostream& operator<<(std::ostream&, Error const&);
+
+template <typename T>
+using Result = ublib::Expected<T, Error>;
+
+// @return the error, for a function giving back a `Result<T>`
+inline ublib::Unexpected<Error>
+fail(Error_code code, std::size_t offset = Error::no_offset) {
+  return ublib::Unexpected<Error>{Error{code, offset}};
+}
+
+// @throw Parse_error, or Eval_error, with the message for `error`'s code
+[[noreturn]] void throw_error(Error const& error);
+
+// what the throwing functions are written with
+// @throw Parse_error, or Eval_error, if `result` is an error
+template <typename T>
+T value_or_throw(Result<T> result) {
+  if (not result) {
+    throw_error(result.error());
+  }
+  return std::move(*result);
+}
+
+} // namespace lambda
@@ -0,0 +1,90 @@
+#pragma once
+
+// NOTE(ubsan): a content-addressed memo table for `eval`
+// terms are looked up by `Ast::hash`, and a hit is checked against the
+// stored term, names of binders included; so a term that's been evaluated
+// before gets its value straight back, named just as `eval` would name it.
+// The hash doesn't cover those names, so a term that's only
+// alpha-equivalent to the stored one is a collision, which is a miss. `eval`
+// looks up the whole term, and every argument it evaluates that's at least
+// `min_size` nodes; smaller ones are cheaper to evaluate than to look up.
+//
+// the table holds at most `capacity` entries; past that, the one used
+// longest ago is dropped. It can be saved to a file, in the format of
+// lambda/binary.h, and loaded again by a later run.
+
+#include <lambda/ast.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <list>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+
+namespace lambda {
+
+struct Eval_cache_stats {
+  std::size_t hits = 0;
+  std::size_t misses = 0;
+  // entries dropped to make room
+  std::size_t evictions = 0;
+};
+
+std::ostream& operator<<(std::ostream&, Eval_cache_stats const&);
+
+class Eval_cache {
+public:
+  constexpr static std::size_t default_capacity = 4096;
+  constexpr static std::size_t default_min_size = 32;
+
+  explicit Eval_cache(
+      std::size_t capacity = default_capacity,
+      std::size_t min_size = default_min_size)
+      : capacity_(capacity), min_size_(min_size) {}
+
+  // whether `eval` should look `term` up, and remember its value
+  bool wants(Ast const& term) const noexcept {
+    return capacity_ != 0 and term.size() >= min_size_;
+  }
+
+  // @return the value of `term`, if it's been stored, with the same names;
+  // counts a hit or a miss
+  std::optional<Ast> find(Ast const& term);
+
+  // replaces whatever was stored for a term with the same hash, like one
+  // that's alpha-equivalent to it
+  void insert(Ast term, Ast value);
+
+  std::size_t size() const noexcept { return entries_.size(); }
+  Eval_cache_stats const& stats() const noexcept { return stats_; }
+
+  // writes every entry, as one term in the format of lambda/binary.h
+  void save(std::ostream&) const;
+
+  // adds the entries written by `save`; the ones in this cache already are
+  // kept, as if they'd been used since
+  // @throw Binary_error if `bytes` aren't a saved cache
+  void load(std::string_view bytes);
+
+private:
+  struct Entry {
+    Ast term;
+    Ast value;
+  };
+
+  // the most recently used entry is at the front
+  std::list<Entry> entries_;
+  std::unordered_map<std::uint64_t, std::list<Entry>::iterator> index_;
+  std::size_t capacity_;
+  std::size_t min_size_;
+  Eval_cache_stats stats_;
+};
+
+// like `eval(Ast const&)`, looking terms up in `cache`, and remembering
+// their values in it
+// @throw Eval_error if the ast is not well-formed
+Ast eval(Ast const&, Eval_cache& cache);
+
+} // namespace lambda
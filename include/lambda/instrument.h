@@ -0,0 +1,60 @@
+#pragma once
+
+// NOTE(ubsan): opt-in counters and tracing for `reduce` and `eval`
+// the plain overloads don't take any of this, and are compiled separately
+// from the instrumented ones, so they don't pay for it.
+
+#include <lambda/ast.h>
+#include <lambda/parse_ast.h>
+
+#include <chrono>
+#include <cstddef>
+#include <iosfwd>
+#include <string_view>
+
+namespace lambda {
+
+class Ast_factory;
+
+struct Eval_stats {
+  // lambdas called
+  std::size_t beta_steps = 0;
+  // variables replaced by an argument
+  std::size_t substitutions = 0;
+  // nodes built (or asked of the factory), by `reduce` and by `eval`
+  std::size_t nodes_built = 0;
+  // the most evaluation frames live at once
+  std::size_t max_depth = 0;
+
+  std::chrono::nanoseconds reduce_time{};
+  std::chrono::nanoseconds eval_time{};
+};
+
+std::ostream& operator<<(std::ostream&, Eval_stats const&);
+
+struct Instrumentation {
+  // if non-null, counts are added to it
+  Eval_stats* stats = nullptr;
+  // if non-null, every beta step is written to it, one per line
+  std::ostream* trace = nullptr;
+};
+
+// like `reduce(Parse_ast const&)`; if `factory` is non-null, nodes are
+// built out of it
+// @throw reduce_error if the Parse_ast is not well-formed
+Ast reduce(
+    Parse_ast const&, Instrumentation, Ast_factory* factory = nullptr);
+
+// like `parse_to_ast(std::string_view)`; the time spent parsing is counted
+// as `reduce_time`
+// @throw Parse_error if the input is invalid lambda calculus
+Ast parse_to_ast(
+    std::string_view source, Instrumentation, Ast_factory* factory = nullptr);
+
+// like `eval(Ast const&)`; if `factory` is non-null, nodes are built out
+// of it. Every step is counted, so Church numerals aren't computed natively,
+// like in `eval_without_jets`
+// @throw Eval_error if the ast is not well-formed
+Ast eval(Ast const&, Instrumentation, Ast_factory* factory = nullptr);
+
+} // namespace lambda
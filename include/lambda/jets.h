@@ -0,0 +1,44 @@
+#pragma once
+
+// NOTE(ubsan): "jets" for Church numerals and booleans
+// `eval` recognizes these terms when they're called, and, when they're
+// given both of their arguments, computes the result natively, instead of
+// through the term they're written as:
+//
+//   /t./f.t                                 true
+//   /f./x.f (... (f x))                     n; false is 0
+//   /f./x.f (n f x)                         succ n
+//   /f./x.m f (n f x)                       add m n
+//   /f.m (n f)                              mult m n
+//   /f./x.n (/g./h.h (g f)) (/u.x) (/u.u)   pred n
+//   /x.m (... (m x))                        exp m k, with k copies of m
+//
+// which are the canonical numerals, and what the usual combinators evaluate
+// to when they're given numerals. So `add two three s z` is `s` applied
+// five times to `z`, without going through `add`'s body; and if the
+// function is constant, as in `iszero`, it isn't applied at all.
+//
+// values are never rewritten: a numeral that isn't given both arguments is
+// evaluated as it's written, so printing a result gives the same term it
+// always did. Every jet gives the same result as the pure evaluator, which
+// is still there as `eval_without_jets`.
+
+#include <lambda/ast.h>
+
+#include <cstdint>
+#include <optional>
+
+namespace lambda {
+
+// @return the number `ast` is a Church numeral for, if it's one of the
+// shapes above, and the number fits
+std::optional<std::uint64_t> church_numeral(Ast const&);
+
+// @return the boolean `ast` is, if it's `/t./f.t` or `/t./f.f`
+std::optional<bool> church_boolean(Ast const&);
+
+// like `eval(Ast const&)`, but without any jets
+// @throw Eval_error if the ast is not well-formed
+Ast eval_without_jets(Ast const&);
+
+} // namespace lambda
@@ -0,0 +1,29 @@
+#pragma once
+
+// NOTE(ubsan): environment-based evaluators
+// instead of rebuilding the lambda body on every call, like `eval` does,
+// the machines pair the body with an environment of arguments, and only
+// rebuild an `Ast` when reading back the final value
+
+#include <lambda/ast.h>
+
+namespace lambda {
+
+// evaluates using a CEK machine (Control, Environment, Kontinuation)
+// it is call-by-value, and gives the same results as `eval`
+//
+// @throw Eval_error if the ast is not well-formed
+Ast eval_cek(Ast const&);
+
+// evaluates call-by-need; arguments are passed as thunks, which are only
+// evaluated once they're needed (called, or returned), and at most once.
+// an argument that's never needed is never evaluated, so this can finish
+// where `eval` doesn't.
+//
+// like `eval`, it stops at a lambda or a stuck call. Arguments which were
+// never needed are read back as they were passed, instead of as values.
+//
+// @throw Eval_error if the ast is not well-formed
+Ast eval_lazy(Ast const&);
+
+} // namespace lambda
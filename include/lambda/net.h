@@ -0,0 +1,88 @@
+#pragma once
+
+// NOTE(ubsan): an experimental backend, which normalizes a term by turning
+// it into an interaction net, reducing the net, and reading the term back
+//
+// this is Lamping's algorithm. The net has an agent for each lambda, call,
+// and free variable of the term, and a croissant for each use of a
+// variable. The uses are connected to their lambda through fans, which
+// share them, and a bracket for each argument the variable is used inside
+// of; so the net is at most the size of the term, times how many variables
+// bound outside of an argument it uses. A lambda whose variable isn't used
+// at all is connected to an eraser. Then, off a worklist, every pair of
+// agents which are connected by their principal ports interacts, until
+// there are no pairs left: a lambda and a call are a beta reduction; a fan
+// copies what it meets one agent at a time; and an eraser deletes it.
+//
+// since a fan only copies a term as it's needed, work done inside a shared
+// term, like a redex in the body of a function that's called many times, is
+// only done once, instead of once for every copy. Every agent has a level,
+// which is how many arguments it's inside of; the croissants and brackets
+// on the way from a variable's uses to its lambda keep those up to date as
+// terms are moved around, so that two fans only cancel out when they're
+// the two ends of the same sharing, and copy each other otherwise.
+//
+// like `normalize`, this reduces under lambdas, and gives the beta-normal
+// form. Unlike it, every pair in the net is reduced, even the ones in an
+// argument that's being erased; so a term with a normal form may still not
+// finish without fuel. The order pairs are reduced in doesn't change how
+// many interactions it takes. Reading back unshares the normal form, which
+// can be far bigger than the net it's read from.
+
+#include <lambda/ast.h>
+#include <lambda/normalize.h>
+
+#include <cstddef>
+#include <iosfwd>
+
+namespace lambda {
+
+struct Net_stats {
+  // every interaction, of any kind; this is what the fuel counts
+  std::size_t interactions = 0;
+  // a lambda meeting a call; comparable to `Eval_stats::beta_steps`, and to
+  // `Normalize_result::steps`
+  std::size_t betas = 0;
+  // a fan copying an agent, and being copied by it
+  std::size_t duplications = 0;
+  // two fans at the same level cancelling out
+  std::size_t annihilations = 0;
+  // a croissant or bracket going through an agent, or cancelling out
+  std::size_t level_changes = 0;
+  // an eraser deleting an agent
+  std::size_t erasures = 0;
+  // the most agents in the net at once
+  std::size_t max_agents = 0;
+  // the interactions which unshare the normal form, and the agents gone
+  // through reading it back; the fuel counts these too
+  std::size_t read_back_steps = 0;
+};
+
+std::ostream& operator<<(std::ostream&, Net_stats const&);
+
+struct Net_result {
+  enum class Status {
+    // `term` is in beta-normal form
+    normal_form,
+    // the budget ran out
+    out_of_fuel,
+    // the net got too big to hold; a term without a normal form can grow
+    // its net without bound, where `normalize` would just keep reducing
+    out_of_memory,
+  };
+
+  Status status;
+  // the normal form; a net that's partly reduced can't always be read back,
+  // so if the fuel or the memory ran out, this is the term that was given
+  Ast term;
+  Net_stats stats;
+};
+
+// does at most `fuel` interactions and steps reading back, between them;
+// running out of memory, or of room for agents, is given back like running
+// out of fuel, rather than thrown
+// @throw Eval_error if the ast is not well-formed, or the net can't be read
+// back
+Net_result normalize_net(Ast const&, std::size_t fuel = unlimited_fuel);
+
+} // namespace lambda
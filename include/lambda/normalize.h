@@ -0,0 +1,44 @@
+#pragma once
+
+// NOTE(ubsan): strong, normal-order reduction
+// unlike `eval`, this reduces under lambdas and inside stuck calls, and
+// always reduces the leftmost-outermost redex first; if a term has a normal
+// form, this will find it. Substitutions are explicit, and only done as far
+// as the reduction looks, so a step costs the same however big the body is
+
+#include <lambda/ast.h>
+
+#include <cstddef>
+#include <limits>
+
+namespace lambda {
+
+struct Normalize_result {
+  enum class Status {
+    // `term` is in beta-normal form
+    normal_form,
+    // the budget ran out; `term` is as far as we got
+    out_of_fuel,
+  };
+
+  Status status;
+  Ast term;
+  // the number of beta reductions done
+  std::size_t steps;
+};
+
+constexpr auto unlimited_fuel = std::numeric_limits<std::size_t>::max();
+
+// does at most `fuel` beta reductions
+// @throw Eval_error if the ast is not well-formed
+Normalize_result normalize(Ast const&, std::size_t fuel = unlimited_fuel);
+
+// normalization by evaluation; gives the same normal form as `normalize`,
+// but evaluates into closures instead of substituting, so it's much faster.
+// the evaluation is lazy, so it finds a normal form whenever `normalize`
+// would; if there isn't one, it doesn't return.
+//
+// @throw Eval_error if the ast is not well-formed
+Ast normalize_nbe(Ast const&);
+
+} // namespace lambda
@@ -0,0 +1,35 @@
+#pragma once
+
+// NOTE(ubsan): opt-in parallel evaluation
+// under call-by-value, the callee and the argument of a call are evaluated
+// independently. When both are calls, `eval_parallel` puts a large argument
+// on a thread pool, while the callee is evaluated on the calling thread, and
+// joins them before the call. If no worker has picked the argument up by
+// then, it's evaluated in place instead. Forked arguments fork in turn.
+//
+// nothing is shared between threads but immutable `Ast` nodes, so the
+// result is the same term `eval` gives, whatever the number of threads.
+// The same goes for errors: if both the callee and the argument fail, the
+// callee's error is the one thrown. A forked argument that's no longer
+// needed, since its callee failed, still runs to the end on the pool.
+
+#include <lambda/ast.h>
+
+#include <ublib/thread_pool.h>
+
+#include <cstddef>
+
+namespace lambda {
+
+// arguments smaller than this (in nodes) aren't worth a task
+constexpr std::size_t default_fork_threshold = 256;
+
+// gives the same results as `eval(Ast const&)`
+// @param threshold arguments of fewer nodes are evaluated in place
+// @throw Eval_error if the ast is not well-formed
+Ast eval_parallel(
+    Ast const&,
+    ublib::Thread_pool& pool,
+    std::size_t threshold = default_fork_threshold);
+
+} // namespace lambda
@@ -1,5 +1,7 @@
 ﻿#pragma once
 
+#include <lambda/error.h>
+
 #include <ublib/shared_string.h>
 #include <ublib/utility.h>
 
@@ -33,6 +35,13 @@ public:
     explicit Call(Parse_ast callee, Parse_ast argument)
         : callee_(std::make_unique<Parse_ast>(std::move(callee))),
           argument_(std::make_unique<Parse_ast>(std::move(argument))) {}
+
+    Call(Call&&) noexcept = default;
+    Call& operator=(Call&&) noexcept = default;
+    ~Call() {
+      free_deep(std::move(callee_));
+      free_deep(std::move(argument_));
+    }
   };
 
   class Lambda {
@@ -46,6 +55,10 @@ public:
     explicit Lambda(std::string parameter, Parse_ast expression)
         : parameter_(std::move(parameter)),
           expression_(std::make_unique<Parse_ast>(std::move(expression))) {}
+
+    Lambda(Lambda&&) noexcept = default;
+    Lambda& operator=(Lambda&&) noexcept = default;
+    ~Lambda() { free_deep(std::move(expression_)); }
   };
 
   Parse_ast(Variable v) : underlying_(std::move(v)) {}
@@ -56,6 +69,14 @@ public:
   friend struct ::ublib::Visit_for;
 
 private:
+  // NOTE(ubsan): frees deep trees without recursing
+  static void free_deep(std::unique_ptr<Parse_ast> ast) noexcept {
+    if (ast) {
+      free_unique(std::move(ast));
+    }
+  }
+  static void free_unique(std::unique_ptr<Parse_ast> ast) noexcept;
+
   std::variant<Variable, Call, Lambda> underlying_;
 };
 
@@ -74,6 +95,14 @@ std::ostream& operator<<(std::ostream&, Parse_error const&);
 // @throw Parse_error if the input is invalid lambda calculus
 Parse_ast parse_from(std::istream&);
 
+// parses straight out of the buffer, without going through a stream
+// @throw Parse_error if the input is invalid lambda calculus
+Parse_ast parse_from(std::string_view source);
+
+// like `parse_from`, but gives back the error, with the offset it was found
+// at, instead of throwing it
+Result<Parse_ast> try_parse_from(std::string_view source);
+
 } // namespace lambda
 
 namespace ublib {
@@ -0,0 +1,46 @@
+#pragma once
+
+// NOTE(ubsan): every kind of tree is printed by rendering them into a
+// buffer, in one pass without recursing, and writing the buffer out at
+// once; `operator<<` is `print` with the default options.
+//
+// by default, every lambda is parenthesized, and calls never are; variables
+// in an `Ast` or an `Arena_ast` are printed as their binder's name, then
+// their de Bruijn index, like `x_0`. With `minimal_parens`, there are only
+// parentheses where the parser needs them to read the same tree back.
+
+#include <lambda/arena_ast.h>
+#include <lambda/ast.h>
+#include <lambda/parse_ast.h>
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+
+namespace lambda {
+
+struct Print_options {
+  // subterms nested deeper than this are printed as `...`;
+  // zero means there's no limit
+  std::size_t max_depth = 0;
+  // past this many characters, the output is cut off, and ends in `...`;
+  // zero means there's no limit
+  std::size_t max_length = 0;
+  bool minimal_parens = false;
+};
+
+// renders the tree into `out`, replacing what was there, so that a buffer
+// can be reused across calls
+// @throw std::out_of_range if a variable isn't bound by a lambda around it
+void print(std::string& out, Ast const&, Print_options const& = {});
+void print(std::string& out, Parse_ast const&, Print_options const& = {});
+void print(std::string& out, Arena_ast const&, Print_options const& = {});
+
+// renders the tree into a buffer that's reused by every call on the same
+// thread, then writes it with one call
+// @throw std::out_of_range if a variable isn't bound by a lambda around it
+std::ostream& print(std::ostream&, Ast const&, Print_options const& = {});
+std::ostream& print(std::ostream&, Parse_ast const&, Print_options const& = {});
+std::ostream& print(std::ostream&, Arena_ast const&, Print_options const& = {});
+
+} // namespace lambda
@@ -0,0 +1,64 @@
+#pragma once
+
+// NOTE(ubsan): a value, or the error that kept it from being made; the
+// parts of C++23's `std::expected` that get used, on top of a variant
+
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace ublib {
+
+template <typename E>
+struct Unexpected {
+  E error;
+};
+
+template <typename E>
+Unexpected(E) -> Unexpected<E>;
+
+template <typename T, typename E>
+class Expected {
+public:
+  using value_type = T;
+  using error_type = E;
+
+  Expected(T value) : underlying_(std::in_place_index<0>, std::move(value)) {}
+  Expected(Unexpected<E> error)
+      : underlying_(std::in_place_index<1>, std::move(error.error)) {}
+
+  bool has_value() const noexcept { return underlying_.index() == 0; }
+  explicit operator bool() const noexcept { return has_value(); }
+
+  // the value must be there
+  T& operator*() & noexcept { return *std::get_if<0>(&underlying_); }
+  T const& operator*() const& noexcept {
+    return *std::get_if<0>(&underlying_);
+  }
+  T&& operator*() && noexcept { return std::move(**this); }
+  T* operator->() noexcept { return std::get_if<0>(&underlying_); }
+  T const* operator->() const noexcept { return std::get_if<0>(&underlying_); }
+
+  // the error must be there
+  E const& error() const noexcept { return *std::get_if<1>(&underlying_); }
+
+  // @return `f(value)`, which gives an `Expected` with the same error type;
+  // or the error, without calling `f`
+  template <typename F>
+  auto and_then(F&& f) && {
+    using Result = std::invoke_result_t<F, T&&>;
+    static_assert(
+        std::is_same_v<typename Result::error_type, E>,
+        "and_then must give back the same error type");
+    if (has_value()) {
+      return std::forward<F>(f)(std::move(**this));
+    } else {
+      return Result(Unexpected<E>{error()});
+    }
+  }
+
+private:
+  std::variant<T, E> underlying_;
+};
+
+} // namespace ublib
@@ -1,28 +1,132 @@
 #pragma once
 
-#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <string>
 #include <string_view>
+#include <unordered_map>
 
 #include <ublib/checked_iterators.h>
 
 namespace ublib {
 
 // NOTE(ubsan): this string *is* a NTBS
+// strings of up to `inline_capacity` bytes are stored inline, and never
+// allocate; nearly every identifier is one of those. Longer strings are
+// shared, with an intrusive refcount.
+//
+// interned strings (see `interned`) are the exception: however short, they
+// point to the one copy of their characters the program has, which is never
+// freed. Copying one doesn't touch a refcount, and comparing or hashing two
+// of them doesn't look at the characters.
+//
+// the refcount isn't atomic, unless `UBLIB_SHARED_STRING_ATOMIC` is defined
+// (see the CMake option), so a string which isn't interned mustn't be copied
+// or destroyed on two threads at once; handing one to another thread is
+// fine. That's what the library does: the only thing its threads share are
+// `Ast`s, which intern their names.
 class Shared_string {
+public:
+  constexpr static std::size_t inline_capacity = 15;
+
+private:
+  struct Heap;
+
+  // set in `length_` for an interned string
+  constexpr static std::size_t interned_bit = ~(~std::size_t(0) >> 1);
+
   std::size_t length_;
-  std::shared_ptr<char const[]> underlying_;
+  union {
+    char inline_[inline_capacity + 1];
+    Heap* heap_;
+  };
+
+  bool is_inline() const noexcept { return length_ <= inline_capacity; }
+  // whether this holds a reference to a `Heap`
+  bool is_counted() const noexcept {
+    return length_ > inline_capacity and length_ < interned_bit;
+  }
+  static void release(Heap* heap) noexcept;
+  static void retain(Heap* heap) noexcept;
+  static char const* heap_data(Heap* heap) noexcept;
+  static std::size_t heap_hash(Heap* heap) noexcept;
+
+  // these all expect this to be empty, and don't release what it holds
+
+  // `other` is left empty
+  void take(Shared_string& other) noexcept {
+    length_ = other.length_;
+    copy_representation(other);
+    other.length_ = 0;
+    other.inline_[0] = '\0';
+  }
+  void copy_from(Shared_string const& other) noexcept {
+    length_ = other.length_;
+    copy_representation(other);
+    if (is_counted()) {
+      retain(heap_);
+    }
+  }
+  // copies whichever of `inline_` and `heap_` is in use, without a branch
+  void copy_representation(Shared_string const& other) noexcept {
+    std::memcpy(&inline_, &other.inline_, sizeof(inline_));
+  }
+
+  // releases what this holds, and leaves it empty
+  void clear() noexcept {
+    if (is_counted()) {
+      release(heap_);
+    }
+    length_ = 0;
+    inline_[0] = '\0';
+  }
 
 public:
-  Shared_string() noexcept : length_(0), underlying_(nullptr) {}
+  Shared_string() noexcept : length_(0), inline_() {}
 
-  Shared_string(Shared_string const&) noexcept = default;
-  Shared_string(Shared_string&&) noexcept = default;
-  Shared_string& operator=(Shared_string const&) noexcept = default;
-  Shared_string& operator=(Shared_string&&) noexcept = default;
-  ~Shared_string() = default;
+  Shared_string(Shared_string const& other) noexcept : length_(0) {
+    copy_from(other);
+  }
+  Shared_string(Shared_string&& other) noexcept : length_(0) { take(other); }
+  Shared_string& operator=(Shared_string const& other) noexcept {
+    if (this != &other) {
+      clear();
+      copy_from(other);
+    }
+    return *this;
+  }
+  Shared_string& operator=(Shared_string&& other) noexcept {
+    if (this != &other) {
+      clear();
+      take(other);
+    }
+    return *this;
+  }
+  ~Shared_string() {
+    if (is_counted()) {
+      release(heap_);
+    }
+  }
 
   Shared_string(std::string_view s);
 
+  // @return the interned copy of `s`; there's one for each distinct string,
+  // shared by the whole program, and it lives until the program exits.
+  // This takes a lock; an `Interner` in front of it only does so for the
+  // first occurrence of each name.
+  static Shared_string interned(std::string_view s);
+  // @return `s`, if it's interned already
+  static Shared_string interned(Shared_string s) {
+    if (s.is_interned()) {
+      return s;
+    }
+    return interned(std::string_view(s));
+  }
+
+  // whether this came from `interned`; copies of it did too
+  bool is_interned() const noexcept { return length_ >= interned_bit; }
+
   Shared_string(char const* first, char const* last)
       : Shared_string(std::string_view(first, last - first)) {}
   Shared_string(char const* ptr, std::size_t length)
@@ -31,11 +135,7 @@ public:
   Shared_string(char const* s) : Shared_string(std::string_view(s)) {}
 
   operator std::string_view() const noexcept {
-    if (empty()) {
-      return std::string_view();
-    } else {
-      return std::string_view(underlying_.get(), length_);
-    }
+    return std::string_view(data(), length());
   }
 
   using iterator = std::string_view::const_iterator;
@@ -43,11 +143,11 @@ public:
   using reverse_iterator = std::string_view::const_reverse_iterator;
   using const_reverse_iterator = reverse_iterator;
 
-  bool empty() const noexcept { return length_ == 0; }
-  std::size_t length() const noexcept { return length_; }
-  std::size_t size() const noexcept { return length_; }
+  bool empty() const noexcept { return length() == 0; }
+  std::size_t length() const noexcept { return length_ & ~interned_bit; }
+  std::size_t size() const noexcept { return length(); }
   char const& operator[](std::size_t idx) const noexcept {
-    return underlying_.get()[idx];
+    return data()[idx];
   }
 
   // @throw std::out_of_range if idx >= size()
@@ -55,11 +155,13 @@ public:
     return std::string_view(*this).at(idx);
   }
 
-  char const& front() const noexcept { return underlying_.get()[0]; }
-  char const& back() const noexcept { return underlying_.get()[size() - 1]; }
+  char const& front() const noexcept { return data()[0]; }
+  char const& back() const noexcept { return data()[size() - 1]; }
 
   // returns a nul terminated string
-  char const* data() const noexcept { return underlying_.get(); }
+  char const* data() const noexcept {
+    return is_inline() ? inline_ : heap_data(heap_);
+  }
   char const* c_str() const noexcept { return data(); }
 
   iterator cbegin() const noexcept { return std::string_view(*this).cbegin(); }
@@ -76,10 +178,15 @@ public:
   }
   reverse_iterator rend() const noexcept { return crend(); }
 
+  // the same as hashing the characters as a `std::string_view`;
+  // an interned string has it worked out already
+  std::size_t hash() const noexcept;
+
   friend void swap(Shared_string& lhs, Shared_string& rhs) noexcept;
+  friend bool
+  operator==(Shared_string const& lhs, Shared_string const& rhs) noexcept;
 };
 
-bool operator==(Shared_string const& lhs, Shared_string const& rhs) noexcept;
 bool operator!=(Shared_string const& lhs, Shared_string const& rhs) noexcept;
 bool operator<(Shared_string const& lhs, Shared_string const& rhs) noexcept;
 bool operator>(Shared_string const& lhs, Shared_string const& rhs) noexcept;
@@ -88,14 +195,34 @@ bool operator>=(Shared_string const& lhs, Shared_string const& rhs) noexcept;
 
 std::ostream& operator<<(std::ostream& os, Shared_string const& rhs);
 
+// NOTE(ubsan): a cache in front of `Shared_string::interned`, so that
+// interning the same name again doesn't take the lock. It's meant to live
+// as long as one compilation; it isn't thread-safe, though many of them
+// can be used at once.
+class Interner {
+  // interned strings never move, or go away, so the keys can point into
+  // them
+  std::unordered_map<std::string_view, Shared_string> table_;
+
+public:
+  Interner() = default;
+  Interner(Interner const&) = delete;
+  Interner& operator=(Interner const&) = delete;
+
+  Shared_string const& intern(std::string_view s);
+
+  // the number of distinct strings
+  std::size_t size() const noexcept { return table_.size(); }
+};
+
 } // namespace ublib
 
 namespace std {
 
 template <>
 struct hash<::ublib::Shared_string> {
-  auto operator()(::ublib::Shared_string const& s) {
-    return ::std::hash<::std::string_view>()(s);
+  auto operator()(::ublib::Shared_string const& s) const noexcept {
+    return s.hash();
   }
 };
 
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace ublib {
+
+// NOTE(ubsan): a fixed set of worker threads, each with its own queue
+// a worker runs tasks from the back of its own queue, newest first, and once
+// that's empty, steals the oldest task from the front of another's.
+// Tasks submitted from a worker go on that worker's queue; tasks submitted
+// from any other thread are dealt out to the queues in turn.
+class Thread_pool {
+public:
+  using Task = std::function<void()>;
+
+  // @param threads the number of workers; zero means one per core
+  explicit Thread_pool(std::size_t threads = 0);
+
+  Thread_pool(Thread_pool const&) = delete;
+  Thread_pool& operator=(Thread_pool const&) = delete;
+
+  // runs every task that's already been submitted, then joins the workers
+  ~Thread_pool();
+
+  std::size_t size() const noexcept { return workers_.size(); }
+
+  // tasks must not throw
+  void submit(Task task);
+
+  // runs one queued task on the calling thread, if there is one;
+  // a thread waiting on the pool can call this instead of blocking
+  // @return whether a task was run
+  bool run_one();
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  // takes from the back of `queues_[self]`, or steals from the front of
+  // another queue; `self` may be past the end, for threads outside the pool
+  std::optional<Task> take(std::size_t self);
+  void work(std::size_t self);
+
+  // never resized once the workers start, so workers can index it freely
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> workers_;
+
+  // guards `pending_` and `stopping_`; workers sleep on `wake_`
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  // tasks submitted and not taken yet
+  std::size_t pending_ = 0;
+  bool stopping_ = false;
+  // the queue the next task from outside the pool goes to
+  std::size_t next_queue_ = 0;
+};
+
+} // namespace ublib
@@ -0,0 +1,1151 @@
+#include <lambda/parse_ast.h>
+#include <lambda/ast.h>
+#include <lambda/arena_ast.h>
+#include <lambda/ast_factory.h>
+#include <lambda/binary.h>
+#include <lambda/bytecode.h>
+#include <lambda/emit_c.h>
+#include <lambda/environment.h>
+#include <lambda/eval_cache.h>
+#include <lambda/jets.h>
+#include <lambda/machine.h>
+#include <lambda/net.h>
+#include <lambda/normalize.h>
+#include <lambda/parallel.h>
+#include <lambda/print.h>
+
+#include <ublib/failure.h>
+#include <ublib/shared_string.h>
+#include <ublib/thread_pool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+using namespace std::literals;
+
+// NOTE(ubsan): every allocation in the program goes through these,
+// so that each phase can report how much it allocates
+namespace {
+  std::atomic<std::size_t> allocations{0};
+  std::atomic<std::size_t> allocated_bytes{0};
+
+  void* counted_allocate(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (auto p = std::malloc(size == 0 ? 1 : size)) {
+      return p;
+    }
+    throw std::bad_alloc();
+  }
+} // namespace
+
+void* operator new(std::size_t size) { return counted_allocate(size); }
+void* operator new[](std::size_t size) { return counted_allocate(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+// NOTE(ubsan): the workloads are generated as source, so that parsing is
+// measured too. Every application is written `(callee) (argument)`;
+// the parser nests a parenthesized argument around the rest of the
+// application list, so this is the one spelling that's unambiguous.
+
+std::string app(std::string_view callee, std::string_view argument) {
+  auto ret = std::string("(");
+  ret.append(callee).append(") (").append(argument).append(")");
+  return ret;
+}
+
+std::string app(
+    std::string_view callee,
+    std::string_view first,
+    std::string_view second) {
+  return app(app(callee, first), second);
+}
+
+std::string lam(std::string_view variable, std::string_view body) {
+  auto ret = std::string("(/");
+  ret.append(variable).append(".").append(body).append(")");
+  return ret;
+}
+
+std::string let(
+    std::string_view name, std::string_view value, std::string_view body) {
+  return app(lam(name, body), value);
+}
+
+// f (f (... (f x)))
+std::string chain(std::string_view f, std::string_view x, int depth) {
+  auto ret = std::string();
+  for (int i = 0; i < depth; ++i) {
+    ret.append(f).append(" (");
+  }
+  ret.append(x);
+  ret.append(static_cast<std::size_t>(depth), ')');
+  return ret;
+}
+
+// a complete binary tree of applications of `x`, with 2^depth leaves
+std::string balanced(std::string_view x, int depth) {
+  if (depth == 0) {
+    return std::string(x);
+  }
+  auto const half = balanced(x, depth - 1);
+  return app(half, half);
+}
+
+std::string numeral(int n) { return lam("f", lam("x", chain("f", "x", n))); }
+
+// the same as lambdac's
+constexpr static auto default_program = R"(
+(/fix./z.
+  (/fib.fib z)
+  (fix (/f./x.x))
+)
+(/f.(/x.f (/z.x x z)) (/x.f (/z.x x z)))
+z
+)"sv;
+
+// the call-by-value fixpoint combinator from the default program
+constexpr static auto fix = "(/f.(/x.f (/z.x x z)) (/x.f (/z.x x z)))"sv;
+
+struct Definition {
+  std::string name;
+  std::string term;
+};
+
+// the Church arithmetic used by the workloads; each definition can use the
+// ones before it
+std::vector<Definition> prelude() {
+  auto const if_then_else = [](auto cond, auto then, auto otherwise) {
+    // the branches are delayed, so that only one is evaluated
+    return app(app(cond, lam("d", then), lam("d", otherwise)), "(/i.i)");
+  };
+
+  auto ret = std::vector<Definition>();
+  ret.push_back(Definition{"fix", std::string(fix)});
+  ret.push_back(Definition{
+      "add",
+      lam("m",
+          lam("n",
+              lam("f", lam("x", app("m", "f", app("n", "f", "x"))))))});
+  ret.push_back(Definition{
+      "mult", lam("m", lam("n", lam("f", app("m", app("n", "f")))))});
+  ret.push_back(Definition{"exp", lam("m", lam("n", app("n", "m")))});
+  ret.push_back(Definition{
+      "pred",
+      lam("n",
+          lam("f",
+              lam("x",
+                  app(app("n",
+                          lam("g", lam("h", app("h", app("g", "f")))),
+                          lam("u", "x")),
+                      lam("u", "u")))))});
+  ret.push_back(Definition{"true", lam("t", lam("f", "t"))});
+  ret.push_back(Definition{"false", lam("t", lam("f", "f"))});
+  ret.push_back(Definition{
+      "iszero", lam("n", app("n", lam("x", "false"), "true"))});
+  ret.push_back(Definition{
+      "fact",
+      app("fix",
+          lam("fact",
+              lam("n",
+                  if_then_else(
+                      app("iszero", "n"),
+                      numeral(1),
+                      app("mult", "n", app("fact", app("pred", "n")))))))});
+  auto const fib_body = if_then_else(
+      app("iszero", "n"),
+      numeral(0),
+      if_then_else(
+          app("iszero", app("pred", "n")),
+          numeral(1),
+          app("add",
+              app("fib", app("pred", "n")),
+              app("fib", app("pred", app("pred", "n"))))));
+  ret.push_back(
+      Definition{"fib", app("fix", lam("fib", lam("n", fib_body)))});
+  return ret;
+}
+
+// binds the prelude around `body`
+std::string with_prelude(std::string_view body) {
+  auto program = std::string(body);
+  auto const definitions = prelude();
+  for (auto it = definitions.rbegin(); it != definitions.rend(); ++it) {
+    program = let(it->name, it->term, program);
+  }
+  return program;
+}
+
+// applies a Church numeral to free variables, so evaluation has to build it
+std::string unfold(std::string_view numeral) {
+  return app(numeral, "s", "z");
+}
+
+struct Workload {
+  std::string name;
+  std::string source;
+};
+
+std::vector<Workload> workloads() {
+  auto ret = std::vector<Workload>();
+  ret.push_back(Workload{"default_program", std::string(default_program)});
+  ret.push_back(Workload{
+      "church_add",
+      with_prelude(unfold(app("add", numeral(1000), numeral(1000))))});
+  ret.push_back(Workload{
+      "church_mult",
+      with_prelude(unfold(app("mult", numeral(100), numeral(100))))});
+  ret.push_back(Workload{
+      "church_exp", with_prelude(unfold(app("exp", numeral(2), numeral(10))))});
+  ret.push_back(
+      Workload{"fact_y", with_prelude(unfold(app("fact", numeral(5))))});
+  ret.push_back(
+      Workload{"fib_y", with_prelude(unfold(app("fib", numeral(10))))});
+  ret.push_back(Workload{
+      "deep_chain", let("i", "(/x.x)", chain("i", "z", 10000))});
+  ret.push_back(Workload{"wide", app(lam("x", balanced("x", 14)), "(/y.y)")});
+  // the same few names, over and over
+  ret.push_back(Workload{"repeated_names", balanced(lam("x", "s"), 12)});
+  return ret;
+}
+
+// throws away everything printed to it
+class Null_buffer : public std::streambuf {
+protected:
+  int_type overflow(int_type c) override { return c; }
+  std::streamsize xsputn(char const*, std::streamsize n) override {
+    return n;
+  }
+};
+
+struct Options {
+  std::chrono::nanoseconds min_time = 200ms;
+  std::optional<std::string_view> filter;
+};
+
+[[noreturn]] void usage(int argc, char const* const* argv) {
+  auto const program_name = (argc > 0) ? argv[0] : "[program]";
+  ublib::failwith("Usage: ", program_name, " [--quick] [workload]");
+}
+
+Options get_options(int argc, char const* const* argv) {
+  auto ret = Options();
+  for (int i = 1; i < argc; ++i) {
+    auto const arg = std::string_view(argv[i]);
+    if (arg == "--quick"sv) {
+      ret.min_time = 10ms;
+    } else if (arg.substr(0, 2) == "--"sv or ret.filter) {
+      usage(argc, argv);
+    } else {
+      ret.filter = arg;
+    }
+  }
+  return ret;
+}
+
+// @return the peak resident set size of the process so far, or nothing if
+// this platform doesn't say
+std::optional<long> peak_rss_kb() {
+#if defined(__unix__) || defined(__APPLE__)
+  auto usage = rusage();
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024; // in bytes on macOS
+#else
+    return usage.ru_maxrss;
+#endif
+  }
+#endif
+  return std::nullopt;
+}
+
+struct Result {
+  std::size_t iterations;
+  double ns_per_op;
+  double allocations_per_op;
+  double bytes_per_op;
+};
+
+// `op` does `batch` operations each time it's called
+Result measure(
+    Options const& opts,
+    std::function<void()> const& op,
+    std::size_t batch = 1) {
+  using clock = std::chrono::steady_clock;
+
+  op(); // warm up
+
+  auto const start_allocations = allocations.load();
+  auto const start_bytes = allocated_bytes.load();
+  auto const start = clock::now();
+  auto iterations = std::size_t(0);
+  auto elapsed = clock::duration();
+  do {
+    op();
+    ++iterations;
+    elapsed = clock::now() - start;
+  } while (elapsed < opts.min_time);
+
+  auto const n = static_cast<double>(iterations * batch);
+  return Result{
+      iterations,
+      std::chrono::duration<double, std::nano>(elapsed).count() / n,
+      static_cast<double>(allocations.load() - start_allocations) / n,
+      static_cast<double>(allocated_bytes.load() - start_bytes) / n};
+}
+
+void print_result(
+    std::ostream& os,
+    bool& first,
+    std::string_view workload,
+    std::string_view phase,
+    Result const& r) {
+  os << (first ? "\n" : ",\n");
+  first = false;
+  os << "    {\"workload\": \"" << workload << "\", \"phase\": \"" << phase
+     << "\", \"iterations\": " << r.iterations
+     << ", \"ns_per_op\": " << r.ns_per_op
+     << ", \"allocations_per_op\": " << r.allocations_per_op
+     << ", \"bytes_per_op\": " << r.bytes_per_op << ", \"peak_rss_kb\": ";
+  if (auto rss = peak_rss_kb()) {
+    os << *rss;
+  } else {
+    os << "null";
+  }
+  os << '}';
+}
+
+// NOTE(ubsan): how `eval_parallel` scales with threads, from one up to one
+// per core. The workload is a free variable applied to eight independent
+// multiplications, so there's work to go around.
+void bench_parallel(Options const& opts, bool& first) {
+  auto source = std::string("k");
+  for (int i = 0; i < 8; ++i) {
+    source = app(source, unfold(app("mult", numeral(130 + i), numeral(4))));
+  }
+  auto const ast = lambda::parse_to_ast(with_prelude(source));
+
+  auto const cores = std::max(1u, std::thread::hardware_concurrency());
+  auto threads = std::vector<unsigned>();
+  for (auto n = 1u; n < cores; n *= 2) {
+    threads.push_back(n);
+  }
+  threads.push_back(cores);
+
+  print_result(
+      std::cout,
+      first,
+      "parallel",
+      "eval",
+      measure(opts, [&] { lambda::eval(ast); }));
+  std::cout.flush();
+  for (auto const n : threads) {
+    auto pool = ublib::Thread_pool(n);
+    auto const phase = "eval_parallel_" + std::to_string(n);
+    print_result(
+        std::cout,
+        first,
+        "parallel",
+        phase,
+        measure(opts, [&] { lambda::eval_parallel(ast, pool); }));
+    std::cout.flush();
+  }
+}
+
+// NOTE(ubsan): what a line of `lambdac --repl` costs, with the prelude
+// defined up front, against wrapping the prelude around it, the way a
+// program has to be written otherwise
+void bench_repl(Options const& opts, bool& first) {
+  auto env = lambda::Environment();
+  for (auto const& definition : prelude()) {
+    auto const ast = env.resolve(lambda::parse_to_ast(definition.term));
+    env.define(ublib::Shared_string(definition.name), lambda::eval(ast));
+  }
+
+  auto const line = unfold(app("add", numeral(2), numeral(2)));
+  auto const program = with_prelude(line);
+
+  print_result(
+      std::cout,
+      first,
+      "repl",
+      "with_prelude",
+      measure(opts, [&] { lambda::eval(lambda::parse_to_ast(program)); }));
+  print_result(
+      std::cout,
+      first,
+      "repl",
+      "defined_prelude",
+      measure(opts, [&] {
+        lambda::eval(env.resolve(lambda::parse_to_ast(line)));
+      }));
+  std::cout.flush();
+}
+
+// NOTE(ubsan): `reduce` and `eval` keep their work on the heap once a term
+// is too deep to recurse through; these are how they were written when they
+// always recursed, for comparison on terms that are shallow enough for
+// either. The recursive `reduce` looks names up with a linear search, like
+// it did before the scoped hash map; `eval` substitutes the same way as
+// `eval_without_jets`, so only the recursion differs.
+namespace recursive {
+  lambda::Ast reduce(
+      lambda::Parse_ast const& ast,
+      std::vector<std::string_view>& context,
+      ublib::Interner& names) {
+    using lambda::Ast;
+    using lambda::Parse_ast;
+    return ublib::match(ast)(
+        [&](Parse_ast::Variable const& e) {
+          auto const found =
+              std::find(context.rbegin(), context.rend(), e.name());
+          if (found == context.rend()) {
+            return Ast(Ast::Free_variable(names.intern(e.name())));
+          }
+          return Ast(Ast::Variable(static_cast<int>(found - context.rbegin())));
+        },
+        [&](Parse_ast::Call const& e) {
+          auto argument = recursive::reduce(e.argument(), context, names);
+          auto callee = recursive::reduce(e.callee(), context, names);
+          return Ast(Ast::Call(std::move(callee), std::move(argument)));
+        },
+        [&](Parse_ast::Lambda const& e) {
+          context.push_back(e.parameter());
+          auto body = recursive::reduce(e.expression(), context, names);
+          context.pop_back();
+          return Ast(Ast::Lambda(names.intern(e.parameter()), std::move(body)));
+        });
+  }
+
+  lambda::Ast
+  substitute(lambda::Ast const& expr, lambda::Ast const& arg, int index) {
+    using lambda::Ast;
+    if (expr.max_free_index() < index) {
+      return expr;
+    }
+    return ublib::match(expr)(
+        [&](Ast::Lambda const& e) {
+          auto body = substitute(e.expression(), arg, index + 1);
+          if (same_node(body, e.expression())) {
+            return expr;
+          }
+          return Ast(Ast::Lambda(e.variable(), std::move(body)));
+        },
+        [&](Ast::Call const& e) {
+          auto callee = substitute(e.callee(), arg, index);
+          auto argument = substitute(e.argument(), arg, index);
+          if (same_node(callee, e.callee()) and
+              same_node(argument, e.argument())) {
+            return expr;
+          }
+          return Ast(Ast::Call(std::move(callee), std::move(argument)));
+        },
+        [&](Ast::Variable const& e) { return e.index() == index ? arg : expr; },
+        [&](Ast::Free_variable const&) { return expr; });
+  }
+
+  lambda::Ast eval(lambda::Ast const& ast) {
+    using lambda::Ast;
+    return ublib::match(ast)(
+        [&](Ast::Call const& e) {
+          auto callee = recursive::eval(e.callee());
+          auto argument = recursive::eval(e.argument());
+          return ublib::match(callee)(
+              [&](Ast::Lambda const& lambda) {
+                return recursive::eval(
+                    substitute(lambda.expression(), argument, 0));
+              },
+              [&](auto const&) { return Ast(Ast::Call(callee, argument)); });
+        },
+        [&](auto const&) { return ast; });
+  }
+} // namespace recursive
+
+void bench_recursion(Options const& opts, bool& first) {
+  // the rest are too slow to evaluate without jets
+  constexpr static std::string_view names[] = {
+      "default_program",
+      "church_add",
+      "fact_y",
+      "deep_chain",
+      "wide",
+      "repeated_names",
+  };
+
+  for (auto const& workload : workloads()) {
+    if (std::find(std::begin(names), std::end(names), workload.name) ==
+        std::end(names)) {
+      continue;
+    }
+
+    auto const parse = lambda::parse_from(std::string_view(workload.source));
+    auto const ast = lambda::reduce(parse);
+    auto const name = "recursion_" + workload.name;
+
+    auto const phases =
+        std::vector<std::pair<std::string_view, std::function<void()>>>{
+            {"reduce", [&] { lambda::reduce(parse); }},
+            {"reduce_recursive",
+             [&] {
+               auto context = std::vector<std::string_view>();
+               auto names = ublib::Interner();
+               recursive::reduce(parse, context, names);
+             }},
+            {"eval_without_jets", [&] { lambda::eval_without_jets(ast); }},
+            {"eval_recursive", [&] { recursive::eval(ast); }},
+        };
+    for (auto const& [phase, op] : phases) {
+      print_result(std::cout, first, name, phase, measure(opts, op));
+      std::cout.flush();
+    }
+  }
+}
+
+// NOTE(ubsan): `eval` with a cache of values, on a program that evaluates
+// the same closed subterm eight times; with a cache that's new every time,
+// like one run of `lambdac --cache-size`, and one that's kept across runs,
+// like `lambdac --cache=file`. `church_mult` never repeats anything, so it
+// only pays for the lookups.
+void bench_cache(Options const& opts, bool& first) {
+  auto source = std::string("k");
+  for (int i = 0; i < 8; ++i) {
+    source = app(source, unfold(app("fact", numeral(4))));
+  }
+  auto const programs = std::vector<std::pair<std::string_view, lambda::Ast>>{
+      {"cache_repeated", lambda::parse_to_ast(with_prelude(source))},
+      {"cache_church_mult",
+       lambda::parse_to_ast(
+           with_prelude(unfold(app("mult", numeral(100), numeral(100)))))},
+  };
+
+  for (auto const& [name, ast] : programs) {
+    auto warm = lambda::Eval_cache();
+    auto const phases =
+        std::vector<std::pair<std::string_view, std::function<void()>>>{
+            {"eval", [&] { lambda::eval(ast); }},
+            {"eval_cold_cache",
+             [&] {
+               auto cache = lambda::Eval_cache();
+               lambda::eval(ast, cache);
+             }},
+            {"eval_warm_cache", [&] { lambda::eval(ast, warm); }},
+        };
+    for (auto const& [phase, op] : phases) {
+      print_result(std::cout, first, name, phase, measure(opts, op));
+      std::cout.flush();
+    }
+  }
+}
+
+// NOTE(ubsan): a batch where three programs in four are malformed, parsed
+// with the throwing functions, and with the ones that give the error back;
+// and the same for evaluating, where three terms in four use a variable
+// that isn't bound. Each pass goes over the whole corpus.
+void bench_errors(Options const& opts, bool& first) {
+  auto const valid = app(lam("x", "x"), numeral(3));
+  auto const malformed = std::vector<std::string>{
+      valid + " .",
+      "(" + valid,
+      app(valid, "/x.x") + " /y.y",
+      valid + " (* unclosed",
+      "/. x",
+      valid + " #",
+  };
+  auto sources = std::vector<std::string>();
+  for (std::size_t i = 0; i < 256; ++i) {
+    sources.push_back(i % 4 == 0 ? valid : malformed[i % malformed.size()]);
+  }
+
+  auto terms = std::vector<lambda::Ast>();
+  auto const callee = lambda::parse_to_ast(valid);
+  for (std::size_t i = 0; i < 256; ++i) {
+    if (i % 4 == 0) {
+      terms.push_back(lambda::Ast(lambda::Ast::Call(callee, callee)));
+    } else {
+      terms.push_back(
+          lambda::Ast(lambda::Ast::Call(callee, lambda::Ast::Variable(0))));
+    }
+  }
+
+  // keeps the error counts from being optimized away
+  auto errors = std::size_t(0);
+  auto const phases =
+      std::vector<std::pair<std::string_view, std::function<void()>>>{
+          {"parse_to_ast",
+           [&] {
+             for (auto const& source : sources) {
+               try {
+                 lambda::parse_to_ast(source);
+               } catch (lambda::Parse_error const&) {
+                 ++errors;
+               }
+             }
+           }},
+          {"try_parse_to_ast",
+           [&] {
+             for (auto const& source : sources) {
+               errors += not lambda::try_parse_to_ast(source);
+             }
+           }},
+          {"eval",
+           [&] {
+             for (auto const& term : terms) {
+               try {
+                 lambda::eval(term);
+               } catch (lambda::Eval_error const&) {
+                 ++errors;
+               }
+             }
+           }},
+          {"try_eval",
+           [&] {
+             for (auto const& term : terms) {
+               errors += not lambda::try_eval(term);
+             }
+           }},
+      };
+  for (auto const& [phase, op] : phases) {
+    print_result(std::cout, first, "errors", phase, measure(opts, op));
+    std::cout.flush();
+  }
+  if (errors == 0) {
+    std::cerr << "the malformed inputs didn't fail\n";
+  }
+}
+
+// NOTE(ubsan): compiles every workload with `emit_c`, builds it with the
+// system C compiler (`$CC`, or `cc`), and checks that it prints what
+// `eval` gives; then times it. A run of the program evaluates the term
+// `repeat` times, so starting the process is mostly amortized away.
+// @return whether every program printed the same as `eval`
+bool bench_emit_c(Options const& opts, bool& first) {
+  namespace fs = std::filesystem;
+  constexpr auto repeat = std::size_t(100);
+
+  auto const compiler = [] {
+    auto const cc = std::getenv("CC");
+    return std::string(cc and *cc ? cc : "cc");
+  }();
+  auto const dir = fs::temp_directory_path() /
+      ("lambda_bench_emit_c_" + std::to_string(std::random_device()()));
+  fs::create_directories(dir);
+
+  auto ok = true;
+  auto expected = std::string();
+  for (auto const& workload : workloads()) {
+    auto const ast = lambda::parse_to_ast(workload.source);
+    auto const source = dir / (workload.name + ".c");
+    auto const program = dir / workload.name;
+    auto const output = dir / (workload.name + ".out");
+    {
+      auto file = std::ofstream(source);
+      lambda::emit_c(file, ast);
+    }
+
+    auto const build = compiler + " -std=c99 -O2 -o \"" + program.string() +
+        "\" \"" + source.string() + "\"";
+    if (std::system(build.c_str()) != 0) {
+      std::cerr << "emit_c: couldn't build " << workload.name << " with `"
+                << build << "`\n";
+      ok = false;
+      continue;
+    }
+
+    auto const run = "\"" + program.string() + "\" 1 > \"" +
+        output.string() + "\"";
+    auto got = std::string();
+    if (std::system(run.c_str()) == 0) {
+      auto file = std::ifstream(output);
+      std::getline(file, got);
+    }
+    lambda::print(expected, lambda::eval(ast));
+    if (got != expected) {
+      std::cerr << "emit_c: " << workload.name
+                << " doesn't print the same as eval\n";
+      ok = false;
+      continue;
+    }
+
+    auto const timed = "\"" + program.string() + "\" " +
+        std::to_string(repeat) + " > \"" + output.string() + "\"";
+    print_result(
+        std::cout,
+        first,
+        workload.name,
+        "native",
+        measure(
+            opts, [&] { static_cast<void>(std::system(timed.c_str())); },
+            repeat));
+    std::cout.flush();
+  }
+
+  fs::remove_all(dir);
+  return ok;
+}
+
+// NOTE(ubsan): the interaction net against the two other normalizers, on
+// terms where sharing matters; there's no `fix` around, since the net
+// reduces inside everything. How many interactions and betas the net does,
+// next to the steps `normalize` does, goes to stderr.
+void bench_net(Options const& opts, bool& first) {
+  auto const square = lam("n", lam("f", app("n", app("n", "f"))));
+  auto const tower = lam("t", app(app("t", "t"), "t"));
+  auto const terms = std::vector<std::pair<std::string_view, std::string>>{
+      {"net_square", unfold(app(square, numeral(10)))},
+      {"net_tower", unfold(app(tower, numeral(2)))},
+      {"net_self", unfold(app(lam("t", app("t", "t")), numeral(3)))},
+  };
+
+  for (auto const& [name, source] : terms) {
+    auto const ast = lambda::parse_to_ast(source);
+
+    auto const steps = lambda::normalize(ast).steps;
+    auto const stats = lambda::normalize_net(ast).stats;
+    std::cerr << name << ": " << steps << " steps to normalize; net: " << stats
+              << '\n';
+
+    print_result(
+        std::cout,
+        first,
+        name,
+        "normalize",
+        measure(opts, [&] { lambda::normalize(ast); }));
+    print_result(
+        std::cout,
+        first,
+        name,
+        "normalize_nbe",
+        measure(opts, [&] { lambda::normalize_nbe(ast); }));
+    print_result(
+        std::cout,
+        first,
+        name,
+        "normalize_net",
+        measure(opts, [&] { lambda::normalize_net(ast); }));
+    std::cout.flush();
+  }
+}
+
+// NOTE(ubsan): a differential check of `normalize_nbe`, against `normalize`,
+// and against itself on the value `eval` gives; they should all find the
+// same normal form. The terms are random, but simply typed, so every way of
+// evaluating them terminates. They're built out of a few free variables,
+// and Church numerals, `add` and `mult`, which are bound around each term;
+// there are redexes of a few types besides, under lambdas and in arguments.
+// Normal forms are compared up to the names of binders, by building them
+// out of one `Ast_factory`.
+//
+// @return whether every normal form agreed
+bool bench_nbe(Options const& opts, bool& first) {
+  constexpr auto count = 500;
+  constexpr auto max_depth = 8;
+
+  // a simple type; the base type, if `from` and `to` are both null
+  struct Type {
+    std::shared_ptr<Type const> from;
+    std::shared_ptr<Type const> to;
+
+    bool is_base() const noexcept { return from == nullptr; }
+  };
+  using Type_ptr = std::shared_ptr<Type const>;
+  auto const base = std::make_shared<Type const>();
+  auto const arrow = [](Type_ptr from, Type_ptr to) {
+    return std::make_shared<Type const>(Type{std::move(from), std::move(to)});
+  };
+  auto const same = [](Type_ptr const& lhs, Type_ptr const& rhs) {
+    auto todo = std::vector<std::pair<Type const*, Type const*>>{
+        {lhs.get(), rhs.get()}};
+    while (not todo.empty()) {
+      auto const [l, r] = todo.back();
+      todo.pop_back();
+      if (l->is_base() != r->is_base()) {
+        return false;
+      }
+      if (not l->is_base()) {
+        todo.push_back({l->from.get(), r->from.get()});
+        todo.push_back({l->to.get(), r->to.get()});
+      }
+    }
+    return true;
+  };
+
+  auto const unary = arrow(base, base);
+  auto const binary = arrow(base, unary);
+  auto const church = arrow(unary, unary);
+  // the types of the redexes
+  auto const redex_types = std::vector<Type_ptr>{base, unary, binary, church};
+
+  struct Binding {
+    std::string name;
+    Type_ptr type;
+  };
+  auto random = std::mt19937(0x4E4245);
+  auto const chance = [&](int percent) {
+    return std::uniform_int_distribution<int>(0, 99)(random) < percent;
+  };
+
+  // NOTE(ubsan): a term of type `type`, with the variables in `context`;
+  // the depth of the term is bounded by the types once `depth` runs out,
+  // since only the free `z` is picked for the base type then
+  auto const generate = [&](auto const& self,
+                            std::vector<Binding>& context,
+                            Type_ptr const& type,
+                            int depth) -> std::string {
+    if (not type->is_base() and (depth <= 0 or chance(40))) {
+      auto name = "x" + std::to_string(context.size());
+      context.push_back(Binding{name, type->from});
+      auto body = self(self, context, type->to, depth - 1);
+      context.pop_back();
+      return lam(name, body);
+    }
+    if (depth <= 0) {
+      return "z";
+    }
+    if (chance(25)) {
+      auto const& argument_type =
+          redex_types[random() % redex_types.size()];
+      auto name = "x" + std::to_string(context.size());
+      context.push_back(Binding{name, argument_type});
+      auto body = self(self, context, type, depth - 1);
+      context.pop_back();
+      return app(
+          lam(name, body), self(self, context, argument_type, depth - 1));
+    }
+
+    // a variable whose type ends in `type`, applied to enough arguments
+    auto candidates = std::vector<std::pair<Binding const*, int>>();
+    for (auto const& binding : context) {
+      auto arguments = 0;
+      for (auto t = binding.type; t; t = t->to, ++arguments) {
+        if (same(t, type)) {
+          candidates.push_back({&binding, arguments});
+          break;
+        }
+      }
+    }
+    if (candidates.empty()) {
+      return self(self, context, type, 0);
+    }
+    auto const [binding, arguments] = candidates[random() % candidates.size()];
+    auto ret = binding->name;
+    auto t = binding->type;
+    for (auto i = 0; i < arguments; ++i, t = t->to) {
+      ret = app(ret, self(self, context, t->from, depth - 1));
+    }
+    return ret;
+  };
+
+  auto const church_binary = arrow(church, arrow(church, church));
+  auto const add = lam(
+      "m",
+      lam("n", lam("f", lam("x", app("m", "f", app("n", "f", "x"))))));
+  auto const mult = lam("m", lam("n", lam("f", app("m", app("n", "f")))));
+  auto const definitions = std::vector<std::pair<Binding, std::string>>{
+      {{"add", church_binary}, add},
+      {{"mult", church_binary}, mult},
+      {{"two", church}, numeral(2)},
+      {{"three", church}, numeral(3)},
+  };
+
+  auto sources = std::vector<std::string>();
+  auto terms = std::vector<lambda::Ast>();
+  for (auto i = 0; i < count; ++i) {
+    // the free variables, then the definitions
+    auto context = std::vector<Binding>{
+        {"z", base}, {"s", unary}, {"g", binary}, {"n", church}};
+    for (auto const& [binding, definition] : definitions) {
+      context.push_back(binding);
+    }
+    auto const& type =
+        redex_types[static_cast<std::size_t>(i) % redex_types.size()];
+    auto source = generate(generate, context, type, max_depth);
+    for (auto it = definitions.rbegin(); it != definitions.rend(); ++it) {
+      source = let(it->first.name, it->second, source);
+    }
+    sources.push_back(std::move(source));
+    terms.push_back(lambda::parse_to_ast(sources.back()));
+  }
+
+  auto ok = true;
+  auto factory = lambda::Ast_factory();
+  for (std::size_t i = 0; i < terms.size(); ++i) {
+    auto const& term = terms[i];
+    auto const normal = lambda::normalize(term).term;
+    auto const nbe = lambda::normalize_nbe(term);
+    auto const nbe_of_value = lambda::normalize_nbe(lambda::eval(term));
+
+    auto const expected = factory.intern(normal);
+    if (not same_node(factory.intern(nbe), expected) or
+        not same_node(factory.intern(nbe_of_value), expected)) {
+      std::cerr << "nbe: the normal forms of " << sources[i]
+                << " don't agree\n  normalize: " << normal
+                << "\n  normalize_nbe: " << nbe
+                << "\n  normalize_nbe after eval: " << nbe_of_value << '\n';
+      ok = false;
+    }
+  }
+
+  auto const corpus =
+      std::vector<std::pair<std::string_view, std::function<void()>>>{
+          {"normalize",
+           [&] {
+             for (auto const& term : terms) {
+               lambda::normalize(term);
+             }
+           }},
+          {"normalize_nbe",
+           [&] {
+             for (auto const& term : terms) {
+               lambda::normalize_nbe(term);
+             }
+           }},
+      };
+  for (auto const& [phase, op] : corpus) {
+    print_result(
+        std::cout, first, "nbe_random", phase, measure(opts, op, count));
+    std::cout.flush();
+  }
+
+  // NOTE(ubsan): terms far deeper than the native stack; nested lambdas,
+  // and a chain of stuck calls that evaluation builds, which have to be
+  // read back and freed without recursing
+  constexpr auto deep = 300000;
+  auto lambdas = std::string();
+  auto stuck = std::string("(/y.");
+  for (auto i = 0; i < deep; ++i) {
+    lambdas.append("/x.");
+    stuck.append("y ");
+  }
+  lambdas.append("x");
+  stuck.append("y) s");
+  auto const deep_terms = std::vector<std::pair<std::string_view, lambda::Ast>>{
+      {"nbe_deep_lambdas", lambda::parse_to_ast(lambdas)},
+      {"nbe_deep_stuck", lambda::parse_to_ast(stuck)},
+  };
+  for (auto const& [name, term] : deep_terms) {
+    print_result(
+        std::cout,
+        first,
+        name,
+        "normalize_nbe",
+        measure(opts, [&] { lambda::normalize_nbe(term); }));
+    std::cout.flush();
+  }
+  return ok;
+}
+
+// NOTE(ubsan): microbenchmarks for the strings every name is stored in
+// short strings are stored inline; long ones are refcounted
+void bench_shared_string(Options const& opts, bool& first) {
+  constexpr auto batch = std::size_t(1000);
+  using ublib::Shared_string;
+
+  auto short_sources = std::vector<std::string>();
+  auto long_sources = std::vector<std::string>();
+  for (std::size_t i = 0; i < batch; ++i) {
+    short_sources.push_back("x" + std::to_string(i % 100));
+    long_sources.push_back("a_rather_long_name_" + std::to_string(i % 100));
+  }
+  auto const make_all = [](std::vector<std::string> const& sources) {
+    return std::vector<Shared_string>(sources.begin(), sources.end());
+  };
+  auto const short_strings = make_all(short_sources);
+  auto const long_strings = make_all(long_sources);
+  // equal to the originals, but not sharing their data
+  auto const short_copies = make_all(short_sources);
+  auto const long_copies = make_all(long_sources);
+  // as the names of an `Ast` are; each is the one interned copy
+  auto const intern_all = [](std::vector<std::string> const& sources) {
+    auto names = ublib::Interner();
+    auto ret = std::vector<Shared_string>();
+    for (auto const& s : sources) {
+      ret.push_back(names.intern(s));
+    }
+    return ret;
+  };
+  auto const long_interned = intern_all(long_sources);
+  auto const long_interned_copies = intern_all(long_sources);
+
+  // keeps the results alive, so nothing is optimized out
+  auto sink = std::size_t(0);
+  auto storage = std::vector<Shared_string>(batch);
+
+  auto const construct = [&](std::vector<std::string> const& sources) {
+    return [&] {
+      for (std::size_t i = 0; i < batch; ++i) {
+        storage[i] = Shared_string(sources[i]);
+      }
+    };
+  };
+  // copies into fresh strings, and destroys them again
+  auto const copy = [&](std::vector<Shared_string> const& strings) {
+    return [&] {
+      auto copies = strings;
+      sink += copies.size();
+    };
+  };
+  auto const compare = [&](
+      std::vector<Shared_string> const& lhs,
+      std::vector<Shared_string> const& rhs) {
+    return [&] {
+      for (std::size_t i = 0; i < batch; ++i) {
+        sink += lhs[i] == rhs[i];
+      }
+    };
+  };
+  auto const hash = [&](std::vector<Shared_string> const& strings) {
+    return [&] {
+      for (auto const& s : strings) {
+        sink += std::hash<Shared_string>()(s);
+      }
+    };
+  };
+
+  auto const phases =
+      std::vector<std::pair<std::string_view, std::function<void()>>>{
+          {"construct_short", construct(short_sources)},
+          {"construct_long", construct(long_sources)},
+          {"copy_short", copy(short_strings)},
+          {"copy_long", copy(long_strings)},
+          {"compare_short", compare(short_strings, short_copies)},
+          {"compare_long", compare(long_strings, long_copies)},
+          {"compare_long_shared", compare(long_strings, long_strings)},
+          {"copy_long_interned", copy(long_interned)},
+          {"compare_long_interned",
+           compare(long_interned, long_interned_copies)},
+          {"hash_long", hash(long_strings)},
+          {"hash_long_interned", hash(long_interned)},
+      };
+
+  for (auto const& [phase, op] : phases) {
+    print_result(
+        std::cout, first, "shared_string", phase, measure(opts, op, batch));
+  }
+  if (sink == 0) {
+    std::cerr << "the comparisons didn't compare\n";
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  auto const opts = get_options(argc, argv);
+
+  auto null_buffer = Null_buffer();
+  auto null_stream = std::ostream(&null_buffer);
+  auto print_buffer = std::string();
+
+  std::cout << "{\n  \"benchmarks\": [";
+  auto first = true;
+
+  for (auto const& workload : workloads()) {
+    if (opts.filter and workload.name != *opts.filter) {
+      continue;
+    }
+
+    auto const source = std::string_view(workload.source);
+    auto const parse = lambda::parse_from(source);
+    auto const ast = lambda::reduce(parse);
+    auto const arena = lambda::Arena_ast(ast);
+    auto const binary = [&] {
+      auto os = std::ostringstream();
+      lambda::write_binary(os, ast);
+      return std::move(os).str();
+    }();
+
+    auto const phases =
+        std::vector<std::pair<std::string_view, std::function<void()>>>{
+            {"parse", [&] { lambda::parse_from(source); }},
+            {"reduce", [&] { lambda::reduce(parse); }},
+            // `parse` and `reduce` in one pass
+            {"parse_to_ast", [&] { lambda::parse_to_ast(source); }},
+            {"write_binary",
+             [&] {
+               auto os = std::ostringstream();
+               lambda::write_binary(os, ast);
+             }},
+            // what `lambdac --load-binary` does instead of `parse_to_ast`
+            {"read_binary", [&] { lambda::read_binary(binary); }},
+            {"read_binary_arena", [&] { lambda::read_binary_arena(binary); }},
+            {"eval", [&] { lambda::eval(ast); }},
+            // what `eval` would be, without recognizing Church numerals
+            {"eval_without_jets", [&] { lambda::eval_without_jets(ast); }},
+            // the results of `deep_chain` and `wide` are tiny;
+            // the input is what's worth printing
+            {"print", [&] { null_stream << ast; }},
+            // without the stream, into a buffer that's reused
+            {"print_buffer", [&] { lambda::print(print_buffer, ast); }},
+            {"eval_cek", [&] { lambda::eval_cek(ast); }},
+            {"eval_arena", [&] { lambda::eval(arena); }},
+            {"eval_bytecode",
+             [&] { lambda::eval(lambda::Bytecode(ast)); }},
+        };
+
+    for (auto const& [phase, op] : phases) {
+      print_result(std::cout, first, workload.name, phase, measure(opts, op));
+      std::cout.flush();
+    }
+  }
+
+  if (not opts.filter or *opts.filter == "shared_string"sv) {
+    bench_shared_string(opts, first);
+  }
+  if (not opts.filter or *opts.filter == "repl"sv) {
+    bench_repl(opts, first);
+  }
+  if (not opts.filter or *opts.filter == "recursion"sv) {
+    bench_recursion(opts, first);
+  }
+  if (not opts.filter or *opts.filter == "parallel"sv) {
+    bench_parallel(opts, first);
+  }
+  if (not opts.filter or *opts.filter == "net"sv) {
+    bench_net(opts, first);
+  }
+  if (not opts.filter or *opts.filter == "cache"sv) {
+    bench_cache(opts, first);
+  }
+  if (not opts.filter or *opts.filter == "errors"sv) {
+    bench_errors(opts, first);
+  }
+  auto nbe_ok = true;
+  if (not opts.filter or *opts.filter == "nbe"sv) {
+    nbe_ok = bench_nbe(opts, first);
+  }
+  auto native_ok = true;
+  if (not opts.filter or *opts.filter == "emit_c"sv) {
+    native_ok = bench_emit_c(opts, first);
+  }
+
+  std::cout << "\n  ],\n  \"peak_rss_kb\": ";
+  if (auto rss = peak_rss_kb()) {
+    std::cout << *rss;
+  } else {
+    std::cout << "null";
+  }
+  std::cout << "\n}\n";
+  return nbe_ok and native_ok ? 0 : 1;
+}
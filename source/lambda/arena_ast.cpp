@@ -0,0 +1,613 @@
+#include <lambda/arena_ast.h>
+#include <lambda/print.h>
+
+#include "context.h"
+
+#include <ublib/failure.h>
+#include <ublib/utility.h>
+
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace lambda {
+
+using Index = Arena_ast::Index;
+using Tag = Arena_ast::Tag;
+
+Index Arena_ast::push(Tag tag, Index first, Index second) {
+  if (tags_.size() >= no_index) {
+    throw std::length_error("Arena_ast is full");
+  }
+  tags_.push_back(tag);
+  nodes_.push_back(Node{first, second});
+  return root_ = static_cast<Index>(tags_.size() - 1);
+}
+
+Index Arena_ast::push_name(ublib::Shared_string name) {
+  if (names_.size() >= no_index) {
+    throw std::length_error("Arena_ast is full");
+  }
+  names_.push_back(std::move(name));
+  return static_cast<Index>(names_.size() - 1);
+}
+
+void Arena_ast::reserve(std::size_t nodes) {
+  tags_.reserve(nodes);
+  nodes_.reserve(nodes);
+}
+
+Index Arena_ast::variable(int index) {
+  assert(index >= 0);
+  return push(Tag::variable, static_cast<Index>(index), 0);
+}
+
+Index Arena_ast::free_variable(ublib::Shared_string name) {
+  return push(Tag::free_variable, push_name(std::move(name)), 0);
+}
+
+Index Arena_ast::call(Index callee, Index argument) {
+  assert(callee < size() and argument < size());
+  return push(Tag::call, callee, argument);
+}
+
+Index Arena_ast::lambda(ublib::Shared_string variable, Index expression) {
+  assert(expression < size());
+  return push(Tag::lambda, push_name(std::move(variable)), expression);
+}
+
+// NOTE(ubsan): none of the traversals in here recurse, like the ones in
+// ast.cpp; terms can be far deeper than the native stack. A frame is either
+// on its way down (children not done yet), or on its way back up (children
+// are on the `done` stack).
+
+Arena_ast::Arena_ast(Ast const& ast) {
+  struct Frame {
+    Ast const* ast;
+    bool children_done;
+  };
+
+  // NOTE(ubsan): `Ast`s share subterms after evaluation;
+  // we keep that sharing, keyed on the address of the shared node
+  auto seen = std::unordered_map<void const*, Index>();
+  auto todo = std::vector<Frame>{Frame{&ast, false}};
+  auto done = std::vector<Index>();
+
+  while (not todo.empty()) {
+    auto const frame = todo.back();
+    todo.pop_back();
+
+    ublib::match(*frame.ast)(
+        [&](Ast::Variable const& e) { done.push_back(variable(e.index())); },
+        [&](Ast::Free_variable const& e) {
+          done.push_back(free_variable(e.name()));
+        },
+        [&](Ast::Call const& e) {
+          if (not frame.children_done) {
+            if (auto it = seen.find(&e); it != seen.end()) {
+              done.push_back(it->second);
+              return;
+            }
+            // the callee is added first, then the argument
+            todo.push_back(Frame{frame.ast, true});
+            todo.push_back(Frame{&e.argument(), false});
+            todo.push_back(Frame{&e.callee(), false});
+          } else {
+            auto const argument = done.back();
+            done.pop_back();
+            auto const callee = done.back();
+            done.pop_back();
+            done.push_back(seen[&e] = call(callee, argument));
+          }
+        },
+        [&](Ast::Lambda const& e) {
+          if (not frame.children_done) {
+            if (auto it = seen.find(&e); it != seen.end()) {
+              done.push_back(it->second);
+              return;
+            }
+            todo.push_back(Frame{frame.ast, true});
+            todo.push_back(Frame{&e.expression(), false});
+          } else {
+            auto const expression = done.back();
+            done.pop_back();
+            done.push_back(seen[&e] = lambda(e.variable(), expression));
+          }
+        });
+  }
+
+  root_ = done.back();
+}
+
+Ast to_ast(Arena_ast const& arena) {
+  struct Frame {
+    Index idx;
+    bool children_done;
+  };
+
+  // shared nodes of the arena become shared nodes of the `Ast`
+  auto seen = std::vector<std::optional<Ast>>(arena.size());
+  auto todo = std::vector<Frame>{Frame{arena.root(), false}};
+  auto done = std::vector<Ast>();
+
+  while (not todo.empty()) {
+    auto const frame = todo.back();
+    todo.pop_back();
+
+    auto const idx = frame.idx;
+    if (not frame.children_done and seen[idx]) {
+      done.push_back(*seen[idx]);
+      continue;
+    }
+
+    switch (arena.tag(idx)) {
+    case Tag::variable:
+      done.push_back(Ast(Ast::Variable(arena.index(idx))));
+      break;
+    case Tag::free_variable:
+      done.push_back(Ast(Ast::Free_variable(arena.name(idx))));
+      break;
+    case Tag::call:
+      if (not frame.children_done) {
+        todo.push_back(Frame{idx, true});
+        todo.push_back(Frame{arena.argument(idx), false});
+        todo.push_back(Frame{arena.callee(idx), false});
+        continue;
+      } else {
+        auto argument = std::move(done.back());
+        done.pop_back();
+        auto callee = std::move(done.back());
+        done.pop_back();
+        done.push_back(Ast(Ast::Call(std::move(callee), std::move(argument))));
+      }
+      break;
+    case Tag::lambda:
+      if (not frame.children_done) {
+        todo.push_back(Frame{idx, true});
+        todo.push_back(Frame{arena.expression(idx), false});
+        continue;
+      } else {
+        auto expression = std::move(done.back());
+        done.pop_back();
+        done.push_back(
+            Ast(Ast::Lambda(arena.name(idx), std::move(expression))));
+      }
+      break;
+    }
+    seen[idx] = done.back();
+  }
+
+  return std::move(done.back());
+}
+
+Arena_ast reduce_to_arena(Parse_ast const& ast) {
+  struct Frame {
+    Parse_ast const* ast;
+    bool children_done;
+  };
+
+  auto ret = Arena_ast();
+  auto context = Context();
+  // every occurrence of a name shares one string
+  auto names = ublib::Interner();
+  auto todo = std::vector<Frame>{Frame{&ast, false}};
+  auto done = std::vector<Index>();
+
+  while (not todo.empty()) {
+    auto const frame = todo.back();
+    todo.pop_back();
+
+    ublib::match(*frame.ast)(
+        [&](Parse_ast::Variable const& e) {
+          if (auto idx = find_in_context(context, e.name())) {
+            done.push_back(ret.variable(*idx));
+          } else {
+            done.push_back(ret.free_variable(names.intern(e.name())));
+          }
+        },
+        [&](Parse_ast::Call const& e) {
+          if (not frame.children_done) {
+            // the argument is reduced first, then the callee
+            todo.push_back(Frame{frame.ast, true});
+            todo.push_back(Frame{&e.callee(), false});
+            todo.push_back(Frame{&e.argument(), false});
+          } else {
+            auto const callee = done.back();
+            done.pop_back();
+            auto const argument = done.back();
+            done.pop_back();
+            done.push_back(ret.call(callee, argument));
+          }
+        },
+        [&](Parse_ast::Lambda const& e) {
+          if (not frame.children_done) {
+            context.push_back(e.parameter());
+            todo.push_back(Frame{frame.ast, true});
+            todo.push_back(Frame{&e.expression(), false});
+          } else {
+            context.pop_back();
+            auto const typed = done.back();
+            done.pop_back();
+            done.push_back(ret.lambda(names.intern(e.parameter()), typed));
+          }
+        });
+  }
+
+  ret.set_root(done.back());
+  return ret;
+}
+
+namespace {
+  // NOTE(ubsan): this is the same machine as `eval_cek`, but everything it
+  // allocates lives in vectors, and refers to each other by index
+  // the environments are never freed until the evaluation is over
+
+  struct Value {
+    enum class Kind : std::uint8_t {
+      closure,
+      neutral,
+    };
+
+    Kind kind;
+    // for a closure, the lambda node; for a neutral, the index in `neutrals`
+    Index node;
+    // the environment of a closure
+    Index env;
+  };
+
+  struct Env_node {
+    Value value;
+    Index next;
+    // the index of the value read back into the output arena
+    Index quoted;
+  };
+
+  struct Neutral_node {
+    // either a free variable node (when `callee == no_index`),
+    // or a call of a neutral
+    Index free;
+    Index callee;
+    Value argument;
+  };
+
+  constexpr auto no_index = Arena_ast::no_index;
+
+  struct Machine {
+    Arena_ast const& code;
+    std::vector<Env_node> envs;
+    std::vector<Neutral_node> neutrals;
+
+    Index push_env(Value value, Index next) {
+      envs.push_back(Env_node{value, next, no_index});
+      return static_cast<Index>(envs.size() - 1);
+    }
+
+    Index push_neutral(Neutral_node n) {
+      neutrals.push_back(n);
+      return static_cast<Index>(neutrals.size() - 1);
+    }
+
+    Index lookup(Index env, int index) const noexcept {
+      for (; env != no_index and index > 0; --index) {
+        env = envs[env].next;
+      }
+      return env;
+    }
+
+    Value run() {
+      struct Frame {
+        enum class Kind : std::uint8_t {
+          // evaluate the argument of a call
+          eval_argument,
+          // call the callee with the value we just got
+          apply,
+        };
+
+        Kind kind;
+        Index argument;
+        Index env;
+        Value callee;
+      };
+      std::vector<Frame> kont;
+
+      auto control = code.root();
+      auto env = no_index;
+
+      for (;;) {
+        auto value = std::optional<Value>();
+        switch (code.tag(control)) {
+        case Tag::call:
+          kont.push_back(Frame{
+              Frame::Kind::eval_argument, code.argument(control), env, {}});
+          control = code.callee(control);
+          break;
+        case Tag::variable:
+          if (auto node = lookup(env, code.index(control)); node != no_index) {
+            value = envs[node].value;
+          } else {
+            throw Eval_error("evaluation found an unbound non-free variable");
+          }
+          break;
+        case Tag::free_variable:
+          value = Value{
+              Value::Kind::neutral,
+              push_neutral(Neutral_node{control, no_index, {}}),
+              no_index};
+          break;
+        case Tag::lambda:
+          value = Value{Value::Kind::closure, control, env};
+          break;
+        }
+
+        while (value) {
+          if (kont.empty()) {
+            return *value;
+          }
+
+          auto const frame = kont.back();
+          kont.pop_back();
+
+          switch (frame.kind) {
+          case Frame::Kind::eval_argument:
+            kont.push_back(Frame{Frame::Kind::apply, no_index, no_index, *value});
+            value.reset();
+            control = frame.argument;
+            env = frame.env;
+            break;
+          case Frame::Kind::apply:
+            if (frame.callee.kind == Value::Kind::closure) {
+              env = push_env(*value, frame.callee.env);
+              control = code.expression(frame.callee.node);
+              value.reset();
+            } else {
+              value = Value{
+                  Value::Kind::neutral,
+                  push_neutral(Neutral_node{no_index, frame.callee.node, *value}),
+                  no_index};
+            }
+            break;
+          }
+        }
+      }
+    }
+  };
+} // namespace
+
+Arena_ast eval(Arena_ast const& ast) {
+  // NOTE(ubsan): reads the value back recursively, as usual, up to
+  // `max_level` calls deep; past that, the rest of the value is read back in
+  // a loop, with `todo` and `done` on the heap, like `eval_cek` does. Going
+  // through the loop for everything is about a third slower on the terms
+  // the benchmarks use, so the loop is only for deep terms.
+  constexpr static int max_level = 1024;
+  struct helper {
+    struct Work {
+      enum class Kind : std::uint8_t {
+        // read back the closure of the lambda `node` in the environment `env`
+        quote_closure,
+        // read back `neutrals[node]`
+        quote_neutral,
+        // read back `node`, in the environment `env`, `depth` lambdas in
+        quote_body,
+        // wrap the node we just got in a lambda, named like `node`
+        make_lambda,
+        // call the callee we got with the argument we got after it
+        make_call,
+        // cache the node we just got as the value of the environment `env`
+        remember,
+      };
+
+      Kind kind;
+      Index node;
+      Index env;
+      int depth;
+    };
+
+    Machine& machine;
+    Arena_ast& out;
+    // only used past `max_level`; kept around, since the loop may be
+    // entered many times for one value
+    std::vector<Work> todo;
+    std::vector<Index> done;
+
+    static Work quote_work(Value v) noexcept {
+      if (v.kind == Value::Kind::closure) {
+        return Work{Work::Kind::quote_closure, v.node, v.env, 1};
+      } else {
+        return Work{Work::Kind::quote_neutral, v.node, no_index, 0};
+      }
+    }
+
+    Index quote_body(Index expr, Index env, int depth, int level) {
+      auto const& code = machine.code;
+      if (level == max_level) {
+        return quote_deep(Work{Work::Kind::quote_body, expr, env, depth});
+      }
+      switch (code.tag(expr)) {
+      case Tag::lambda: {
+        auto body =
+            quote_body(code.expression(expr), env, depth + 1, level + 1);
+        return out.push(Tag::lambda, code.nodes_[expr].first, body);
+      }
+      case Tag::call: {
+        auto callee = quote_body(code.callee(expr), env, depth, level + 1);
+        auto argument = quote_body(code.argument(expr), env, depth, level + 1);
+        return out.call(callee, argument);
+      }
+      case Tag::variable: {
+        auto const index = code.index(expr);
+        if (index >= depth) {
+          if (auto node = machine.lookup(env, index - depth);
+              node != no_index) {
+            if (machine.envs[node].quoted == no_index) {
+              // NOTE(ubsan): don't hold a reference across `quote`
+              auto q = quote(machine.envs[node].value, level + 1);
+              machine.envs[node].quoted = q;
+            }
+            return machine.envs[node].quoted;
+          }
+        }
+        return out.variable(index);
+      }
+      case Tag::free_variable:
+        return out.push(Tag::free_variable, code.nodes_[expr].first, 0);
+      }
+      return ublib::unreachable<Index>();
+    }
+
+    Index quote(Value value, int level) {
+      auto const& code = machine.code;
+      if (level == max_level) {
+        return quote_deep(quote_work(value));
+      }
+      if (value.kind == Value::Kind::closure) {
+        auto body =
+            quote_body(code.expression(value.node), value.env, 1, level + 1);
+        return out.push(Tag::lambda, code.nodes_[value.node].first, body);
+      }
+
+      auto const n = machine.neutrals[value.node];
+      if (n.callee == no_index) {
+        return out.push(Tag::free_variable, code.nodes_[n.free].first, 0);
+      } else {
+        auto callee =
+            quote(Value{Value::Kind::neutral, n.callee, no_index}, level + 1);
+        auto argument = quote(n.argument, level + 1);
+        return out.call(callee, argument);
+      }
+    }
+
+    // what `quote` and `quote_body` do, without recursing
+    Index quote_deep(Work const start) {
+      auto const& code = machine.code;
+      todo.push_back(start);
+
+      while (not todo.empty()) {
+        auto work = todo.back();
+        todo.pop_back();
+
+        // the first child of a node is read back right away, without going
+        // through `todo`; `next` is set when `work` has been replaced by it
+        for (auto next = true; next;) {
+          next = false;
+          switch (work.kind) {
+          case Work::Kind::quote_closure:
+            todo.push_back(
+                Work{Work::Kind::make_lambda, work.node, no_index, 0});
+            work = Work{
+                Work::Kind::quote_body,
+                code.expression(work.node),
+                work.env,
+                1};
+            next = true;
+            break;
+          case Work::Kind::quote_neutral: {
+            auto const& n = machine.neutrals[work.node];
+            if (n.callee == no_index) {
+              done.push_back(
+                  out.push(Tag::free_variable, code.nodes_[n.free].first, 0));
+            } else {
+              todo.push_back(
+                  Work{Work::Kind::make_call, no_index, no_index, 0});
+              todo.push_back(quote_work(n.argument));
+              work = Work{Work::Kind::quote_neutral, n.callee, no_index, 0};
+              next = true;
+            }
+            break;
+          }
+          case Work::Kind::quote_body: {
+            auto const expr = work.node;
+            switch (code.tag(expr)) {
+            case Tag::lambda:
+              todo.push_back(Work{Work::Kind::make_lambda, expr, no_index, 0});
+              work = Work{
+                  Work::Kind::quote_body,
+                  code.expression(expr),
+                  work.env,
+                  work.depth + 1};
+              next = true;
+              break;
+            case Tag::call:
+              todo.push_back(
+                  Work{Work::Kind::make_call, no_index, no_index, 0});
+              todo.push_back(Work{
+                  Work::Kind::quote_body,
+                  code.argument(expr),
+                  work.env,
+                  work.depth});
+              work = Work{
+                  Work::Kind::quote_body,
+                  code.callee(expr),
+                  work.env,
+                  work.depth};
+              next = true;
+              break;
+            case Tag::variable: {
+              auto const index = code.index(expr);
+              auto const node = index >= work.depth
+                  ? machine.lookup(work.env, index - work.depth)
+                  : no_index;
+              if (node == no_index) {
+                done.push_back(out.variable(index));
+              } else if (machine.envs[node].quoted != no_index) {
+                done.push_back(machine.envs[node].quoted);
+              } else {
+                todo.push_back(Work{Work::Kind::remember, no_index, node, 0});
+                work = quote_work(machine.envs[node].value);
+                next = true;
+              }
+              break;
+            }
+            case Tag::free_variable:
+              done.push_back(
+                  out.push(Tag::free_variable, code.nodes_[expr].first, 0));
+              break;
+            }
+            break;
+          }
+          case Work::Kind::make_lambda: {
+            auto const body = done.back();
+            done.pop_back();
+            done.push_back(
+                out.push(Tag::lambda, code.nodes_[work.node].first, body));
+            break;
+          }
+          case Work::Kind::make_call: {
+            auto const argument = done.back();
+            done.pop_back();
+            auto const callee = done.back();
+            done.pop_back();
+            done.push_back(out.call(callee, argument));
+            break;
+          }
+          case Work::Kind::remember:
+            machine.envs[work.env].quoted = done.back();
+            break;
+          }
+        }
+      }
+
+      auto const ret = done.back();
+      done.pop_back();
+      return ret;
+    }
+  };
+
+  auto machine = Machine{ast, {}, {}};
+  auto const value = machine.run();
+
+  auto ret = Arena_ast();
+  // the names are shared, so that the indices into them stay the same
+  ret.names_ = ast.names_;
+  ret.root_ = helper{machine, ret, {}, {}}.quote(value, 0);
+  return ret;
+}
+
+std::ostream& operator<<(std::ostream& os, Arena_ast const& ast) {
+  return print(os, ast);
+}
+
+} // namespace lambda
@@ -1,147 +1,838 @@
 #include <lambda/ast.h>
+#include <lambda/ast_factory.h>
+#include <lambda/eval_cache.h>
+#include <lambda/instrument.h>
+#include <lambda/jets.h>
+#include <lambda/parallel.h>
+#include <lambda/print.h>
+
+#include "church.h"
+#include "context.h"
+#include "parser.h"
 
 #include <ublib/failure.h>
 #include <ublib/utility.h>
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <future>
 #include <iostream>
 
-#include <algorithm>
-#include <iterator>
-#include <limits>
+#include <memory>
 #include <optional>
+#include <string_view>
+#include <variant>
 #include <vector>
 
 using namespace std::literals;
 
 namespace lambda {
 
-using Context = std::vector<std::string_view>;
-
 namespace {
-  std::optional<int>
-  find_in_context(Context const& ctxt, std::string_view to_find) {
-    using std::crbegin;
-    using std::crend;
+  // builds nodes through the factory, if there is one
+  struct Builder {
+    Ast_factory* factory;
+
+    Ast variable(int index) const {
+      if (factory) {
+        return factory->variable(index);
+      } else {
+        return Ast(Ast::Variable(index));
+      }
+    }
+    Ast free_variable(ublib::Shared_string name) const {
+      if (factory) {
+        return factory->free_variable(std::move(name));
+      } else {
+        return Ast(Ast::Free_variable(std::move(name)));
+      }
+    }
+    Ast call(Ast callee, Ast argument) const {
+      if (factory) {
+        return factory->call(std::move(callee), std::move(argument));
+      } else {
+        return Ast(Ast::Call(std::move(callee), std::move(argument)));
+      }
+    }
+    Ast lambda(ublib::Shared_string variable, Ast expression) const {
+      if (factory) {
+        return factory->lambda(std::move(variable), std::move(expression));
+      } else {
+        return Ast(Ast::Lambda(std::move(variable), std::move(expression)));
+      }
+    }
+  };
+
+  // the uninstrumented traversals are compiled with this;
+  // every hook is empty, so they compile away
+  struct No_instrument {
+    void node_built() const noexcept {}
+    void substitution() const noexcept {}
+    void depth(std::size_t) const noexcept {}
+    void beta(Ast const&, Ast const&) const noexcept {}
+  };
+
+  // null pointers in `Instrumentation` are checked on every hook;
+  // only the instrumented overloads pay for that
+  struct Recording_instrument {
+    Instrumentation inst;
+
+    void node_built() const noexcept {
+      if (inst.stats) {
+        ++inst.stats->nodes_built;
+      }
+    }
+    void substitution() const noexcept {
+      if (inst.stats) {
+        ++inst.stats->substitutions;
+      }
+    }
+    void depth(std::size_t depth) const noexcept {
+      if (inst.stats and depth > inst.stats->max_depth) {
+        inst.stats->max_depth = depth;
+      }
+    }
+    void beta(Ast const& lambda, Ast const& argument) const {
+      if (inst.stats) {
+        ++inst.stats->beta_steps;
+      }
+      if (inst.trace) {
+        auto const step = inst.stats ? inst.stats->beta_steps : 0;
+        *inst.trace << step << ": " << lambda << " <- " << argument << '\n';
+      }
+    }
+  };
+
+  // NOTE(ubsan): none of the traversals in here are limited by the native
+  // stack; terms can be far deeper than it. Shallow terms are walked
+  // recursively, which is up to twice as fast as going through a stack on
+  // the heap; past `max_level` calls deep, the rest of the subterm is walked
+  // with a heap-allocated stack instead, like `Ast::free_unique` frees.
+  // a frame is either on its way down (children not done yet),
+  // or on its way back up (children are on the `done` stack).
+  constexpr static int max_level = 1024;
+
+  // builds the `Ast` while parsing; `Reducer` builds it the same way, from
+  // a `Parse_ast`
+  template <typename Instrument>
+  struct Ast_sink {
+    using Term = Ast;
 
-    auto first = crbegin(ctxt);
-    auto last = crend(ctxt);
+    Builder make;
+    Instrument instrument;
+    Scope scope = Scope();
+    // every occurrence of a name shares one string
+    ublib::Interner names = ublib::Interner();
 
-    assert(last - first <= std::numeric_limits<int>::max());
+    Term variable(std::string_view name) {
+      instrument.node_built();
+      if (auto idx = scope.find(name)) {
+        return make.variable(*idx);
+      } else {
+        return make.free_variable(names.intern(name));
+      }
+    }
+    void bind(std::string_view name) { scope.push(name); }
+    Term lambda(std::string_view name, Term body) {
+      scope.pop();
+      instrument.node_built();
+      return make.lambda(names.intern(name), std::move(body));
+    }
+    Term call(Term callee, Term argument) {
+      instrument.node_built();
+      return make.call(std::move(callee), std::move(argument));
+    }
+  };
+
+  template <typename Instrument>
+  class Reducer {
+  public:
+    Reducer(Builder make, Instrument instrument)
+        : sink_{make, instrument} {}
 
-    auto found = std::find(first, last, to_find);
-    if (found == last) {
-      return std::nullopt;
-    } else {
-      return static_cast<int>(found - first);
+    Ast reduce(Parse_ast const& ast, int level = 0) {
+      if (level == max_level) {
+        return reduce_deep(ast);
+      }
+      return ublib::match(ast)(
+          [&](Parse_ast::Variable const& e) { return sink_.variable(e.name()); },
+          [&](Parse_ast::Call const& e) {
+            // the argument is reduced first, then the callee
+            auto argument = reduce(e.argument(), level + 1);
+            auto callee = reduce(e.callee(), level + 1);
+            return sink_.call(std::move(callee), std::move(argument));
+          },
+          [&](Parse_ast::Lambda const& e) {
+            sink_.bind(e.parameter());
+            auto body = reduce(e.expression(), level + 1);
+            return sink_.lambda(e.parameter(), std::move(body));
+          });
     }
+
+  private:
+    // what `reduce` does, without recursing
+    Ast reduce_deep(Parse_ast const& ast) {
+      struct Frame {
+        Parse_ast const* ast;
+        bool children_done;
+      };
+
+      auto todo = std::vector<Frame>{Frame{&ast, false}};
+      auto done = std::vector<Ast>();
+
+      while (not todo.empty()) {
+        auto const frame = todo.back();
+        todo.pop_back();
+
+        ublib::match(*frame.ast)(
+            [&](Parse_ast::Variable const& e) {
+              done.push_back(sink_.variable(e.name()));
+            },
+            [&](Parse_ast::Call const& e) {
+              if (not frame.children_done) {
+                todo.push_back(Frame{frame.ast, true});
+                todo.push_back(Frame{&e.callee(), false});
+                todo.push_back(Frame{&e.argument(), false});
+              } else {
+                auto callee = std::move(done.back());
+                done.pop_back();
+                auto arg = std::move(done.back());
+                done.pop_back();
+                done.push_back(sink_.call(std::move(callee), std::move(arg)));
+              }
+            },
+            [&](Parse_ast::Lambda const& e) {
+              if (not frame.children_done) {
+                sink_.bind(e.parameter());
+                todo.push_back(Frame{frame.ast, true});
+                todo.push_back(Frame{&e.expression(), false});
+              } else {
+                auto typed = std::move(done.back());
+                done.pop_back();
+                done.push_back(sink_.lambda(e.parameter(), std::move(typed)));
+              }
+            });
+      }
+
+      return std::move(done.back());
+    }
+
+    Ast_sink<Instrument> sink_;
+  };
+
+  template <typename Instrument>
+  Result<Ast>
+  parse_iter(std::string_view source, Builder make, Instrument instrument) {
+    auto sink = Ast_sink<Instrument>{make, instrument};
+    return Parser(source, sink).parse_term();
   }
 
-  Ast reduce_rec(Parse_ast const& ast, Context& context) {
-    return ublib::match(ast)(
-        [&](Parse_ast::Variable const& e) {
-          if (auto idx = find_in_context(context, e.name())) {
-            return Ast(Ast::Variable(*idx));
-          } else {
-            return Ast(Ast::Free_variable(e.name()));
+  // the sequential evaluators never fork; this compiles away, like
+  // `No_instrument`
+  struct No_fork {
+    // never made
+    struct Handle {};
+
+    bool wants(Ast::Call const&) const noexcept { return false; }
+    Handle spawn(Ast const&) { return ublib::unreachable<Handle>(); }
+    std::optional<Ast> reclaim(Handle&) {
+      return ublib::unreachable<std::optional<Ast>>();
+    }
+    Ast join(Handle&) { return ublib::unreachable<Ast>(); }
+  };
+
+  // evaluates arguments which are large enough on a thread pool, while the
+  // callee is evaluated on this thread
+  struct Pool_fork {
+    ublib::Thread_pool* pool;
+    std::size_t threshold;
+
+    // NOTE(ubsan): whoever sets `taken` first evaluates `argument`; either
+    // a worker, or the evaluator that forked it, once it gets to the join.
+    // Most forks are never stolen, and taking them back is much cheaper
+    // than waiting on another thread.
+    struct Forked {
+      explicit Forked(Ast argument) : argument(std::move(argument)) {}
+
+      std::atomic<bool> taken{false};
+      Ast argument;
+      std::promise<Ast> result;
+    };
+    struct Handle {
+      std::shared_ptr<Forked> forked;
+      std::future<Ast> result;
+    };
+
+    // @return whether the argument of `call` is worth evaluating on another
+    // thread; that is, whether it's a call of at least `threshold` nodes, and
+    // there's a callee to evaluate meanwhile. If the callee is already a
+    // value, we'd only be waiting on the argument straight away.
+    bool wants(Ast::Call const& call) const noexcept {
+      auto const is_call = [](Ast const& ast) {
+        return ublib::match(ast)(
+            [](Ast::Call const&) { return true; },
+            [](auto const&) { return false; });
+      };
+      return is_call(call.callee()) and is_call(call.argument()) and
+          call.argument().size() >= threshold;
+    }
+
+    // defined after `Evaluator`
+    Handle spawn(Ast argument);
+
+    // @return the argument, if no worker has started on it yet
+    std::optional<Ast> reclaim(Handle& handle) {
+      if (handle.forked->taken.exchange(true)) {
+        return std::nullopt;
+      }
+      return std::move(handle.forked->argument);
+    }
+
+    // while the argument isn't done, helps with whatever else is queued
+    Ast join(Handle& handle) {
+      using namespace std::chrono_literals;
+      auto& result = handle.result;
+      while (result.wait_for(0s) != std::future_status::ready) {
+        if (not pool->run_one()) {
+          // the argument is being evaluated on another thread
+          result.wait();
+        }
+      }
+      return result.get();
+    }
+  };
+
+  // the instrumented evaluator shows every step, so it doesn't take
+  // shortcuts; this compiles away
+  struct No_jets {
+    std::optional<Church> recognize(Ast const&) { return std::nullopt; }
+  };
+
+  // see lambda/jets.h
+  struct Church_jets {
+    Church_recognizer recognizer;
+
+    std::optional<Church> recognize(Ast const& callee) {
+      return recognizer.recognize(callee);
+    }
+  };
+
+  // evaluation doesn't remember anything by default; this compiles away
+  struct No_cache {
+    bool wants(Ast const&) const noexcept { return false; }
+    std::optional<Ast> find(Ast const&) {
+      return ublib::unreachable<std::optional<Ast>>();
+    }
+    void insert(Ast, Ast) { ublib::unreachable(); }
+  };
+
+  // see lambda/eval_cache.h
+  struct Memo_cache {
+    Eval_cache* cache;
+
+    bool wants(Ast const& term) const noexcept { return cache->wants(term); }
+    std::optional<Ast> find(Ast const& term) { return cache->find(term); }
+    void insert(Ast term, Ast value) {
+      cache->insert(std::move(term), std::move(value));
+    }
+  };
+
+  template <
+      typename Instrument,
+      typename Fork = No_fork,
+      typename Jets = No_jets,
+      typename Cache = No_cache>
+  class Evaluator {
+  public:
+    Evaluator(
+        Builder make,
+        Instrument instrument,
+        Fork fork = Fork(),
+        Jets jets = Jets(),
+        Cache cache = Cache())
+        : make_(make),
+          instrument_(instrument),
+          fork_(std::move(fork)),
+          jets_(std::move(jets)),
+          cache_(std::move(cache)) {}
+
+    // @throw Eval_error if the ast is not well-formed
+    Ast eval(Ast const& ast) { return value_or_throw(try_eval(ast)); }
+
+    Result<Ast> try_eval(Ast const& ast) {
+      // evaluate the argument of a call, after the callee
+      struct Eval_argument {
+        Ast const* argument;
+      };
+      // wait on an argument that was forked off, after the callee
+      struct Join_argument {
+        typename Fork::Handle argument;
+      };
+      // call the callee with the value we just got
+      struct Apply {
+        Ast callee;
+      };
+      // call `function` `count` times, starting with the value we just got
+      struct Iterate {
+        Ast function;
+        std::uint64_t count;
+      };
+      // ignore the value we just got, and give back `value` instead
+      struct Constant {
+        Ast value;
+      };
+      // remember the value we just got as the value of `term`
+      struct Memoize {
+        Ast term;
+      };
+      using Frame = std::variant<
+          Eval_argument,
+          Join_argument,
+          Apply,
+          Iterate,
+          Constant,
+          Memoize>;
+
+      // NOTE(ubsan): `control` and the `Eval_argument`s point into either
+      // `ast`, or the result of a substitution. Those results are kept
+      // alive in `owners` until the term they became `control` as is
+      // evaluated; at that point, the stack is back to the height it was
+      // at when they were made, and nothing above it can point into them.
+      struct Owner {
+        std::size_t height;
+        Ast root;
+      };
+
+      auto kont = std::vector<Frame>();
+      auto owners = std::vector<Owner>();
+      auto control = &ast;
+
+      if (cache_.wants(ast)) {
+        if (auto value = cache_.find(ast)) {
+          return std::move(*value);
+        }
+        kont.push_back(Memoize{ast});
+      }
+
+      auto const release_from = [&](std::size_t height) {
+        while (not owners.empty() and owners.back().height >= height) {
+          owners.pop_back();
+        }
+      };
+
+      auto unbound = false;
+      for (;;) {
+        auto value = ublib::match(*control)(
+            [&](Ast::Call const& e) -> std::optional<Ast> {
+              if (fork_.wants(e)) {
+                kont.push_back(Join_argument{fork_.spawn(e.argument())});
+              } else {
+                kont.push_back(Eval_argument{&e.argument()});
+              }
+              instrument_.depth(kont.size());
+              control = &e.callee();
+              return std::nullopt;
+            },
+            [&](Ast::Variable const&) -> std::optional<Ast> {
+              unbound = true;
+              return std::nullopt;
+            },
+            [&](Ast::Free_variable const&) -> std::optional<Ast> {
+              return *control;
+            },
+            [&](Ast::Lambda const&) -> std::optional<Ast> { return *control; });
+        if (unbound) {
+          return fail(Error_code::unbound_variable);
+        }
+
+        while (value) {
+          release_from(kont.size());
+
+          if (kont.empty()) {
+            return std::move(*value);
           }
-        },
-        [&](Parse_ast::Call const& e) {
-          auto arg = reduce_rec(e.argument(), context);
-          auto callee = reduce_rec(e.callee(), context);
-          return Ast(Ast::Call(std::move(callee), std::move(arg)));
-        },
-        [&](Parse_ast::Lambda const& e) {
-          context.push_back(e.parameter());
-          auto typed = reduce_rec(e.expression(), context);
-          context.pop_back();
-          return Ast(Ast::Lambda(e.parameter(), std::move(typed)));
-        });
-  }
 
-} // namespace
+          auto frame = std::move(kont.back());
+          kont.pop_back();
 
-Ast reduce(Parse_ast const& ast) {
-  std::vector<std::string_view> context;
-  return reduce_rec(ast, context);
-}
+          ublib::match(frame)(
+              [&](Eval_argument& f) {
+                kont.push_back(Apply{std::move(*value)});
+                if (cache_.wants(*f.argument)) {
+                  if (auto cached = cache_.find(*f.argument)) {
+                    value = std::move(cached);
+                    return;
+                  }
+                  kont.push_back(Memoize{*f.argument});
+                }
+                value.reset();
+                control = f.argument;
+              },
+              [&](Join_argument& f) {
+                // NOTE(ubsan): only joined once the callee is done, so that
+                // if both fail, the callee's error wins, like in `eval`
+                kont.push_back(Apply{std::move(*value)});
+                if (auto argument = fork_.reclaim(f.argument)) {
+                  // nobody took it; evaluate it here, as if it hadn't been
+                  // forked
+                  value.reset();
+                  owners.push_back(Owner{kont.size(), std::move(*argument)});
+                  control = &owners.back().root;
+                } else {
+                  value = fork_.join(f.argument);
+                }
+              },
+              [&](Iterate& f) {
+                if (f.count > 1) {
+                  kont.push_back(Iterate{f.function, f.count - 1});
+                }
+                kont.push_back(Apply{std::move(f.function)});
+              },
+              [&](Constant& f) { value = std::move(f.value); },
+              [&](Memoize& f) { cache_.insert(std::move(f.term), *value); },
+              [&](Apply& f) {
+                ublib::match(f.callee)(
+                    [&](Ast::Lambda const& e) {
+                      if (not kont.empty() and
+                          std::holds_alternative<Eval_argument>(kont.back())) {
+                        if (auto church = jets_.recognize(f.callee)) {
+                          // NOTE(ubsan): this call is the callee of another;
+                          // go straight to that one's argument, and do both
+                          // calls at once when it's done. Calling a numeral
+                          // with one argument can't fail, or call anything,
+                          // so nothing's lost by skipping it.
+                          release_from(kont.size());
+                          auto const argument =
+                              std::get<Eval_argument>(kont.back()).argument;
+                          kont.pop_back();
+                          if (church->is_true) {
+                            kont.push_back(Constant{std::move(*value)});
+                          } else if (church->count == 0) {
+                            // gives back the second argument as it is
+                          } else if (auto body = constant_body(*value)) {
+                            kont.push_back(Constant{*body});
+                          } else {
+                            kont.push_back(
+                                Iterate{std::move(*value), church->count});
+                          }
+                          value.reset();
+                          control = argument;
+                          return;
+                        }
+                      }
+
+                      instrument_.beta(f.callee, *value);
+                      auto body = substitute(e.expression(), *value);
+                      // a tail call; what we were evaluating is done
+                      release_from(kont.size());
+                      owners.push_back(Owner{kont.size(), std::move(body)});
+                      control = &owners.back().root;
+                      value.reset();
+                    },
+                    [&](Ast::Variable const&) {
+                      ublib::unreachable(); // should be impossible
+                    },
+                    [&](Ast::Call const&) {
+                      value = make_.call(std::move(f.callee), std::move(*value));
+                      instrument_.node_built();
+                    },
+                    [&](Ast::Free_variable const&) {
+                      value = make_.call(std::move(f.callee), std::move(*value));
+                      instrument_.node_built();
+                    });
+              });
+        }
+      }
+    }
+
+  private:
+    struct Substitute_frame {
+      Ast const* expr;
+      int index;
+      bool children_done;
+    };
+
+    // replaces the variable bound by the lambda `expr` is the body of
+    // subterms which don't change are shared with `expr`, not rebuilt; and
+    // a subterm whose free variables are all bound outside of that lambda
+    // isn't walked at all
+    //
+    // NOTE(ubsan): `arg` is always a value, and values are closed, so it
+    // never needs shifting as it goes under lambdas
+    Ast substitute(
+        Ast const& expr, Ast const& arg, int index = 0, int level = 0) {
+      if (expr.max_free_index() < index) {
+        return expr;
+      }
+      if (level == max_level) {
+        return substitute_deep(expr, arg, index);
+      }
 
-Ast eval(Ast const& ast) {
-  struct helper {
-    static Ast substitute(Ast const& expr, Ast const& arg, int index) {
       return ublib::match(expr)(
           [&](Ast::Lambda const& e) {
-            return Ast(Ast::Lambda(
-                e.variable(), substitute(e.expression(), arg, index + 1)));
+            auto expression =
+                substitute(e.expression(), arg, index + 1, level + 1);
+            if (same_node(expression, e.expression())) {
+              return expr;
+            }
+            instrument_.node_built();
+            return make_.lambda(e.variable(), std::move(expression));
           },
           [&](Ast::Call const& e) {
-            return Ast(Ast::Call(
-                substitute(e.callee(), arg, index),
-                substitute(e.argument(), arg, index)));
+            auto callee = substitute(e.callee(), arg, index, level + 1);
+            auto argument = substitute(e.argument(), arg, index, level + 1);
+            if (same_node(callee, e.callee()) and
+                same_node(argument, e.argument())) {
+              return expr;
+            }
+            instrument_.node_built();
+            return make_.call(std::move(callee), std::move(argument));
           },
           [&](Ast::Variable const& e) {
             if (e.index() == index) {
+              instrument_.substitution();
               return arg;
-            } else {
-              return Ast(e);
             }
+            return expr;
           },
-          [&](Ast::Free_variable const& e) { return Ast(e); });
-    };
+          [&](Ast::Free_variable const&) { return expr; });
+    }
 
-    static Ast do_call(Ast const& callee, Ast const& arg) {
-      auto const callee_eval = eval(callee);
-      auto const arg_eval = eval(arg);
+    // what `substitute` does, without recursing
+    Ast substitute_deep(Ast const& expr, Ast const& arg, int index) {
+      using Frame = Substitute_frame;
 
-      return ublib::match(callee_eval)(
-          [&](Ast::Lambda const& e) {
-            return eval(substitute(e.expression(), arg_eval, 0));
-          },
-          [&](Ast::Variable const&) {
-            return ublib::unreachable<Ast>(); // should be impossible
-          },
-          [&](Ast::Call const& e) { return Ast(Ast::Call(e, arg_eval)); },
-          [&](Ast::Free_variable const& e) {
-            return Ast(Ast::Call(e, arg_eval));
-          });
-    };
+      // reuse the stacks' allocations across calls
+      auto& todo = substitute_todo_;
+      auto& done = substitute_done_;
+      todo.push_back(Frame{&expr, index, false});
+
+      while (not todo.empty()) {
+        auto const frame = todo.back();
+        todo.pop_back();
+
+        if (not frame.children_done and
+            frame.expr->max_free_index() < frame.index) {
+          done.push_back(*frame.expr);
+          continue;
+        }
+
+        ublib::match(*frame.expr)(
+            [&](Ast::Lambda const& e) {
+              if (not frame.children_done) {
+                todo.push_back(Frame{frame.expr, frame.index, true});
+                todo.push_back(
+                    Frame{&e.expression(), frame.index + 1, false});
+              } else if (same_node(done.back(), e.expression())) {
+                done.back() = *frame.expr;
+              } else {
+                auto expression = std::move(done.back());
+                done.pop_back();
+                done.push_back(make_.lambda(e.variable(), std::move(expression)));
+                instrument_.node_built();
+              }
+            },
+            [&](Ast::Call const& e) {
+              if (not frame.children_done) {
+                todo.push_back(Frame{frame.expr, frame.index, true});
+                todo.push_back(Frame{&e.argument(), frame.index, false});
+                todo.push_back(Frame{&e.callee(), frame.index, false});
+                return;
+              }
+
+              auto argument = std::move(done.back());
+              done.pop_back();
+              if (same_node(done.back(), e.callee()) and
+                  same_node(argument, e.argument())) {
+                done.back() = *frame.expr;
+              } else {
+                auto callee = std::move(done.back());
+                done.pop_back();
+                done.push_back(make_.call(std::move(callee), std::move(argument)));
+                instrument_.node_built();
+              }
+            },
+            [&](Ast::Variable const& e) {
+              if (e.index() == frame.index) {
+                instrument_.substitution();
+                done.push_back(arg);
+              } else {
+                done.push_back(*frame.expr);
+              }
+            },
+            [&](Ast::Free_variable const&) { done.push_back(*frame.expr); });
+      }
+
+      auto ret = std::move(done.back());
+      done.pop_back();
+      return ret;
+    }
+
+    Builder make_;
+    Instrument instrument_;
+    Fork fork_;
+    Jets jets_;
+    Cache cache_;
+    std::vector<Ast> substitute_done_;
+    std::vector<Substitute_frame> substitute_todo_;
   };
+  Pool_fork::Handle Pool_fork::spawn(Ast argument) {
+    // NOTE(ubsan): a `std::function` has to be copyable; a `promise` isn't,
+    // so it's shared
+    auto forked = std::make_shared<Forked>(std::move(argument));
+    auto ret = Handle{forked, forked->result.get_future()};
+    pool->submit([forked, pool = pool, threshold = threshold] {
+      if (forked->taken.exchange(true)) {
+        return;
+      }
+      try {
+        auto fork = Pool_fork{pool, threshold};
+        forked->result.set_value(
+            Evaluator(Builder{nullptr}, No_instrument(), fork, Church_jets())
+                .eval(forked->argument));
+      } catch (...) {
+        forked->result.set_exception(std::current_exception());
+      }
+    });
+    return ret;
+  }
+} // namespace
+
+void Ast::free_unique() noexcept {
+  // NOTE(ubsan): shallow terms are freed recursively, as usual;
+  // past `max_depth`, nodes are pushed to `pending` instead, and freed in a
+  // loop by the first destructor to get that deep
+  constexpr static int max_depth = 256;
+  thread_local auto depth = 0;
+  thread_local auto pending = std::vector<std::shared_ptr<Underlying_type>>();
+  thread_local auto draining = false;
+
+  if (depth < max_depth) {
+    ++depth;
+    underlying_.reset();
+    --depth;
+    return;
+  }
+
+  pending.push_back(std::move(underlying_));
+  if (draining) {
+    return;
+  }
+
+  draining = true;
+  while (not pending.empty()) {
+    // the children get pushed to `pending` when this is freed
+    auto node = std::move(pending.back());
+    pending.pop_back();
+    node.reset();
+  }
+  draining = false;
+}
+
+Ast reduce(Parse_ast const& ast) {
+  return Reducer(Builder{nullptr}, No_instrument()).reduce(ast);
+}
 
-  return ublib::match(ast)(
-      [&](Ast::Call const& e) {
-        return helper::do_call(e.callee(), e.argument());
-      },
-      [&](Ast::Variable const&) {
-        return ublib::throw_as<Ast>(
-            Eval_error("evaluation found an unbound non-free variable"));
-      },
-      [&](Ast::Free_variable const& e) { return Ast(e); },
-      [&](Ast::Lambda const& e) { return Ast(e); });
+Result<Ast> try_reduce(Parse_ast const& ast) {
+  return Reducer(Builder{nullptr}, No_instrument()).reduce(ast);
+}
+
+Ast reduce(Parse_ast const& ast, Ast_factory& factory) {
+  return Reducer(Builder{&factory}, No_instrument()).reduce(ast);
+}
+
+Ast reduce(Parse_ast const& ast, Instrumentation inst, Ast_factory* factory) {
+  auto const start = std::chrono::steady_clock::now();
+  auto ret = Reducer(Builder{factory}, Recording_instrument{inst}).reduce(ast);
+  if (inst.stats) {
+    inst.stats->reduce_time += std::chrono::steady_clock::now() - start;
+  }
+  return ret;
+}
+
+Ast parse_to_ast(std::string_view source) {
+  return value_or_throw(try_parse_to_ast(source));
+}
+
+Result<Ast> try_parse_to_ast(std::string_view source) {
+  return parse_iter(source, Builder{nullptr}, No_instrument());
+}
+
+Ast parse_to_ast(std::string_view source, Ast_factory& factory) {
+  return value_or_throw(
+      parse_iter(source, Builder{&factory}, No_instrument()));
+}
+
+Ast parse_to_ast(
+    std::string_view source, Instrumentation inst, Ast_factory* factory) {
+  auto const start = std::chrono::steady_clock::now();
+  auto ret = value_or_throw(
+      parse_iter(source, Builder{factory}, Recording_instrument{inst}));
+  if (inst.stats) {
+    inst.stats->reduce_time += std::chrono::steady_clock::now() - start;
+  }
+  return ret;
+}
+
+Ast eval(Ast const& ast) {
+  return Evaluator(Builder{nullptr}, No_instrument(), No_fork(), Church_jets())
+      .eval(ast);
+}
+
+Result<Ast> try_eval(Ast const& ast) {
+  return Evaluator(Builder{nullptr}, No_instrument(), No_fork(), Church_jets())
+      .try_eval(ast);
+}
+
+Ast eval(Ast const& ast, Eval_cache& cache) {
+  return Evaluator(
+             Builder{nullptr},
+             No_instrument(),
+             No_fork(),
+             Church_jets(),
+             Memo_cache{&cache})
+      .eval(ast);
+}
+
+Ast eval_without_jets(Ast const& ast) {
+  return Evaluator(Builder{nullptr}, No_instrument()).eval(ast);
+}
+
+Ast eval(Ast const& ast, Ast_factory& factory) {
+  return Evaluator(Builder{&factory}, No_instrument(), No_fork(), Church_jets())
+      .eval(ast);
+}
+
+Ast eval_parallel(
+    Ast const& ast, ublib::Thread_pool& pool, std::size_t threshold) {
+  auto fork = Pool_fork{&pool, threshold};
+  return Evaluator(Builder{nullptr}, No_instrument(), fork, Church_jets())
+      .eval(ast);
+}
+
+Ast eval(Ast const& ast, Instrumentation inst, Ast_factory* factory) {
+  auto const start = std::chrono::steady_clock::now();
+  auto ret = Evaluator(Builder{factory}, Recording_instrument{inst}).eval(ast);
+  if (inst.stats) {
+    inst.stats->eval_time += std::chrono::steady_clock::now() - start;
+  }
+  return ret;
+}
+
+std::ostream& operator<<(std::ostream& os, Eval_stats const& stats) {
+  using ms = std::chrono::duration<double, std::milli>;
+  return os << "beta steps: " << stats.beta_steps
+            << "\nsubstitutions: " << stats.substitutions
+            << "\nnodes built: " << stats.nodes_built
+            << "\nmax depth: " << stats.max_depth
+            << "\nreduce time: " << ms(stats.reduce_time).count() << "ms"
+            << "\neval time: " << ms(stats.eval_time).count() << "ms";
 }
 
 std::ostream& operator<<(std::ostream& os, Ast const& ast) {
-  struct helper {
-    static std::ostream& rec(std::ostream& os, Ast const& ast, Context& ctxt) {
-      return ublib::match(ast)(
-          [&](Ast::Variable const& e) -> std::ostream& {
-            return os << ctxt.at(e.index()) << '_' << e.index();
-          },
-          [&](Ast::Free_variable const& e) -> std::ostream& { return os << e.name(); },
-          [&](Ast::Call const& e) -> std::ostream& {
-            rec(os, e.callee(), ctxt);
-            os << ' ';
-            return rec(os, e.argument(), ctxt);
-          },
-          [&](Ast::Lambda const& e) -> std::ostream& {
-            os << "(/" << e.variable() << '.';
-            ctxt.push_back(e.variable());
-            rec(os, e.expression(), ctxt);
-            ctxt.pop_back();
-            return os << ')';
-          });
-    }
-  };
-  std::vector<std::string_view> ctxt;
-  return helper::rec(os, ast, ctxt);
+  return print(os, ast);
 }
 
 } // namespace lambda
@@ -0,0 +1,94 @@
+#include <lambda/ast_factory.h>
+
+#include <ublib/utility.h>
+
+#include <cassert>
+
+namespace lambda {
+
+Ast Ast_factory::variable(int index) {
+  assert(index >= 0);
+  ++stats_.requested;
+
+  auto const idx = static_cast<std::size_t>(index);
+  if (idx >= variables_.size()) {
+    variables_.resize(idx + 1);
+  }
+  if (not variables_[idx]) {
+    ++stats_.created;
+    variables_[idx] = Ast(Ast::Variable(index));
+  }
+  return *variables_[idx];
+}
+
+Ast Ast_factory::free_variable(ublib::Shared_string name) {
+  ++stats_.requested;
+
+  if (auto it = free_variables_.find(name); it != free_variables_.end()) {
+    return it->second;
+  }
+  ++stats_.created;
+  auto ret = Ast(Ast::Free_variable(name));
+  free_variables_.emplace(std::move(name), ret);
+  return ret;
+}
+
+Ast Ast_factory::call(Ast callee, Ast argument) {
+  ++stats_.requested;
+
+  auto key = std::pair(node(callee), node(argument));
+  if (auto it = calls_.find(key); it != calls_.end()) {
+    return it->second;
+  }
+  ++stats_.created;
+  auto ret = Ast(Ast::Call(std::move(callee), std::move(argument)));
+  calls_.emplace(key, ret);
+  return ret;
+}
+
+Ast Ast_factory::lambda(ublib::Shared_string variable, Ast expression) {
+  ++stats_.requested;
+
+  auto key = node(expression);
+  if (auto it = lambdas_.find(key); it != lambdas_.end()) {
+    return it->second;
+  }
+  ++stats_.created;
+  auto ret = Ast(Ast::Lambda(std::move(variable), std::move(expression)));
+  lambdas_.emplace(key, ret);
+  return ret;
+}
+
+Ast Ast_factory::intern(Ast const& ast) {
+  // NOTE(ubsan): the input might be a DAG; don't walk shared nodes twice
+  struct helper {
+    Ast_factory& self;
+    std::unordered_map<Node, Ast> seen;
+
+    Ast rec(Ast const& ast) {
+      if (auto it = seen.find(node(ast)); it != seen.end()) {
+        return it->second;
+      }
+
+      auto ret = ublib::match(ast)(
+          [&](Ast::Variable const& e) { return self.variable(e.index()); },
+          [&](Ast::Free_variable const& e) {
+            return self.free_variable(e.name());
+          },
+          [&](Ast::Call const& e) {
+            auto callee = rec(e.callee());
+            auto argument = rec(e.argument());
+            return self.call(std::move(callee), std::move(argument));
+          },
+          [&](Ast::Lambda const& e) {
+            return self.lambda(e.variable(), rec(e.expression()));
+          });
+      seen.emplace(node(ast), ret);
+      return ret;
+    }
+  };
+
+  return helper{*this, {}}.rec(ast);
+}
+
+} // namespace lambda
@@ -0,0 +1,377 @@
+#include <lambda/binary.h>
+
+#include <ublib/failure.h>
+#include <ublib/utility.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std::literals;
+
+namespace lambda {
+
+using Index = Arena_ast::Index;
+using Tag = Arena_ast::Tag;
+
+namespace {
+  constexpr auto magic = "LMBD"sv;
+  constexpr auto no_index = Arena_ast::no_index;
+
+  Index checked_index(std::size_t size) {
+    if (size >= no_index) {
+      throw std::length_error("Ast is too large for the binary format");
+    }
+    return static_cast<Index>(size);
+  }
+
+  // little-endian base 128; seven bits a byte, the top bit set on all but
+  // the last
+  void put_varint(std::string& out, std::uint64_t n) {
+    while (n >= 0x80) {
+      out.push_back(static_cast<char>((n & 0x7F) | 0x80));
+      n >>= 7;
+    }
+    out.push_back(static_cast<char>(n));
+  }
+
+  // a node, with its children as absolute indices
+  struct Node {
+    Tag tag;
+    // the index, the string, or the callee
+    Index first;
+    // the argument, or the body
+    Index second;
+  };
+
+  // reads the header and the string table up front; nodes are read one at
+  // a time, in order
+  class Reader {
+  public:
+    explicit Reader(std::string_view bytes) : bytes_(bytes) {
+      if (not is_binary(bytes_)) {
+        throw Binary_error("not a binary term");
+      }
+      position_ = magic.size();
+
+      if (auto const version = varint(); version != binary_version) {
+        throw Binary_error("unsupported binary term version");
+      }
+
+      auto const string_count = index(no_index);
+      // NOTE(ubsan): every string takes at least a byte; this stops a bad
+      // count from reserving gigabytes
+      strings_.reserve(std::min<std::size_t>(string_count, remaining()));
+      for (Index i = 0; i < string_count; ++i) {
+        auto const length = index(no_index);
+        if (length > remaining()) {
+          throw Binary_error("unexpected end of binary term");
+        }
+        strings_.push_back(
+            ublib::Shared_string::interned(bytes_.substr(position_, length)));
+        position_ += length;
+      }
+
+      node_count_ = index(no_index);
+      if (node_count_ == 0) {
+        throw Binary_error("binary term has no nodes");
+      } else if (node_count_ > remaining()) {
+        // every node takes at least a byte, too
+        throw Binary_error("unexpected end of binary term");
+      }
+      binders_.reserve(node_count_);
+    }
+
+    Index node_count() const noexcept { return node_count_; }
+
+    // @param self the index of the node being read
+    Node node(Index self) {
+      auto const ret = read_node(self);
+      // NOTE(ubsan): keep track of how many binders each node has to be
+      // under, so a variable can't point past the binders around it
+      auto const needed = [&]() -> Index {
+        switch (ret.tag) {
+        case Tag::variable:
+          return ret.first + 1;
+        case Tag::free_variable:
+          return 0;
+        case Tag::call:
+          return std::max(binders_[ret.first], binders_[ret.second]);
+        case Tag::lambda:
+          return std::max(binders_[ret.second], Index(1)) - 1;
+        }
+        return ublib::unreachable<Index>();
+      }();
+      binders_.push_back(needed);
+      return ret;
+    }
+
+    ublib::Shared_string const& string_at(Index idx) const noexcept {
+      return strings_[idx];
+    }
+
+    // checks that nothing comes after the last node, and that the root
+    // doesn't have unbound variables
+    void finish() const {
+      if (position_ != bytes_.size()) {
+        throw Binary_error("trailing bytes after binary term");
+      } else if (binders_.back() != 0) {
+        throw Binary_error("unbound variable in binary term");
+      }
+    }
+
+  private:
+    Node read_node(Index self) {
+      if (position_ == bytes_.size()) {
+        throw Binary_error("unexpected end of binary term");
+      }
+      auto const tag = static_cast<unsigned char>(bytes_[position_++]);
+
+      // children are written as the distance back from `self`
+      auto const child = [&] {
+        auto const distance = index(self + 1);
+        if (distance == 0) {
+          throw Binary_error("node refers to itself in binary term");
+        }
+        return self - distance;
+      };
+      auto const string = [&] {
+        return index(static_cast<Index>(strings_.size()));
+      };
+
+      switch (tag) {
+      case static_cast<unsigned char>(Tag::variable):
+        return Node{Tag::variable,
+                    index(Index(std::numeric_limits<int>::max()) + 1),
+                    0};
+      case static_cast<unsigned char>(Tag::free_variable):
+        return Node{Tag::free_variable, string(), 0};
+      case static_cast<unsigned char>(Tag::call): {
+        auto const callee = child();
+        auto const argument = child();
+        return Node{Tag::call, callee, argument};
+      }
+      case static_cast<unsigned char>(Tag::lambda): {
+        auto const name = string();
+        auto const expression = child();
+        return Node{Tag::lambda, name, expression};
+      }
+      default:
+        throw Binary_error("unknown node in binary term");
+      }
+    }
+
+    std::size_t remaining() const noexcept {
+      return bytes_.size() - position_;
+    }
+
+    std::uint64_t varint() {
+      auto ret = std::uint64_t(0);
+      for (int shift = 0;; shift += 7) {
+        if (position_ == bytes_.size()) {
+          throw Binary_error("unexpected end of binary term");
+        }
+        auto const byte = static_cast<unsigned char>(bytes_[position_++]);
+        if (shift > 63 - 7 and (byte >> (64 - shift)) != 0) {
+          throw Binary_error("varint too large in binary term");
+        }
+        ret |= std::uint64_t(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+          return ret;
+        }
+      }
+    }
+
+    // @return a varint, which must be less than `limit`
+    Index index(Index limit) {
+      auto const ret = varint();
+      if (ret >= limit) {
+        throw Binary_error("index out of range in binary term");
+      }
+      return static_cast<Index>(ret);
+    }
+
+    std::string_view bytes_;
+    std::size_t position_ = 0;
+    std::vector<ublib::Shared_string> strings_;
+    Index node_count_ = 0;
+    // for each node read, the binders it has to be under
+    std::vector<Index> binders_;
+  };
+} // namespace
+
+std::ostream& operator<<(std::ostream& os, Binary_error const& e) {
+  return os << "Binary error: " << e.what();
+}
+
+bool is_binary(std::string_view bytes) noexcept {
+  return bytes.substr(0, magic.size()) == magic;
+}
+
+void write_binary(std::ostream& os, Ast const& ast) {
+  // NOTE(ubsan): like the rest of the traversals, this doesn't recurse;
+  // nodes are numbered on the way back up, so children come first
+  struct Frame {
+    Ast const* ast;
+    bool children_done;
+  };
+
+  auto strings = std::vector<std::string_view>();
+  auto string_ids = std::unordered_map<std::string_view, Index>();
+  // shared nodes are only written once, keyed on their address
+  auto ids = std::unordered_map<void const*, Index>();
+  auto nodes = std::string();
+  auto node_count = Index(0);
+
+  auto todo = std::vector<Frame>{Frame{&ast, false}};
+  auto done = std::vector<Index>();
+
+  auto const string_id = [&](std::string_view s) {
+    auto [it, inserted] =
+        string_ids.try_emplace(s, checked_index(strings.size()));
+    if (inserted) {
+      strings.push_back(s);
+    }
+    return it->second;
+  };
+  // starts a node, and gives back its index
+  auto const start_node = [&](void const* key, Tag tag) {
+    nodes.push_back(static_cast<char>(tag));
+    auto const self = node_count;
+    node_count = checked_index(std::size_t(node_count) + 1);
+    ids.emplace(key, self);
+    done.push_back(self);
+    return self;
+  };
+
+  while (not todo.empty()) {
+    auto const frame = todo.back();
+    todo.pop_back();
+
+    auto const key = ublib::match(*frame.ast)(
+        [](auto const& e) -> void const* { return &e; });
+    if (not frame.children_done) {
+      if (auto it = ids.find(key); it != ids.end()) {
+        done.push_back(it->second);
+        continue;
+      }
+    }
+
+    ublib::match(*frame.ast)(
+        [&](Ast::Variable const& e) {
+          start_node(key, Tag::variable);
+          put_varint(nodes, static_cast<std::uint64_t>(e.index()));
+        },
+        [&](Ast::Free_variable const& e) {
+          start_node(key, Tag::free_variable);
+          put_varint(nodes, string_id(e.name()));
+        },
+        [&](Ast::Call const& e) {
+          if (not frame.children_done) {
+            todo.push_back(Frame{frame.ast, true});
+            todo.push_back(Frame{&e.argument(), false});
+            todo.push_back(Frame{&e.callee(), false});
+            return;
+          }
+          auto const argument = done.back();
+          done.pop_back();
+          auto const callee = done.back();
+          done.pop_back();
+          auto const self = start_node(key, Tag::call);
+          put_varint(nodes, self - callee);
+          put_varint(nodes, self - argument);
+        },
+        [&](Ast::Lambda const& e) {
+          if (not frame.children_done) {
+            todo.push_back(Frame{frame.ast, true});
+            todo.push_back(Frame{&e.expression(), false});
+            return;
+          }
+          auto const expression = done.back();
+          done.pop_back();
+          auto const self = start_node(key, Tag::lambda);
+          put_varint(nodes, string_id(e.variable()));
+          put_varint(nodes, self - expression);
+        });
+  }
+
+  // the root is the last node to be finished, so it's written last
+  auto header = std::string(magic);
+  put_varint(header, binary_version);
+  put_varint(header, strings.size());
+  for (auto const s : strings) {
+    put_varint(header, s.size());
+    header.append(s);
+  }
+  put_varint(header, node_count);
+
+  os.write(header.data(), static_cast<std::streamsize>(header.size()));
+  os.write(nodes.data(), static_cast<std::streamsize>(nodes.size()));
+}
+
+Ast read_binary(std::string_view bytes) {
+  auto reader = Reader(bytes);
+  auto built = std::vector<Ast>();
+  built.reserve(reader.node_count());
+
+  for (Index self = 0; self < reader.node_count(); ++self) {
+    auto const node = reader.node(self);
+    switch (node.tag) {
+    case Tag::variable:
+      built.push_back(Ast(Ast::Variable(static_cast<int>(node.first))));
+      break;
+    case Tag::free_variable:
+      built.push_back(Ast(Ast::Free_variable(reader.string_at(node.first))));
+      break;
+    case Tag::call:
+      built.push_back(
+          Ast(Ast::Call(built[node.first], built[node.second])));
+      break;
+    case Tag::lambda:
+      built.push_back(
+          Ast(Ast::Lambda(reader.string_at(node.first), built[node.second])));
+      break;
+    }
+  }
+  reader.finish();
+
+  return std::move(built.back());
+}
+
+Arena_ast read_binary_arena(std::string_view bytes) {
+  auto reader = Reader(bytes);
+  auto arena = Arena_ast();
+  arena.reserve(reader.node_count());
+
+  // NOTE(ubsan): one arena node per binary node, so the indices line up
+  for (Index self = 0; self < reader.node_count(); ++self) {
+    auto const node = reader.node(self);
+    switch (node.tag) {
+    case Tag::variable:
+      arena.variable(static_cast<int>(node.first));
+      break;
+    case Tag::free_variable:
+      arena.free_variable(reader.string_at(node.first));
+      break;
+    case Tag::call:
+      arena.call(node.first, node.second);
+      break;
+    case Tag::lambda:
+      arena.lambda(reader.string_at(node.first), node.second);
+      break;
+    }
+  }
+  reader.finish();
+
+  arena.set_root(reader.node_count() - 1);
+  return arena;
+}
+
+} // namespace lambda
@@ -0,0 +1,747 @@
+#include <lambda/bytecode.h>
+
+#include "church.h"
+
+#include <ublib/failure.h>
+#include <ublib/utility.h>
+
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace lambda {
+
+using Index = Bytecode::Index;
+using Opcode = Bytecode::Opcode;
+using Instruction = Bytecode::Instruction;
+
+namespace {
+  constexpr auto no_index = Bytecode::no_index;
+
+  Index checked_index(std::size_t size) {
+    if (size >= no_index) {
+      throw std::length_error("Bytecode is too large");
+    }
+    return static_cast<Index>(size);
+  }
+
+  void const* address_of(Ast const& ast) noexcept {
+    return ublib::match(ast)([](auto const& e) -> void const* { return &e; });
+  }
+
+  Ast::Call const* as_call(Ast const& ast) noexcept {
+    return ublib::match(ast)(
+        [](Ast::Call const& e) { return &e; },
+        [](auto const&) -> Ast::Call const* { return nullptr; });
+  }
+} // namespace
+
+Bytecode::Bytecode(Ast const& ast) {
+  // NOTE(ubsan): the top-level code is compiled first; lambdas found along
+  // the way are compiled after it, one after the other, in the order they
+  // were found. Shared lambda nodes (from an `Ast_factory`, or from `eval`)
+  // are only compiled once.
+  //
+  // a body is compiled recursively, as usual, up to `max_level` calls deep;
+  // past that, the rest of it is compiled in a loop, with `todo` on the heap.
+  // The arguments of a chain of calls, like the body of a numeral, are gone
+  // through in a loop either way, so only callees count towards that.
+  //
+  // `code_` is grown ahead of time and written into, rather than pushed
+  // onto; `push_back` made compiling a numeral's body take twice as long
+  constexpr static int max_level = 1024;
+  struct helper {
+    struct Task {
+      // either a subterm to compile, or an instruction to emit once its
+      // operands have been compiled; for a subterm, the operand is `called`
+      // if it's the callee of a call
+      Ast const* ast;
+      Instruction instruction;
+    };
+
+    Bytecode& self;
+    // how much of `self.code_` has been written
+    std::size_t length;
+    std::unordered_map<void const*, Index> lambdas;
+    std::unordered_map<void const*, Index> free_variables;
+    // the operands of the `apply`s of a chain of calls, to be emitted once
+    // its last argument has been compiled
+    std::vector<Index> applies;
+    // only used past `max_level`
+    std::vector<Task> todo;
+
+    void emit(Opcode opcode, Index operand) {
+      checked_index(length);
+      if (length == self.code_.size()) {
+        self.code_.resize(2 * length + 16);
+      }
+      self.code_[length++] = Instruction{opcode, operand};
+    }
+
+    // free variables with the same name share an index; names are
+    // interned, so that's the same as having the same `data()`
+    void emit_free_variable(Ast::Free_variable const& e, Ast const& ast) {
+      auto [it, inserted] = free_variables.try_emplace(
+          e.name().data(), checked_index(self.free_variables_.size()));
+      if (inserted) {
+        self.free_variables_.push_back(ast);
+      }
+      emit(Opcode::free_variable, it->second);
+    }
+
+    void emit_closure(Ast const& ast) {
+      auto [it, inserted] = lambdas.try_emplace(
+          address_of(ast), checked_index(self.functions_.size()));
+      if (inserted) {
+        self.functions_.push_back(
+            Function{no_index, ast, Church_recognizer::has_shape(ast)});
+      }
+      emit(Opcode::closure, it->second);
+    }
+
+    // @param operand is `called` if `ast` is the callee of a call
+    void compile(Ast const& ast, Index operand, int level) {
+      if (level == max_level) {
+        compile_deep(ast, operand);
+        return;
+      }
+      ublib::match(ast)(
+          [&](Ast::Variable const& e) {
+            emit(Opcode::access, static_cast<Index>(e.index()));
+          },
+          [&](Ast::Free_variable const& e) { emit_free_variable(e, ast); },
+          [&](Ast::Call const&) {
+            // the callee is evaluated before the argument, like `eval`
+            auto const first = applies.size();
+            auto cur = &ast;
+            for (auto call = as_call(*cur); call; call = as_call(*cur)) {
+              applies.push_back(operand);
+              compile(call->callee(), called, level + 1);
+              cur = &call->argument();
+              operand = 0;
+            }
+            compile(*cur, 0, level + 1);
+            while (applies.size() > first) {
+              emit(Opcode::apply, applies.back());
+              applies.pop_back();
+            }
+          },
+          [&](Ast::Lambda const&) { emit_closure(ast); });
+    }
+
+    // what `compile` does, without recursing
+    void compile_deep(Ast const& ast, Index operand) {
+      todo.push_back(Task{&ast, Instruction{{}, operand}});
+      while (not todo.empty()) {
+        auto const task = todo.back();
+        todo.pop_back();
+
+        if (not task.ast) {
+          emit(task.instruction.opcode, task.instruction.operand);
+          continue;
+        }
+
+        ublib::match(*task.ast)(
+            [&](Ast::Variable const& e) {
+              emit(Opcode::access, static_cast<Index>(e.index()));
+            },
+            [&](Ast::Free_variable const& e) {
+              emit_free_variable(e, *task.ast);
+            },
+            [&](Ast::Call const& e) {
+              todo.push_back(Task{
+                  nullptr,
+                  Instruction{Opcode::apply, task.instruction.operand}});
+              todo.push_back(Task{&e.argument(), {}});
+              todo.push_back(Task{&e.callee(), Instruction{{}, called}});
+            },
+            [&](Ast::Lambda const&) { emit_closure(*task.ast); });
+      }
+    }
+
+    void compile_body(Ast const& body) {
+      compile(body, 0, 0);
+      auto& last = self.code_[length - 1];
+      if (last.opcode == Opcode::apply) {
+        last.opcode = Opcode::tail_apply;
+      } else {
+        emit(Opcode::ret, 0);
+      }
+    }
+  };
+
+  // every node is one instruction, at most, and every function adds a
+  // `grab` and a `ret`; shared subterms are counted once for each use, so
+  // this is only a guess for the results of `eval`
+  code_.resize(std::min<std::size_t>(ast.size(), 1 << 20) + 1);
+
+  auto compiler = helper{*this, 0, {}, {}, {}, {}};
+  compiler.compile_body(ast);
+  // NOTE(ubsan): `functions_` grows while we go through it
+  for (std::size_t i = 0; i < functions_.size(); ++i) {
+    functions_[i].entry = checked_index(compiler.length);
+    compiler.emit(Opcode::grab, 0);
+    // NOTE(ubsan): a copy, since `compile_body` can reallocate `functions_`
+    auto const source = functions_[i].source;
+    compiler.compile_body(ublib::match(source)(
+        [](Ast::Lambda const& e) -> Ast const& { return e.expression(); },
+        [](auto const&) -> Ast const& {
+          return ublib::unreachable<Ast const&>();
+        }));
+  }
+  code_.resize(compiler.length);
+}
+
+namespace {
+  // NOTE(ubsan): like the arena machine, everything the machine makes lives
+  // in vectors, and refers to each other by index; the environments are
+  // never freed until the evaluation is over
+
+  struct Value {
+    enum class Kind : std::uint8_t {
+      closure,
+      neutral,
+      // a numeral, or true, that's been given its first argument; it's the
+      // callee of the `apply` that gives it its second one, so it never
+      // gets any further than that
+      jet,
+    };
+
+    Kind kind;
+    // for a closure, the index in `functions()`;
+    // for a neutral, the index in `neutrals`;
+    // for a jet, the index in `jets`
+    Index index;
+    // the environment of a closure
+    Index env;
+  };
+
+  struct Env_node {
+    Value value;
+    Index next;
+    // the value read back into an `Ast`, as an index into `quoted`; cached
+    // so that every use of a variable shares the same `Ast`
+    Index quoted;
+  };
+
+  struct Neutral_node {
+    // either a free variable (when `callee == no_index`),
+    // or a call of a neutral
+    Index free;
+    Index callee;
+    Value argument;
+  };
+
+  struct Return_frame {
+    // `iterate`, for the frame of a numeral's loop
+    Index pc;
+    Index env;
+  };
+
+  constexpr auto iterate = no_index;
+
+  struct Jet {
+    Church church;
+    // the first argument
+    Value function;
+  };
+
+  // applies `function` to the value on the stack, `count` more times
+  struct Iteration {
+    Value function;
+    std::uint64_t count;
+  };
+
+  struct Quote_work {
+    enum class Kind : std::uint8_t {
+      // read back `value`
+      quote_value,
+      // read back `*expr`, in the environment `env`, `depth` lambdas in
+      quote_body,
+      // wrap the node we just got in a lambda, named like `*expr`
+      make_lambda,
+      // call the callee we got with the argument we got after it
+      make_call,
+      // cache the node we just got as the value of `envs[env]`
+      remember,
+    };
+
+    Kind kind;
+    Value value;
+    Ast const* expr;
+    Index env;
+    int depth;
+  };
+
+  // NOTE(ubsan): the vectors a machine keeps everything in; they're kept
+  // around between evaluations, one set for each thread, so that once a
+  // thread has evaluated something, the next evaluation doesn't have to
+  // grow them all over again. Like `print`'s buffer, the memory is kept
+  // until the thread exits, unless a vector got larger than `max_kept`.
+  struct Buffers {
+    constexpr static std::size_t max_kept = std::size_t(1) << 16;
+
+    std::vector<Env_node> envs;
+    std::vector<Neutral_node> neutrals;
+    std::vector<Value> stack;
+    std::vector<Return_frame> frames;
+    // both only ever hold what's in flight
+    std::vector<Jet> jets;
+    std::vector<Iteration> iterations;
+    std::vector<Ast> quoted;
+    // only used past `Machine::max_level`; kept around, since the loop may
+    // be entered many times for one value
+    std::vector<Quote_work> todo;
+    std::vector<Ast> done;
+
+    template <typename T>
+    static void reset(std::vector<T>& v) noexcept {
+      v.clear();
+      if (v.capacity() > max_kept) {
+        v.shrink_to_fit();
+      }
+    }
+
+    // empties them all, so that the nodes they hold are freed
+    void clear() noexcept {
+      reset(envs);
+      reset(neutrals);
+      reset(stack);
+      reset(frames);
+      reset(jets);
+      reset(iterations);
+      reset(quoted);
+      reset(todo);
+      reset(done);
+    }
+  };
+
+  struct Machine : Buffers {
+    // NOTE(ubsan): reads the value back recursively, as usual, up to
+    // `max_level` calls deep; past that, the rest of the value is read back
+    // in a loop, like the arena machine does
+    constexpr static int max_level = 1024;
+
+    using Work = Quote_work;
+
+    Bytecode const& program;
+    Church_recognizer recognizer;
+
+    Index push_env(Value value, Index next) {
+      envs.push_back(Env_node{value, next, no_index});
+      return checked_index(envs.size() - 1);
+    }
+
+    Value push_neutral(Neutral_node n) {
+      neutrals.push_back(n);
+      return Value{
+          Value::Kind::neutral, checked_index(neutrals.size() - 1), no_index};
+    }
+
+    Index lookup(Index env, Index index) const noexcept {
+      for (; env != no_index and index > 0; --index) {
+        env = envs[env].next;
+      }
+      return env;
+    }
+
+    // @return what a closure does when it's given two arguments, if it's
+    // true, or a numeral; it's read back to find out, like `eval` sees it
+    std::optional<Church> recognize(Value closure) {
+      if (not program.functions()[closure.index].has_shape) {
+        return std::nullopt;
+      }
+      return recognizer.recognize(quote(closure, 0));
+    }
+
+    Value run() {
+      auto const code = program.code().data();
+      auto const functions = program.functions().data();
+
+      auto pc = Index(0);
+      auto env = no_index;
+
+      // calls `callee` with the argument on top of the stack; a neutral is
+      // called in place, and then there's nothing to run
+      // @return whether there's a body to run
+      auto const enter = [&](Value callee) {
+        if (callee.kind == Value::Kind::neutral) {
+          stack.back() =
+              push_neutral(Neutral_node{no_index, callee.index, stack.back()});
+          return false;
+        }
+        // leave the argument for the callee's `grab`
+        pc = functions[callee.index].entry;
+        env = callee.env;
+        return true;
+      };
+
+      // returns the value on top of the stack, going around the loops of
+      // any numerals on the way
+      // @return false if there's nothing to return to
+      auto const pop_frame = [&] {
+        while (not frames.empty()) {
+          auto const frame = frames.back();
+          if (frame.pc != iterate) {
+            pc = frame.pc;
+            env = frame.env;
+            frames.pop_back();
+            return true;
+          }
+
+          auto& iteration = iterations.back();
+          if (iteration.count == 0) {
+            iterations.pop_back();
+            frames.pop_back();
+            continue;
+          }
+          --iteration.count;
+          // the frame stays, so the call comes back here
+          if (enter(iteration.function)) {
+            return true;
+          }
+        }
+        return false;
+      };
+
+      for (;;) {
+        auto const instruction = code[pc++];
+        switch (instruction.opcode) {
+        case Opcode::access: {
+          auto const node = lookup(env, instruction.operand);
+          if (node == no_index) {
+            throw Eval_error("evaluation found an unbound non-free variable");
+          }
+          stack.push_back(envs[node].value);
+          break;
+        }
+        case Opcode::free_variable:
+          stack.push_back(
+              push_neutral(Neutral_node{instruction.operand, no_index, {}}));
+          break;
+        case Opcode::closure:
+          stack.push_back(
+              Value{Value::Kind::closure, instruction.operand, env});
+          break;
+        case Opcode::apply:
+        case Opcode::tail_apply: {
+          auto const tail = instruction.opcode == Opcode::tail_apply;
+          auto const argument = stack.back();
+          stack.pop_back();
+          auto const callee = stack.back();
+          stack.back() = argument;
+
+          if (callee.kind == Value::Kind::closure and
+              instruction.operand == Bytecode::called) {
+            if (auto church = recognize(callee)) {
+              // NOTE(ubsan): like `eval`, skip the call with one argument,
+              // and do both once the second one is there
+              jets.push_back(Jet{*church, argument});
+              stack.back() = Value{
+                  Value::Kind::jet, checked_index(jets.size() - 1), no_index};
+              break;
+            }
+          }
+
+          if (callee.kind == Value::Kind::jet) {
+            auto const jet = jets.back();
+            jets.pop_back();
+            if (jet.church.is_true) {
+              stack.back() = jet.function;
+            } else if (jet.church.count != 0) {
+              // the loop has a frame of its own, which is returned to right
+              // away, with the second argument
+              if (not tail) {
+                frames.push_back(Return_frame{pc, env});
+              }
+              iterations.push_back(Iteration{jet.function, jet.church.count});
+              frames.push_back(Return_frame{iterate, no_index});
+              if (not pop_frame()) {
+                return stack.back();
+              }
+              break;
+            }
+            // zero gives back the second argument as it is
+          } else if (callee.kind == Value::Kind::closure) {
+            if (not tail) {
+              frames.push_back(Return_frame{pc, env});
+            }
+            enter(callee);
+            break;
+          } else {
+            enter(callee);
+          }
+
+          // the call is done already;
+          // do the `ret` that `tail_apply` replaced
+          if (tail and not pop_frame()) {
+            return stack.back();
+          }
+          break;
+        }
+        case Opcode::grab:
+          env = push_env(stack.back(), env);
+          stack.pop_back();
+          break;
+        case Opcode::ret:
+          if (not pop_frame()) {
+            return stack.back();
+          }
+          break;
+        }
+      }
+    }
+
+    static Work quote_work(Value value) noexcept {
+      return Work{Work::Kind::quote_value, value, nullptr, no_index, 0};
+    }
+
+    static ublib::Shared_string const& lambda_variable(Ast const& lambda) {
+      return ublib::match(lambda)(
+          [](Ast::Lambda const& e) -> ublib::Shared_string const& {
+            return e.variable();
+          },
+          [](auto const&) -> ublib::Shared_string const& {
+            return ublib::unreachable<ublib::Shared_string const&>();
+          });
+    }
+
+    // @return the node for `envs[node]`'s value, if it's been read back
+    Ast const* remembered(Index node) const noexcept {
+      auto const q = envs[node].quoted;
+      return q == no_index ? nullptr : &quoted[q];
+    }
+
+    void remember(Index node, Ast value) {
+      envs[node].quoted = checked_index(quoted.size());
+      quoted.push_back(std::move(value));
+    }
+
+    Ast quote(Value value, int level) {
+      if (level == max_level) {
+        return quote_deep(quote_work(value));
+      }
+      if (value.kind == Value::Kind::closure) {
+        auto const& source = program.functions()[value.index].source;
+        return quote_body(source, value.env, 0, level + 1);
+      }
+
+      auto const n = neutrals[value.index];
+      if (n.callee == no_index) {
+        return program.free_variables()[n.free];
+      }
+      auto callee =
+          quote(Value{Value::Kind::neutral, n.callee, no_index}, level + 1);
+      auto argument = quote(n.argument, level + 1);
+      return Ast(Ast::Call(std::move(callee), std::move(argument)));
+    }
+
+    // the variables under `depth` are bound inside of the body, the rest
+    // are in `env`; a subterm which doesn't use any of the latter is shared
+    // with the program, rather than rebuilt
+    Ast quote_body(Ast const& expr, Index env, int depth, int level) {
+      if (expr.max_free_index() < depth) {
+        return expr;
+      }
+      if (level == max_level) {
+        return quote_deep(
+            Work{Work::Kind::quote_body, {}, &expr, env, depth});
+      }
+      return ublib::match(expr)(
+          [&](Ast::Lambda const& e) {
+            auto body = quote_body(e.expression(), env, depth + 1, level + 1);
+            return Ast(Ast::Lambda(e.variable(), std::move(body)));
+          },
+          [&](Ast::Call const& e) {
+            auto callee = quote_body(e.callee(), env, depth, level + 1);
+            auto argument = quote_body(e.argument(), env, depth, level + 1);
+            return Ast(Ast::Call(std::move(callee), std::move(argument)));
+          },
+          [&](Ast::Variable const& e) {
+            auto const node =
+                lookup(env, static_cast<Index>(e.index() - depth));
+            if (node == no_index) {
+              return expr;
+            }
+            if (auto const q = remembered(node)) {
+              return *q;
+            }
+            auto ret = quote(envs[node].value, level + 1);
+            remember(node, ret);
+            return ret;
+          },
+          [&](Ast::Free_variable const&) { return expr; });
+    }
+
+    // what `quote` and `quote_body` do, without recursing
+    Ast quote_deep(Work const start) {
+      todo.push_back(start);
+
+      while (not todo.empty()) {
+        auto work = todo.back();
+        todo.pop_back();
+
+        // the first child of a node is read back right away, without going
+        // through `todo`; `next` is set when `work` has been replaced by it
+        for (auto next = true; next;) {
+          next = false;
+          switch (work.kind) {
+          case Work::Kind::quote_value: {
+            auto const v = work.value;
+            if (v.kind == Value::Kind::closure) {
+              auto const& source = program.functions()[v.index].source;
+              work = Work{Work::Kind::quote_body, {}, &source, v.env, 0};
+              next = true;
+              break;
+            }
+            auto const& n = neutrals[v.index];
+            if (n.callee == no_index) {
+              done.push_back(program.free_variables()[n.free]);
+            } else {
+              todo.push_back(
+                  Work{Work::Kind::make_call, {}, nullptr, no_index, 0});
+              todo.push_back(quote_work(n.argument));
+              work =
+                  quote_work(Value{Value::Kind::neutral, n.callee, no_index});
+              next = true;
+            }
+            break;
+          }
+          case Work::Kind::quote_body: {
+            auto const& expr = *work.expr;
+            if (expr.max_free_index() < work.depth) {
+              done.push_back(expr);
+              break;
+            }
+            ublib::match(expr)(
+                [&](Ast::Lambda const& e) {
+                  todo.push_back(
+                      Work{Work::Kind::make_lambda, {}, &expr, no_index, 0});
+                  work = Work{
+                      Work::Kind::quote_body,
+                      {},
+                      &e.expression(),
+                      work.env,
+                      work.depth + 1};
+                  next = true;
+                },
+                [&](Ast::Call const& e) {
+                  todo.push_back(
+                      Work{Work::Kind::make_call, {}, nullptr, no_index, 0});
+                  todo.push_back(Work{
+                      Work::Kind::quote_body,
+                      {},
+                      &e.argument(),
+                      work.env,
+                      work.depth});
+                  work.expr = &e.callee();
+                  next = true;
+                },
+                [&](Ast::Variable const& e) {
+                  auto const node = lookup(
+                      work.env, static_cast<Index>(e.index() - work.depth));
+                  if (node == no_index) {
+                    done.push_back(expr);
+                  } else if (auto const q = remembered(node)) {
+                    done.push_back(*q);
+                  } else {
+                    todo.push_back(
+                        Work{Work::Kind::remember, {}, nullptr, node, 0});
+                    work = quote_work(envs[node].value);
+                    next = true;
+                  }
+                },
+                [&](Ast::Free_variable const&) { done.push_back(expr); });
+            break;
+          }
+          case Work::Kind::make_lambda:
+            done.back() = Ast(Ast::Lambda(
+                lambda_variable(*work.expr), std::move(done.back())));
+            break;
+          case Work::Kind::make_call: {
+            auto argument = std::move(done.back());
+            done.pop_back();
+            done.back() =
+                Ast(Ast::Call(std::move(done.back()), std::move(argument)));
+            break;
+          }
+          case Work::Kind::remember:
+            remember(work.env, done.back());
+            break;
+          }
+        }
+      }
+
+      auto ret = std::move(done.back());
+      done.pop_back();
+      return ret;
+    }
+  };
+} // namespace
+
+Ast eval(Bytecode const& program) {
+  thread_local auto spare = Buffers();
+
+  auto machine = Machine{{std::move(spare)}, program, {}};
+  auto ret = machine.quote(machine.run(), 0);
+  machine.clear();
+  spare = std::move(static_cast<Buffers&>(machine));
+  return ret;
+}
+
+void disassemble(std::ostream& os, Bytecode const& program) {
+  auto const& functions = program.functions();
+  auto entries = std::unordered_map<Index, Index>();
+  for (std::size_t i = 0; i < functions.size(); ++i) {
+    entries.emplace(functions[i].entry, static_cast<Index>(i));
+  }
+
+  os << "main:\n";
+  auto const& code = program.code();
+  for (std::size_t pc = 0; pc < code.size(); ++pc) {
+    if (auto it = entries.find(static_cast<Index>(pc)); it != entries.end()) {
+      ublib::match(functions[it->second].source)(
+          [&](Ast::Lambda const& e) {
+            os << "function " << it->second << " (/" << e.variable() << "):\n";
+          },
+          [](auto const&) { ublib::unreachable(); });
+    }
+
+    auto const instruction = code[pc];
+    os << "  " << pc << ": ";
+    switch (instruction.opcode) {
+    case Opcode::access:
+      os << "access " << instruction.operand;
+      break;
+    case Opcode::free_variable:
+      os << "free " << instruction.operand << " ("
+         << program.free_variables()[instruction.operand] << ')';
+      break;
+    case Opcode::closure:
+      os << "closure " << instruction.operand;
+      break;
+    case Opcode::apply:
+      os << "apply";
+      if (instruction.operand == Bytecode::called) {
+        os << " (called)";
+      }
+      break;
+    case Opcode::tail_apply:
+      os << "tail_apply";
+      break;
+    case Opcode::grab:
+      os << "grab";
+      break;
+    case Opcode::ret:
+      os << "ret";
+      break;
+    }
+    os << '\n';
+  }
+}
+
+} // namespace lambda
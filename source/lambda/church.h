@@ -0,0 +1,76 @@
+#pragma once
+
+// NOTE(ubsan): recognizes the Church numerals and booleans that `eval` has
+// jets for; see lambda/jets.h for the shapes
+
+#include <lambda/ast.h>
+
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace lambda {
+
+// what a recognized term does once it's been given two arguments
+struct Church {
+  // true gives back its first argument
+  bool is_true;
+  // anything else applies the first argument this many times to the second
+  std::uint64_t count;
+};
+
+class Church_recognizer {
+public:
+  // @return the number `ast` is a numeral for, or nothing if it isn't one
+  // of the shapes, or the number doesn't fit
+  std::optional<std::uint64_t> numeral(Ast const& ast);
+
+  // @return what `ast` does, if it's true, or a numeral (false is zero)
+  std::optional<Church> recognize(Ast const& ast);
+
+  // @return whether `ast` is true, or has one of the shapes; the numerals
+  // it's built out of aren't looked at, so they may be variables
+  static bool has_shape(Ast const& ast);
+
+private:
+  enum class Op {
+    leaf, // /f./x.f (... (f x)); the value is in `count`
+    succ, // /f./x.f (n f x)
+    add, // /f./x.m f (n f x)
+    mult, // /f.m (n f)
+    pred, // /f./x.n (/g./h.h (g f)) (/u.x) (/u.u)
+    power, // /x.m (... (m x)); m applied `count` times
+  };
+  struct Shape {
+    Op op;
+    std::uint64_t count;
+    // the numerals this one is built out of; `second` may be null
+    Ast const* first;
+    Ast const* second;
+  };
+  struct Frame {
+    Ast const* ast;
+    Shape shape;
+    bool children_done;
+  };
+  struct Entry {
+    // keeps the node alive, so its address isn't reused
+    Ast ast;
+    std::uint64_t value;
+  };
+
+  static std::optional<Shape> shape_of(Ast const& ast);
+
+  // numerals found so far, by the address of their node
+  std::unordered_map<void const*, Entry> memo_;
+  // reuse the stacks' allocations across calls
+  std::vector<Frame> todo_;
+  std::vector<std::uint64_t> done_;
+};
+
+// @return the body of `function`, if it's a lambda which doesn't use its
+// parameter, and its body is already a value
+Ast const* constant_body(Ast const& function);
+
+} // namespace lambda
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace lambda {
+
+// the names of the binders we're currently inside of; innermost at the back
+using Context = std::vector<std::string_view>;
+
+// @return the de Bruijn index of `to_find` in `ctxt`, if it's bound
+inline std::optional<int>
+find_in_context(Context const& ctxt, std::string_view to_find) {
+  using std::crbegin;
+  using std::crend;
+
+  auto first = crbegin(ctxt);
+  auto last = crend(ctxt);
+
+  assert(last - first <= std::numeric_limits<int>::max());
+
+  auto found = std::find(first, last, to_find);
+  if (found == last) {
+    return std::nullopt;
+  } else {
+    return static_cast<int>(found - first);
+  }
+}
+
+// like a `Context`, but looking a name up is a hash lookup, instead of a
+// search through every binder we're inside of
+class Scope {
+public:
+  // `name` is bound by the innermost binder, until `pop`
+  void push(std::string_view name) {
+    auto& level = levels_.try_emplace(name, no_level).first->second;
+    binders_.push_back(Binder{name, level});
+    level = depth() - 1;
+  }
+
+  // leaves the innermost binder; the name it shadowed, if any, is visible
+  // again
+  void pop() {
+    auto const binder = binders_.back();
+    binders_.pop_back();
+    // NOTE(ubsan): names which go out of scope are left in the map, so
+    // binding them again doesn't allocate
+    levels_.find(binder.name)->second = binder.shadowed;
+  }
+
+  // @return the de Bruijn index of `to_find`, if it's bound
+  std::optional<int> find(std::string_view to_find) const {
+    auto const it = levels_.find(to_find);
+    if (it == levels_.end() or it->second == no_level) {
+      return std::nullopt;
+    }
+    return depth() - it->second - 1;
+  }
+
+  int depth() const noexcept {
+    assert(binders_.size() <= std::size_t(std::numeric_limits<int>::max()));
+    return static_cast<int>(binders_.size());
+  }
+
+private:
+  constexpr static int no_level = -1;
+
+  struct Binder {
+    std::string_view name;
+    // the level `name` was bound at before this binder, or `no_level`
+    int shadowed;
+  };
+
+  // the level (the depth of the binder) each name is bound at
+  std::unordered_map<std::string_view, int> levels_;
+  std::vector<Binder> binders_;
+};
+
+} // namespace lambda
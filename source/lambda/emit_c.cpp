@@ -0,0 +1,644 @@
+#include <lambda/emit_c.h>
+
+#include <ublib/failure.h>
+#include <ublib/shared_string.h>
+#include <ublib/utility.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std::literals;
+
+namespace lambda {
+
+namespace {
+  // NOTE(ubsan): the runtime is written out around the generated code;
+  // the types go first, then the tables, then the functions which need
+  // the tables, then the compiled lambdas, and `main` last
+
+  constexpr static auto runtime_types = R"(#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct Value Value;
+typedef Value* Code(Value* const* env, Value* arg);
+
+enum { closure_value, free_value, call_value };
+
+struct Value {
+  int kind;
+  /* the function of a closure, or the name of a free variable */
+  unsigned index;
+  /* a call whose callee isn't a closure */
+  Value* callee;
+  Value* argument;
+  /* what a closure captured, in the order of its function's `outer` */
+  Value* env[];
+};
+
+enum { variable_node, free_node, call_node, lambda_node };
+
+/* the terms the functions were compiled from, for printing closures */
+typedef struct {
+  int kind;
+  /* a variable's index, a free variable's or binder's name, or a callee */
+  unsigned first;
+  /* a lambda's body, or an argument */
+  unsigned second;
+} Node;
+
+typedef struct {
+  Code* code;
+  /* the lambda it was compiled from */
+  unsigned node;
+  unsigned captures;
+  /* the index outside of the lambda of each variable it captures */
+  unsigned const* outer;
+} Function;
+)"sv;
+
+  constexpr static auto runtime_functions = R"(
+static void* rt_grow(void* buffer, size_t* capacity, size_t element) {
+  *capacity = *capacity ? *capacity * 2 : 64;
+  buffer = realloc(buffer, *capacity * element);
+  if (!buffer) {
+    fputs("out of memory\n", stderr);
+    exit(1);
+  }
+  return buffer;
+}
+
+/* the bump allocator; the chunks are linked through their first word */
+static void* chunks;
+static char* heap_next;
+static size_t heap_left;
+
+static void* rt_alloc(size_t size) {
+  void* ret;
+  size = (size + sizeof(void*) - 1) / sizeof(void*) * sizeof(void*);
+  if (heap_left < size) {
+    size_t chunk = size + sizeof(void*) > (1 << 20) ? size + sizeof(void*)
+                                                    : (1 << 20);
+    char* start = malloc(chunk);
+    if (!start) {
+      fputs("out of memory\n", stderr);
+      exit(1);
+    }
+    *(void**)start = chunks;
+    chunks = start;
+    heap_next = start + sizeof(void*);
+    heap_left = chunk - sizeof(void*);
+  }
+  ret = heap_next;
+  heap_next += size;
+  heap_left -= size;
+  return ret;
+}
+
+/* frees everything at once */
+static void rt_reset(void) {
+  while (chunks) {
+    void* next = *(void**)chunks;
+    free(chunks);
+    chunks = next;
+  }
+  heap_next = NULL;
+  heap_left = 0;
+}
+
+/* the captures are filled in by the caller */
+static Value* rt_closure(unsigned function) {
+  Value* ret = rt_alloc(
+      sizeof(Value) + functions[function].captures * sizeof(Value*));
+  ret->kind = closure_value;
+  ret->index = function;
+  return ret;
+}
+
+/* a function returns a call in tail position by setting these, and
+   returning a null pointer to the trampoline in `rt_apply` */
+static Value* tail_callee;
+static Value* tail_argument;
+
+static Value* rt_tail(Value* callee, Value* argument) {
+  tail_callee = callee;
+  tail_argument = argument;
+  return NULL;
+}
+
+static Value* rt_apply(Value* callee, Value* argument) {
+  for (;;) {
+    Value* ret;
+    if (callee->kind != closure_value) {
+      ret = rt_alloc(sizeof(Value));
+      ret->kind = call_value;
+      ret->callee = callee;
+      ret->argument = argument;
+      return ret;
+    }
+    ret = functions[callee->index].code(callee->env, argument);
+    if (ret) {
+      return ret;
+    }
+    callee = tail_callee;
+    argument = tail_argument;
+  }
+}
+
+/* prints like `operator<<(std::ostream&, Ast const&)`, without recursing;
+   a closure is printed as its lambda, with the values it captured in
+   place of their variables */
+enum { print_value, print_node, print_text, print_close_lambda };
+
+typedef struct {
+  int kind;
+  Value const* value;
+  unsigned node;
+  /* the lambdas gone into since the closure's own */
+  unsigned depth;
+  char const* text;
+} Print_task;
+
+static Print_task* print_todo;
+static size_t print_todo_size;
+static size_t print_todo_capacity;
+static char const** binders;
+static size_t binders_size;
+static size_t binders_capacity;
+
+static void rt_push(
+    int kind, Value const* value, unsigned node, unsigned depth,
+    char const* text) {
+  Print_task task;
+  if (print_todo_size == print_todo_capacity) {
+    print_todo =
+        rt_grow(print_todo, &print_todo_capacity, sizeof(Print_task));
+  }
+  task.kind = kind;
+  task.value = value;
+  task.node = node;
+  task.depth = depth;
+  task.text = text;
+  print_todo[print_todo_size++] = task;
+}
+
+static Value const* rt_captured(Value const* closure, unsigned outer) {
+  Function const* function = &functions[closure->index];
+  unsigned i;
+  for (i = 0; function->outer[i] != outer; ++i) {
+  }
+  return closure->env[i];
+}
+
+static void rt_print(Value const* value) {
+  rt_push(print_value, value, 0, 0, NULL);
+  while (print_todo_size) {
+    Print_task task = print_todo[--print_todo_size];
+    Node const* node;
+    switch (task.kind) {
+    case print_text:
+      fputs(task.text, stdout);
+      break;
+    case print_close_lambda:
+      --binders_size;
+      putchar(')');
+      break;
+    case print_value:
+      if (task.value->kind == closure_value) {
+        rt_push(
+            print_node, task.value, functions[task.value->index].node, 0,
+            NULL);
+      } else if (task.value->kind == free_value) {
+        fputs(names[task.value->index], stdout);
+      } else {
+        rt_push(print_value, task.value->argument, 0, 0, NULL);
+        rt_push(print_text, NULL, 0, 0, " ");
+        rt_push(print_value, task.value->callee, 0, 0, NULL);
+      }
+      break;
+    case print_node:
+      node = &nodes[task.node];
+      switch (node->kind) {
+      case variable_node:
+        if (node->first < task.depth) {
+          printf("%s_%u", binders[binders_size - 1 - node->first],
+                 node->first);
+        } else {
+          rt_push(
+              print_value, rt_captured(task.value, node->first - task.depth),
+              0, 0, NULL);
+        }
+        break;
+      case free_node:
+        fputs(names[node->first], stdout);
+        break;
+      case call_node:
+        rt_push(print_node, task.value, node->second, task.depth, NULL);
+        rt_push(print_text, NULL, 0, 0, " ");
+        rt_push(print_node, task.value, node->first, task.depth, NULL);
+        break;
+      case lambda_node:
+        printf("(/%s.", names[node->first]);
+        if (binders_size == binders_capacity) {
+          binders = rt_grow(binders, &binders_capacity, sizeof(char const*));
+        }
+        binders[binders_size++] = names[node->first];
+        rt_push(print_close_lambda, NULL, 0, 0, NULL);
+        rt_push(print_node, task.value, node->second, task.depth + 1, NULL);
+        break;
+      }
+      break;
+    }
+  }
+}
+)"sv;
+
+  // only written if there are free variables
+  constexpr static auto runtime_free_values = R"(
+static Value* rt_free(unsigned name) {
+  Value* ret = rt_alloc(sizeof(Value));
+  ret->kind = free_value;
+  ret->index = name;
+  return ret;
+}
+)"sv;
+
+  constexpr static auto runtime_main = R"(
+int main(int argc, char** argv) {
+  long count = argc > 1 ? strtol(argv[1], NULL, 10) : 1;
+  Value* result = run();
+  while (--count > 0) {
+    rt_reset();
+    result = run();
+  }
+  rt_print(result);
+  putchar('\n');
+  return 0;
+}
+)"sv;
+
+  // writes `s` as a C string literal
+  void write_string(std::ostream& os, std::string_view s) {
+    constexpr auto digits = "01234567"sv;
+    os << '"';
+    for (auto const ch : s) {
+      auto const byte = static_cast<unsigned char>(ch);
+      if (ch == '"' or ch == '\\') {
+        os << '\\' << ch;
+      } else if (byte < 0x20 or byte >= 0x7F) {
+        // always three digits, so the next character can't be taken as one
+        os << '\\' << digits[byte >> 6] << digits[(byte >> 3) & 7]
+           << digits[byte & 7];
+      } else {
+        os << ch;
+      }
+    }
+    os << '"';
+  }
+
+  class Emitter {
+  public:
+    explicit Emitter(Ast const& ast) {
+      if (ast.max_free_index() >= 0) {
+        throw Eval_error("evaluation found an unbound non-free variable");
+      }
+
+      compile_body(run_, ast, nullptr);
+      // NOTE(ubsan): `functions_` grows while we go through it
+      for (std::size_t i = 0; i < functions_.size(); ++i) {
+        auto const source = functions_[i].source;
+        ublib::match(source)(
+            [&](Ast::Lambda const& e) {
+              code_ << "\nstatic Value* fn_" << i
+                    << "(Value* const* env, Value* arg) {\n"
+                    << "  (void)env;\n  (void)arg;\n";
+              // NOTE(ubsan): a copy, since `functions_` can reallocate
+              auto const outer = functions_[i].outer;
+              compile_body(code_, e.expression(), &outer);
+              code_ << "}\n";
+            },
+            [](auto const&) { ublib::unreachable(); });
+      }
+      for (auto& function : functions_) {
+        function.node = node(function.source);
+      }
+    }
+
+    void write(std::ostream& os) const {
+      os << runtime_types << '\n';
+      for (std::size_t i = 0; i < functions_.size(); ++i) {
+        os << "static Value* fn_" << i << "(Value* const* env, Value* arg);\n";
+      }
+
+      // NOTE(ubsan): C doesn't allow empty arrays; the tables get an entry
+      // that's never used, if they would be
+      os << "\nstatic char const* const names[] = {\n";
+      for (auto const& name : names_) {
+        os << "  ";
+        write_string(os, name);
+        os << ",\n";
+      }
+      if (names_.empty()) {
+        os << "  NULL,\n";
+      }
+      os << "};\n\nstatic Node const nodes[] = {\n";
+      for (auto const& node : nodes_) {
+        os << "  {" << node.kind << ", " << node.first << ", " << node.second
+           << "},\n";
+      }
+      if (nodes_.empty()) {
+        os << "  {0, 0, 0},\n";
+      }
+      os << "};\n\n";
+      for (std::size_t i = 0; i < functions_.size(); ++i) {
+        auto const& outer = functions_[i].outer;
+        if (outer.empty()) {
+          continue;
+        }
+        os << "static unsigned const outer_" << i << "[] = {";
+        for (std::size_t j = 0; j < outer.size(); ++j) {
+          os << (j == 0 ? "" : ", ") << outer[j];
+        }
+        os << "};\n";
+      }
+      os << "\nstatic Function const functions[] = {\n";
+      for (std::size_t i = 0; i < functions_.size(); ++i) {
+        auto const& function = functions_[i];
+        os << "  {fn_" << i << ", " << function.node << ", "
+           << function.outer.size() << ", ";
+        if (function.outer.empty()) {
+          os << "NULL";
+        } else {
+          os << "outer_" << i;
+        }
+        os << "},\n";
+      }
+      if (functions_.empty()) {
+        os << "  {NULL, 0, 0, NULL},\n";
+      }
+      os << "};\n";
+
+      os << runtime_functions;
+      if (not free_variables_.empty()) {
+        os << runtime_free_values << "\nstatic Value* free_values["
+           << free_variables_.size() << "];\n";
+      }
+      os << code_.str();
+
+      os << "\nstatic Value* run(void) {\n";
+      for (std::size_t i = 0; i < free_variables_.size(); ++i) {
+        os << "  free_values[" << i << "] = rt_free(" << free_variables_[i]
+           << ");\n";
+      }
+      os << run_.str() << "}\n";
+      os << runtime_main;
+    }
+
+  private:
+    // a node of the tables in the output; `kind` is one of the runtime's
+    // `_node` constants
+    struct Node {
+      enum Kind { variable, free_variable, call, lambda };
+
+      Kind kind;
+      std::size_t first;
+      std::size_t second;
+    };
+
+    struct Function {
+      // the lambda it's compiled from
+      Ast source;
+      // the variables it uses from outside of it, by their index outside of
+      // it; the closure captures them in this order
+      std::vector<int> outer;
+      // where `source` is in `nodes_`
+      std::size_t node;
+    };
+
+    // @return the variables `lambda` uses from outside of it
+    static std::vector<int> captures(Ast::Lambda const& lambda) {
+      struct Frame {
+        Ast const* term;
+        // the lambdas between `term` and the outside, counting `lambda`
+        int depth;
+      };
+
+      auto ret = std::vector<int>();
+      auto todo = std::vector<Frame>{Frame{&lambda.expression(), 1}};
+      while (not todo.empty()) {
+        auto const frame = todo.back();
+        todo.pop_back();
+
+        if (frame.term->max_free_index() < frame.depth) {
+          // everything in it is bound inside of `lambda`
+          continue;
+        }
+        ublib::match(*frame.term)(
+            [&](Ast::Variable const& e) {
+              ret.push_back(e.index() - frame.depth);
+            },
+            [&](Ast::Call const& e) {
+              todo.push_back(Frame{&e.argument(), frame.depth});
+              todo.push_back(Frame{&e.callee(), frame.depth});
+            },
+            [&](Ast::Lambda const& e) {
+              todo.push_back(Frame{&e.expression(), frame.depth + 1});
+            },
+            [](Ast::Free_variable const&) {});
+      }
+
+      std::sort(ret.begin(), ret.end());
+      ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+      return ret;
+    }
+
+    std::size_t name(ublib::Shared_string const& s) {
+      auto [it, inserted] = name_ids_.try_emplace(s, names_.size());
+      if (inserted) {
+        names_.push_back(s);
+      }
+      return it->second;
+    }
+
+    // the variable with `index` in the body of a function which captured
+    // `outer`
+    static std::string variable(std::vector<int> const& outer, int index) {
+      if (index == 0) {
+        return "arg";
+      }
+      auto const slot = std::lower_bound(outer.begin(), outer.end(), index - 1);
+      return "env[" + std::to_string(slot - outer.begin()) + "]";
+    }
+
+    // writes statements computing `body`, then returns it; `self` is what
+    // the function it's the body of captured, or null for `run`, where
+    // there are no variables
+    void compile_body(
+        std::ostream& os, Ast const& body, std::vector<int> const* self) {
+      struct Task {
+        Ast const* ast;
+        bool children_done;
+      };
+
+      auto temporaries = std::size_t(0);
+      auto todo = std::vector<Task>{Task{&body, false}};
+      // the C expression for each value computed, in order
+      auto done = std::vector<std::string>();
+
+      while (not todo.empty()) {
+        auto const task = todo.back();
+        todo.pop_back();
+
+        ublib::match(*task.ast)(
+            [&](Ast::Variable const& e) {
+              done.push_back(variable(*self, e.index()));
+            },
+            [&](Ast::Free_variable const& e) {
+              auto const id = name(e.name());
+              auto [it, inserted] =
+                  free_variable_ids_.try_emplace(id, free_variables_.size());
+              if (inserted) {
+                free_variables_.push_back(id);
+              }
+              done.push_back("free_values[" + std::to_string(it->second) + "]");
+            },
+            [&](Ast::Call const& e) {
+              if (not task.children_done) {
+                // the callee is evaluated before the argument, like `eval`
+                todo.push_back(Task{task.ast, true});
+                todo.push_back(Task{&e.argument(), false});
+                todo.push_back(Task{&e.callee(), false});
+                return;
+              }
+
+              auto argument = std::move(done.back());
+              done.pop_back();
+              auto callee = std::move(done.back());
+              done.pop_back();
+              if (task.ast == &body) {
+                // a tail call
+                os << "  return " << (self ? "rt_tail(" : "rt_apply(")
+                   << callee << ", " << argument << ");\n";
+                done.push_back({});
+                return;
+              }
+              auto temporary = "t" + std::to_string(temporaries++);
+              os << "  Value* " << temporary << " = rt_apply(" << callee
+                 << ", " << argument << ");\n";
+              done.push_back(std::move(temporary));
+            },
+            [&](Ast::Lambda const& e) {
+              auto [it, inserted] =
+                  function_ids_.try_emplace(&e, functions_.size());
+              if (inserted) {
+                functions_.push_back(Function{*task.ast, captures(e), 0});
+              }
+
+              auto temporary = "t" + std::to_string(temporaries++);
+              os << "  Value* " << temporary << " = rt_closure(" << it->second
+                 << ");\n";
+              auto const& outer = functions_[it->second].outer;
+              for (std::size_t i = 0; i < outer.size(); ++i) {
+                os << "  " << temporary << "->env[" << i
+                   << "] = " << variable(*self, outer[i]) << ";\n";
+              }
+              done.push_back(std::move(temporary));
+            });
+      }
+
+      if (not done.back().empty()) {
+        os << "  return " << done.back() << ";\n";
+      }
+    }
+
+    // @return where `ast` is in `nodes_`; adds it, and what's under it, if
+    // they aren't there yet
+    std::size_t node(Ast const& ast) {
+      struct Task {
+        Ast const* ast;
+        bool children_done;
+      };
+
+      auto todo = std::vector<Task>{Task{&ast, false}};
+      auto done = std::vector<std::size_t>();
+      // shared nodes, like a lambda inside another one, are only added once
+      auto const identity = [](Ast const& ast) {
+        return ublib::match(ast)(
+            [](auto const& e) -> void const* { return &e; });
+      };
+      auto const add = [&](Task task, Node node) {
+        auto const id = nodes_.size();
+        nodes_.push_back(node);
+        node_ids_.emplace(identity(*task.ast), id);
+        done.push_back(id);
+      };
+
+      while (not todo.empty()) {
+        auto const task = todo.back();
+        todo.pop_back();
+
+        if (auto it = node_ids_.find(identity(*task.ast));
+            it != node_ids_.end()) {
+          done.push_back(it->second);
+          continue;
+        }
+        ublib::match(*task.ast)(
+            [&](Ast::Variable const& e) {
+              add(task,
+                  Node{Node::variable, static_cast<std::size_t>(e.index()), 0});
+            },
+            [&](Ast::Free_variable const& e) {
+              add(task, Node{Node::free_variable, name(e.name()), 0});
+            },
+            [&](Ast::Call const& e) {
+              if (not task.children_done) {
+                todo.push_back(Task{task.ast, true});
+                todo.push_back(Task{&e.argument(), false});
+                todo.push_back(Task{&e.callee(), false});
+                return;
+              }
+              auto const argument = done.back();
+              done.pop_back();
+              auto const callee = done.back();
+              done.pop_back();
+              add(task, Node{Node::call, callee, argument});
+            },
+            [&](Ast::Lambda const& e) {
+              if (not task.children_done) {
+                todo.push_back(Task{task.ast, true});
+                todo.push_back(Task{&e.expression(), false});
+                return;
+              }
+              auto const body = done.back();
+              done.pop_back();
+              add(task, Node{Node::lambda, name(e.variable()), body});
+            });
+      }
+
+      return done.back();
+    }
+
+    std::vector<Function> functions_;
+    std::unordered_map<Ast::Lambda const*, std::size_t> function_ids_;
+    std::vector<Node> nodes_;
+    std::unordered_map<void const*, std::size_t> node_ids_;
+    std::vector<ublib::Shared_string> names_;
+    std::unordered_map<ublib::Shared_string, std::size_t> name_ids_;
+    // each one is a name
+    std::vector<std::size_t> free_variables_;
+    std::unordered_map<std::size_t, std::size_t> free_variable_ids_;
+    // the compiled lambdas, and the top-level term
+    std::ostringstream code_;
+    std::ostringstream run_;
+  };
+} // namespace
+
+void emit_c(std::ostream& os, Ast const& ast) { Emitter(ast).write(os); }
+
+} // namespace lambda
@@ -0,0 +1,125 @@
+#include <lambda/environment.h>
+
+#include "parser.h"
+
+#include <ublib/utility.h>
+
+#include <utility>
+#include <vector>
+
+using namespace std::literals;
+
+namespace lambda {
+
+void Environment::define(ublib::Shared_string name, Ast value) {
+  // the names of free variables are interned, so the lookups in `resolve`
+  // compare by identity if the keys are too
+  definitions_.insert_or_assign(
+      ublib::Shared_string::interned(name), std::move(value));
+}
+
+Ast Environment::resolve(Ast const& ast) const {
+  // NOTE(ubsan): the same walk as substitution, without recursing; the
+  // values themselves aren't walked, since they've already been resolved
+  struct Frame {
+    Ast const* expr;
+    bool children_done;
+  };
+
+  if (definitions_.empty()) {
+    return ast;
+  }
+
+  auto todo = std::vector<Frame>{Frame{&ast, false}};
+  auto done = std::vector<Ast>();
+
+  while (not todo.empty()) {
+    auto const frame = todo.back();
+    todo.pop_back();
+
+    ublib::match(*frame.expr)(
+        [&](Ast::Lambda const& e) {
+          if (not frame.children_done) {
+            todo.push_back(Frame{frame.expr, true});
+            todo.push_back(Frame{&e.expression(), false});
+          } else if (same_node(done.back(), e.expression())) {
+            done.back() = *frame.expr;
+          } else {
+            auto expression = std::move(done.back());
+            done.pop_back();
+            done.push_back(Ast::Lambda(e.variable(), std::move(expression)));
+          }
+        },
+        [&](Ast::Call const& e) {
+          if (not frame.children_done) {
+            todo.push_back(Frame{frame.expr, true});
+            todo.push_back(Frame{&e.argument(), false});
+            todo.push_back(Frame{&e.callee(), false});
+            return;
+          }
+
+          auto argument = std::move(done.back());
+          done.pop_back();
+          if (same_node(done.back(), e.callee()) and
+              same_node(argument, e.argument())) {
+            done.back() = *frame.expr;
+          } else {
+            auto callee = std::move(done.back());
+            done.pop_back();
+            done.push_back(Ast::Call(std::move(callee), std::move(argument)));
+          }
+        },
+        [&](Ast::Variable const&) { done.push_back(*frame.expr); },
+        [&](Ast::Free_variable const& e) {
+          if (auto it = definitions_.find(e.name()); it != definitions_.end()) {
+            done.push_back(it->second);
+          } else {
+            done.push_back(*frame.expr);
+          }
+        });
+  }
+
+  return std::move(done.back());
+}
+
+namespace {
+  // @throw Parse_error if a comment isn't closed, like the parser
+  Lexer::Token next_token(Lexer& lex) {
+    auto ret = lex.next();
+    if (ret.kind == Lexer::Token::Kind::unclosed_comment) {
+      throw_error(Error{Error_code::unexpected_end_of_file, ret.offset});
+    }
+    return ret;
+  }
+} // namespace
+
+bool is_blank(std::string_view line) {
+  auto lex = Lexer(line);
+  return next_token(lex).kind == Lexer::Token::Kind::eof;
+}
+
+std::optional<Definition> parse_definition(std::string_view line) {
+  using Kind = Lexer::Token::Kind;
+
+  auto lex = Lexer(line);
+  auto const keyword = next_token(lex);
+  if (keyword.kind != Kind::identifier or keyword.text != "let"sv) {
+    return std::nullopt;
+  }
+
+  auto const name = next_token(lex);
+  if (name.kind != Kind::identifier) {
+    throw Parse_error("expected a name after `let`");
+  }
+  auto const equals = next_token(lex);
+  if (equals.kind != Kind::unknown or equals.text != "="sv) {
+    throw Parse_error("expected `=` after `let name`");
+  }
+
+  // the tokens point into `line`, so the term is whatever's after the `=`
+  auto const rest = static_cast<std::size_t>(
+      equals.text.data() + equals.text.size() - line.data());
+  return Definition{name.text, line.substr(rest)};
+}
+
+} // namespace lambda
@@ -0,0 +1,49 @@
+#include <lambda/error.h>
+
+#include <lambda/ast.h>
+#include <lambda/parse_ast.h>
+
+#include <ublib/failure.h>
+
+#include <iostream>
+
+namespace lambda {
+
+char const* message(Error_code code) noexcept {
+  switch (code) {
+  case Error_code::unexpected_end_of_file:
+    return "unexpected end of file";
+  case Error_code::unexpected_character:
+    return "unexpected character";
+  case Error_code::expected_variable:
+    return "expected a variable";
+  case Error_code::lambda_in_callee:
+    return "attempted to define a lambda in a callee";
+  case Error_code::unbound_variable:
+    return "evaluation found an unbound non-free variable";
+  }
+  return ublib::unreachable<char const*>();
+}
+
+std::ostream& operator<<(std::ostream& os, Error const& error) {
+  if (error.is_parse_error()) {
+    os << "Parse error: ";
+  } else {
+    os << "Error: ";
+  }
+  os << message(error.code);
+  if (error.offset != Error::no_offset) {
+    os << " at byte " << error.offset;
+  }
+  return os;
+}
+
+void throw_error(Error const& error) {
+  if (error.is_parse_error()) {
+    throw Parse_error(message(error.code));
+  } else {
+    throw Eval_error(message(error.code));
+  }
+}
+
+} // namespace lambda
@@ -0,0 +1,167 @@
+#include <lambda/eval_cache.h>
+
+#include <lambda/binary.h>
+
+#include <ublib/shared_string.h>
+#include <ublib/utility.h>
+
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace std::literals;
+
+namespace lambda {
+
+namespace {
+  // NOTE(ubsan): a saved cache is one term, the entries applied to this
+  // name, oldest first: `head term value term value ...`. The name can't
+  // come from source code, since it has a space in it.
+  constexpr auto saved_head = "eval cache"sv;
+
+  // whether the terms are the same, down to the names of their binders;
+  // `eval` gives the same value for both then, names and all
+  bool identical(Ast const& lhs, Ast const& rhs) {
+    auto todo = std::vector<std::pair<Ast const*, Ast const*>>{{&lhs, &rhs}};
+    while (not todo.empty()) {
+      auto const [l, r] = todo.back();
+      todo.pop_back();
+
+      if (same_node(*l, *r)) {
+        continue;
+      }
+      if (l->hash() != r->hash()) {
+        return false;
+      }
+      auto const equal = ublib::match(*l, *r)(
+          [](Ast::Variable const& a, Ast::Variable const& b) {
+            return a.index() == b.index();
+          },
+          [](Ast::Free_variable const& a, Ast::Free_variable const& b) {
+            return a.name() == b.name();
+          },
+          [&](Ast::Call const& a, Ast::Call const& b) {
+            todo.emplace_back(&a.argument(), &b.argument());
+            todo.emplace_back(&a.callee(), &b.callee());
+            return true;
+          },
+          [&](Ast::Lambda const& a, Ast::Lambda const& b) {
+            todo.emplace_back(&a.expression(), &b.expression());
+            return a.variable() == b.variable();
+          },
+          [](auto const&, auto const&) { return false; });
+      if (not equal) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // @return the callee and argument, if `ast` is a call
+  std::optional<std::pair<Ast, Ast>> as_call(Ast const& ast) {
+    return ublib::match(ast)(
+        [](Ast::Call const& e) -> std::optional<std::pair<Ast, Ast>> {
+          return std::pair(e.callee(), e.argument());
+        },
+        [](auto const&) -> std::optional<std::pair<Ast, Ast>> {
+          return std::nullopt;
+        });
+  }
+} // namespace
+
+std::optional<Ast> Eval_cache::find(Ast const& term) {
+  auto const it = index_.find(term.hash());
+  if (it == index_.end() or not identical(it->second->term, term)) {
+    ++stats_.misses;
+    return std::nullopt;
+  }
+  ++stats_.hits;
+  entries_.splice(entries_.begin(), entries_, it->second);
+  return it->second->value;
+}
+
+void Eval_cache::insert(Ast term, Ast value) {
+  if (capacity_ == 0) {
+    return;
+  }
+
+  auto const hash = term.hash();
+  if (auto it = index_.find(hash); it != index_.end()) {
+    *it->second = Entry{std::move(term), std::move(value)};
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return;
+  }
+
+  if (entries_.size() == capacity_) {
+    index_.erase(entries_.back().term.hash());
+    entries_.pop_back();
+    ++stats_.evictions;
+  }
+  entries_.push_front(Entry{std::move(term), std::move(value)});
+  index_.emplace(hash, entries_.begin());
+}
+
+void Eval_cache::save(std::ostream& os) const {
+  auto saved =
+      Ast(Ast::Free_variable(ublib::Shared_string::interned(saved_head)));
+  for (auto it = entries_.rbegin(); it != entries_.rend(); ++it) {
+    auto entry = Ast(Ast::Call(std::move(saved), it->term));
+    saved = Ast(Ast::Call(std::move(entry), it->value));
+  }
+  write_binary(os, saved);
+}
+
+void Eval_cache::load(std::string_view bytes) {
+  auto const not_a_cache = [] {
+    throw Binary_error("not a saved eval cache");
+  };
+
+  // newest first
+  auto loaded = std::vector<Entry>();
+  auto rest = read_binary(bytes);
+  while (auto outer = as_call(rest)) {
+    auto inner = as_call(outer->first);
+    if (not inner) {
+      not_a_cache();
+    }
+    auto& [term, value] = loaded.emplace_back(
+        Entry{std::move(inner->second), std::move(outer->second)});
+    // NOTE(ubsan): `eval` relies on values being closed
+    if (term.max_free_index() >= 0 or value.max_free_index() >= 0) {
+      not_a_cache();
+    }
+    rest = std::move(inner->first);
+  }
+  auto const is_head = ublib::match(rest)(
+      [](Ast::Free_variable const& e) {
+        return std::string_view(e.name()) == saved_head;
+      },
+      [](auto const&) { return false; });
+  if (not is_head) {
+    not_a_cache();
+  }
+
+  // behind the ones already here
+  for (auto& entry : loaded) {
+    if (entries_.size() >= capacity_) {
+      break;
+    }
+    auto const hash = entry.term.hash();
+    if (index_.count(hash) != 0) {
+      continue;
+    }
+    entries_.push_back(std::move(entry));
+    index_.emplace(hash, std::prev(entries_.end()));
+  }
+}
+
+std::ostream& operator<<(std::ostream& os, Eval_cache_stats const& stats) {
+  return os << "cache hits: " << stats.hits
+            << "\ncache misses: " << stats.misses
+            << "\ncache evictions: " << stats.evictions;
+}
+
+} // namespace lambda
@@ -0,0 +1,357 @@
+#include <lambda/jets.h>
+
+#include "church.h"
+
+#include <ublib/failure.h>
+#include <ublib/utility.h>
+
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace lambda {
+
+namespace {
+  Ast::Lambda const* as_lambda(Ast const& ast) noexcept {
+    return ublib::match(ast)(
+        [](Ast::Lambda const& e) { return &e; },
+        [](auto const&) -> Ast::Lambda const* { return nullptr; });
+  }
+
+  Ast::Call const* as_call(Ast const& ast) noexcept {
+    return ublib::match(ast)(
+        [](Ast::Call const& e) { return &e; },
+        [](auto const&) -> Ast::Call const* { return nullptr; });
+  }
+
+  bool is_variable(Ast const& ast, int index) noexcept {
+    return ublib::match(ast)(
+        [&](Ast::Variable const& e) { return e.index() == index; },
+        [](auto const&) { return false; });
+  }
+
+  // the same node, or the same variable
+  bool same_term(Ast const& lhs, Ast const& rhs) noexcept {
+    if (same_node(lhs, rhs)) {
+      return true;
+    }
+    auto const index = ublib::match(lhs)(
+        [](Ast::Variable const& e) { return e.index(); },
+        [](auto const&) { return -1; });
+    return index >= 0 and is_variable(rhs, index);
+  }
+
+  void const* address_of(Ast const& ast) noexcept {
+    return ublib::match(ast)([](auto const& e) -> void const* { return &e; });
+  }
+
+  // under `/f./x.`, matches `n f x`
+  // @return `n`
+  Ast const* applied_to_f_x(Ast const& ast) noexcept {
+    auto const outer = as_call(ast);
+    if (not outer or not is_variable(outer->argument(), 0)) {
+      return nullptr;
+    }
+    auto const inner = as_call(outer->callee());
+    if (not inner or not is_variable(inner->argument(), 1)) {
+      return nullptr;
+    }
+    return &inner->callee();
+  }
+
+  // matches `/u.x` under `/f./x.`, `/u.u`, and `/g./h.h (g f)`, the pieces
+  // of `pred`
+  bool is_pred_pieces(Ast const& g, Ast const& k, Ast const& i) noexcept {
+    auto const k_lambda = as_lambda(k);
+    auto const i_lambda = as_lambda(i);
+    if (not k_lambda or not is_variable(k_lambda->expression(), 1) or
+        not i_lambda or not is_variable(i_lambda->expression(), 0)) {
+      return false;
+    }
+
+    // under `/f./x./g./h.`, h is 0, g is 1, and f is 3
+    auto const g_lambda = as_lambda(g);
+    auto const h_lambda = g_lambda ? as_lambda(g_lambda->expression()) : nullptr;
+    auto const call = h_lambda ? as_call(h_lambda->expression()) : nullptr;
+    if (not call or not is_variable(call->callee(), 0)) {
+      return false;
+    }
+    auto const g_f = as_call(call->argument());
+    return g_f and is_variable(g_f->callee(), 1) and
+        is_variable(g_f->argument(), 3);
+  }
+
+  bool checked_add(std::uint64_t lhs, std::uint64_t rhs, std::uint64_t& out) {
+    if (lhs > std::numeric_limits<std::uint64_t>::max() - rhs) {
+      return false;
+    }
+    out = lhs + rhs;
+    return true;
+  }
+
+  bool checked_mult(std::uint64_t lhs, std::uint64_t rhs, std::uint64_t& out) {
+    if (lhs != 0 and rhs > std::numeric_limits<std::uint64_t>::max() / lhs) {
+      return false;
+    }
+    out = lhs * rhs;
+    return true;
+  }
+
+  bool checked_power(std::uint64_t base, std::uint64_t exponent, std::uint64_t& out) {
+    // anything past 63 overflows, unless the base is 0 or 1
+    if (base <= 1) {
+      out = exponent == 0 ? 1 : base;
+      return true;
+    }
+    out = 1;
+    for (std::uint64_t i = 0; i < exponent; ++i) {
+      if (not checked_mult(out, base, out)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // NOTE(ubsan): past this many, the memo is thrown away and started over,
+  // so that it doesn't keep every numeral a long evaluation made alive
+  constexpr std::size_t max_memo = std::size_t(1) << 16;
+} // namespace
+
+std::optional<Church_recognizer::Shape>
+Church_recognizer::shape_of(Ast const& ast) {
+  auto const outer = as_lambda(ast);
+  if (not outer) {
+    return std::nullopt;
+  }
+  auto const& body = outer->expression();
+
+  if (auto const inner = as_lambda(body)) {
+    // `/f./x.`; f is 1, and x is 0
+    auto const& e = inner->expression();
+
+    auto count = std::uint64_t(0);
+    auto cur = &e;
+    for (auto call = as_call(*cur); call and is_variable(call->callee(), 1);
+         call = as_call(*cur)) {
+      ++count;
+      cur = &call->argument();
+    }
+    if (is_variable(*cur, 0)) {
+      return Shape{Op::leaf, count, nullptr, nullptr};
+    }
+
+    auto const call = as_call(e);
+    if (not call) {
+      return std::nullopt;
+    }
+    if (is_variable(call->callee(), 1)) {
+      if (auto const n = applied_to_f_x(call->argument())) {
+        return Shape{Op::succ, 0, n, nullptr};
+      }
+      return std::nullopt;
+    }
+
+    auto const callee = as_call(call->callee());
+    if (not callee) {
+      return std::nullopt;
+    }
+    if (is_variable(callee->argument(), 1)) {
+      if (auto const n = applied_to_f_x(call->argument())) {
+        return Shape{Op::add, 0, &callee->callee(), n};
+      }
+      return std::nullopt;
+    }
+    if (auto const n_g = as_call(callee->callee())) {
+      if (is_pred_pieces(n_g->argument(), callee->argument(), call->argument())) {
+        return Shape{Op::pred, 0, &n_g->callee(), nullptr};
+      }
+    }
+    return std::nullopt;
+  }
+
+  // `/f.` or `/x.`; either way, it's 0
+  auto const call = as_call(body);
+  if (not call) {
+    return std::nullopt;
+  }
+  auto const& m = call->callee();
+
+  auto count = std::uint64_t(0);
+  auto cur = &body;
+  for (auto c = call; c and same_term(c->callee(), m); c = as_call(*cur)) {
+    ++count;
+    cur = &c->argument();
+  }
+  if (is_variable(*cur, 0)) {
+    return Shape{Op::power, count, &m, nullptr};
+  }
+
+  auto const n_f = as_call(call->argument());
+  if (n_f and is_variable(n_f->argument(), 0)) {
+    return Shape{Op::mult, 0, &m, &n_f->callee()};
+  }
+  return std::nullopt;
+}
+
+std::optional<std::uint64_t> Church_recognizer::numeral(Ast const& ast) {
+  todo_.clear();
+  done_.clear();
+  todo_.push_back(Frame{&ast, Shape(), false});
+
+  auto const remember = [&](Ast const& node, std::uint64_t value) {
+    if (memo_.size() >= max_memo) {
+      memo_.clear();
+    }
+    memo_.emplace(address_of(node), Entry{node, value});
+    done_.push_back(value);
+  };
+
+  while (not todo_.empty()) {
+    auto const frame = todo_.back();
+    todo_.pop_back();
+
+    if (not frame.children_done) {
+      if (auto it = memo_.find(address_of(*frame.ast)); it != memo_.end()) {
+        done_.push_back(it->second.value);
+        continue;
+      }
+
+      auto const shape = shape_of(*frame.ast);
+      if (not shape) {
+        return std::nullopt;
+      } else if (shape->op == Op::leaf) {
+        remember(*frame.ast, shape->count);
+        continue;
+      }
+      todo_.push_back(Frame{frame.ast, *shape, true});
+      if (shape->second) {
+        todo_.push_back(Frame{shape->second, Shape(), false});
+      }
+      todo_.push_back(Frame{shape->first, Shape(), false});
+      continue;
+    }
+
+    auto second = std::uint64_t(0);
+    if (frame.shape.second) {
+      second = done_.back();
+      done_.pop_back();
+    }
+    auto const first = done_.back();
+    done_.pop_back();
+
+    auto value = std::uint64_t(0);
+    auto fits = true;
+    switch (frame.shape.op) {
+    case Op::leaf:
+      ublib::unreachable();
+    case Op::succ:
+      fits = checked_add(first, 1, value);
+      break;
+    case Op::add:
+      fits = checked_add(first, second, value);
+      break;
+    case Op::mult:
+      fits = checked_mult(first, second, value);
+      break;
+    case Op::pred:
+      value = first == 0 ? 0 : first - 1;
+      break;
+    case Op::power:
+      fits = checked_power(first, frame.shape.count, value);
+      break;
+    }
+    if (not fits) {
+      return std::nullopt;
+    }
+    remember(*frame.ast, value);
+  }
+
+  return done_.back();
+}
+
+std::optional<Church> Church_recognizer::recognize(Ast const& ast) {
+  // NOTE(ubsan): most functions aren't numerals; every shape is a lambda
+  // around either another lambda, or a call, and checking that is cheaper
+  // than looking in the memo
+  auto const lambda = as_lambda(ast);
+  if (not lambda or not ublib::match(lambda->expression())(
+                        [](Ast::Lambda const&) { return true; },
+                        [](Ast::Call const&) { return true; },
+                        [](auto const&) { return false; })) {
+    return std::nullopt;
+  }
+
+  if (church_boolean(ast) == std::optional<bool>(true)) {
+    return Church{true, 0};
+  }
+  if (auto const n = numeral(ast)) {
+    return Church{false, *n};
+  }
+  return std::nullopt;
+}
+
+bool Church_recognizer::has_shape(Ast const& ast) {
+  return church_boolean(ast) == std::optional<bool>(true) or
+      shape_of(ast).has_value();
+}
+
+Ast const* constant_body(Ast const& function) {
+  auto const lambda = as_lambda(function);
+  if (not lambda) {
+    return nullptr;
+  }
+  auto const& body = lambda->expression();
+  auto const is_value = ublib::match(body)(
+      [](Ast::Lambda const&) { return true; },
+      [](Ast::Free_variable const&) { return true; },
+      [](auto const&) { return false; });
+  if (not is_value) {
+    return nullptr;
+  }
+
+  // look for the parameter; it's `depth` under this many more binders
+  struct Frame {
+    Ast const* ast;
+    int depth;
+  };
+  auto todo = std::vector<Frame>{Frame{&body, 0}};
+  while (not todo.empty()) {
+    auto const frame = todo.back();
+    todo.pop_back();
+    auto const uses_parameter = ublib::match(*frame.ast)(
+        [&](Ast::Variable const& e) { return e.index() == frame.depth; },
+        [](Ast::Free_variable const&) { return false; },
+        [&](Ast::Call const& e) {
+          todo.push_back(Frame{&e.callee(), frame.depth});
+          todo.push_back(Frame{&e.argument(), frame.depth});
+          return false;
+        },
+        [&](Ast::Lambda const& e) {
+          todo.push_back(Frame{&e.expression(), frame.depth + 1});
+          return false;
+        });
+    if (uses_parameter) {
+      return nullptr;
+    }
+  }
+  return &body;
+}
+
+std::optional<std::uint64_t> church_numeral(Ast const& ast) {
+  return Church_recognizer().numeral(ast);
+}
+
+std::optional<bool> church_boolean(Ast const& ast) {
+  auto const t = as_lambda(ast);
+  auto const f = t ? as_lambda(t->expression()) : nullptr;
+  if (not f) {
+    return std::nullopt;
+  } else if (is_variable(f->expression(), 1)) {
+    return true;
+  } else if (is_variable(f->expression(), 0)) {
+    return false;
+  }
+  return std::nullopt;
+}
+
+} // namespace lambda
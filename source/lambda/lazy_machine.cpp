@@ -0,0 +1,336 @@
+#include <lambda/machine.h>
+
+#include "release.h"
+
+#include <ublib/failure.h>
+#include <ublib/utility.h>
+
+#include <memory>
+#include <optional>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace lambda {
+
+namespace {
+  // NOTE(ubsan): the same shape as the CEK machine, except environments hold
+  // thunks instead of values; a thunk is overwritten with its value the first
+  // time it's evaluated, so every use of it after that is free
+
+  struct Env_node;
+  using Environment = std::shared_ptr<Env_node const>;
+
+  struct Thunk;
+  using Thunk_ptr = std::shared_ptr<Thunk>;
+
+  struct Neutral_node;
+  using Neutral = std::shared_ptr<Neutral_node const>;
+
+  struct Closure {
+    Ast::Lambda const* lambda;
+    Environment env;
+  };
+
+  using Value = std::variant<Closure, Neutral>;
+
+  void release_value(Value& value) noexcept {
+    if (auto closure = std::get_if<Closure>(&value)) {
+      release(std::move(closure->env));
+    } else {
+      release(std::move(std::get<Neutral>(value)));
+    }
+  }
+
+  // NOTE(ubsan): values can be far deeper than the native stack, so the
+  // nodes are freed through `release`, like in `eval_cek`
+  struct Neutral_node {
+    struct Stuck_call {
+      Neutral callee;
+      Thunk_ptr argument;
+    };
+
+    // the `Ast const*` is the original free variable node
+    std::variant<Ast const*, Stuck_call> underlying;
+
+    Neutral_node(Neutral_node&&) = default;
+    ~Neutral_node() {
+      if (auto call = std::get_if<Stuck_call>(&underlying)) {
+        release(std::move(call->callee));
+        release(std::move(call->argument));
+      }
+    }
+  };
+
+  struct Thunk {
+    // code that hasn't been run yet
+    struct Suspended {
+      Ast const* code;
+      Environment env;
+    };
+
+    std::variant<Suspended, Value> state;
+    // the thunk read back into an `Ast`; cached, like in `eval_cek`
+    std::optional<Ast> quoted;
+
+    Thunk(Thunk&&) = default;
+    ~Thunk() {
+      if (auto suspended = std::get_if<Suspended>(&state)) {
+        release(std::move(suspended->env));
+      } else {
+        release_value(std::get<Value>(state));
+      }
+    }
+  };
+
+  struct Env_node {
+    Thunk_ptr thunk;
+    Environment next;
+
+    Env_node(Env_node&&) = default;
+    ~Env_node() {
+      release(std::move(thunk));
+      release(std::move(next));
+    }
+  };
+
+  // @return nullptr if the index isn't bound in env
+  Thunk_ptr const* lookup(Env_node const* node, int index) noexcept {
+    for (; node and index > 0; --index) {
+      node = node->next.get();
+    }
+    return node ? &node->thunk : nullptr;
+  }
+
+  Thunk_ptr make_thunk(Value value) {
+    return std::make_shared<Thunk>(Thunk{std::move(value), std::nullopt});
+  }
+
+  struct Machine {
+    // call the value we just got with the argument
+    struct Apply_to {
+      Thunk_ptr argument;
+    };
+    // overwrite the thunk with the value we just got
+    struct Update {
+      Thunk_ptr thunk;
+    };
+    using Frame = std::variant<Apply_to, Update>;
+
+    std::vector<Frame> kont;
+
+    // doesn't allocate a new thunk for arguments which are already variables
+    Thunk_ptr delay(Ast const& argument, Environment const& env) {
+      return ublib::match(argument)(
+          [&](Ast::Variable const& e) -> Thunk_ptr {
+            if (auto thunk = lookup(env.get(), e.index())) {
+              return *thunk;
+            } else {
+              return ublib::throw_as<Thunk_ptr>(
+                  Eval_error("evaluation found an unbound non-free variable"));
+            }
+          },
+          [&](Ast::Lambda const& e) { return make_thunk(Closure{&e, env}); },
+          [&](Ast::Free_variable const&) {
+            return make_thunk(
+                std::make_shared<Neutral_node const>(Neutral_node{&argument}));
+          },
+          [&](Ast::Call const&) {
+            return std::make_shared<Thunk>(
+                Thunk{Thunk::Suspended{&argument, env}, std::nullopt});
+          });
+    }
+
+    Value run(Ast const& ast) {
+      auto control = &ast;
+      auto env = Environment();
+
+      for (;;) {
+        auto value = ublib::match(*control)(
+            [&](Ast::Call const& e) -> std::optional<Value> {
+              kont.push_back(Apply_to{delay(e.argument(), env)});
+              control = &e.callee();
+              return std::nullopt;
+            },
+            [&](Ast::Variable const& e) -> std::optional<Value> {
+              auto thunk = lookup(env.get(), e.index());
+              if (not thunk) {
+                return ublib::throw_as<Value>(
+                    Eval_error("evaluation found an unbound non-free variable"));
+              }
+
+              return ublib::match((*thunk)->state)(
+                  [&](Thunk::Suspended const& s) -> std::optional<Value> {
+                    kont.push_back(Update{*thunk});
+                    control = s.code;
+                    // NOTE(ubsan): `s` is kept alive by the `Update`
+                    env = s.env;
+                    return std::nullopt;
+                  },
+                  [&](Value& v) -> std::optional<Value> { return v; });
+            },
+            [&](Ast::Free_variable const&) -> std::optional<Value> {
+              return Value(std::make_shared<Neutral_node const>(
+                  Neutral_node{control}));
+            },
+            [&](Ast::Lambda const& e) -> std::optional<Value> {
+              return Value(Closure{&e, env});
+            });
+
+        while (value) {
+          if (kont.empty()) {
+            return std::move(*value);
+          }
+
+          auto frame = std::move(kont.back());
+          kont.pop_back();
+
+          ublib::match(frame)(
+              [&](Update& f) { f.thunk->state = *value; },
+              [&](Apply_to& f) {
+                ublib::match(*value)(
+                    [&](Closure& c) {
+                      env = std::make_shared<Env_node const>(
+                          Env_node{std::move(f.argument), std::move(c.env)});
+                      control = &c.lambda->expression();
+                      value.reset();
+                    },
+                    [&](Neutral& n) {
+                      value = Value(std::make_shared<Neutral_node const>(
+                          Neutral_node{Neutral_node::Stuck_call{
+                              std::move(n), std::move(f.argument)}}));
+                    });
+              });
+        }
+      }
+    }
+  };
+
+  // NOTE(ubsan): reads the value back without recursing, like `eval_cek`;
+  // a thunk that was never needed is read back as the code it suspends
+  Ast quote(Value const& value) {
+    // read back a value
+    struct Quote_value {
+      Value const* value;
+    };
+    // read back a thunk, and cache it
+    struct Quote_thunk {
+      Thunk* thunk;
+    };
+    // read back a stuck call, or a free variable
+    struct Quote_neutral {
+      Neutral_node const* neutral;
+    };
+    // read back code in an environment, `depth` lambdas in
+    struct Quote_body {
+      Ast const* expr;
+      Env_node const* env;
+      int depth;
+    };
+    // wrap the term we just got in a lambda like this one
+    struct Make_lambda {
+      Ast::Lambda const* lambda;
+    };
+    // call the callee we got with the argument we got after it
+    struct Make_call {};
+    // cache the term we just got as the thunk read back
+    struct Remember {
+      Thunk* thunk;
+    };
+    using Work = std::variant<
+        Quote_value,
+        Quote_thunk,
+        Quote_neutral,
+        Quote_body,
+        Make_lambda,
+        Make_call,
+        Remember>;
+
+    auto todo = std::vector<Work>{Quote_value{&value}};
+    auto done = std::vector<Ast>();
+
+    while (not todo.empty()) {
+      auto const work = todo.back();
+      todo.pop_back();
+
+      ublib::match(work)(
+          [&](Quote_value const& w) {
+            ublib::match(*w.value)(
+                [&](Closure const& c) {
+                  todo.push_back(Make_lambda{c.lambda});
+                  todo.push_back(
+                      Quote_body{&c.lambda->expression(), c.env.get(), 1});
+                },
+                [&](Neutral const& n) {
+                  todo.push_back(Quote_neutral{n.get()});
+                });
+          },
+          [&](Quote_thunk const& w) {
+            if (w.thunk->quoted) {
+              done.push_back(*w.thunk->quoted);
+              return;
+            }
+            todo.push_back(Remember{w.thunk});
+            ublib::match(w.thunk->state)(
+                [&](Thunk::Suspended const& s) {
+                  todo.push_back(Quote_body{s.code, s.env.get(), 0});
+                },
+                [&](Value const& v) { todo.push_back(Quote_value{&v}); });
+          },
+          [&](Quote_neutral const& w) {
+            ublib::match(w.neutral->underlying)(
+                [&](Ast const* free) { done.push_back(*free); },
+                [&](Neutral_node::Stuck_call const& call) {
+                  todo.push_back(Make_call{});
+                  todo.push_back(Quote_thunk{call.argument.get()});
+                  todo.push_back(Quote_neutral{call.callee.get()});
+                });
+          },
+          [&](Quote_body const& w) {
+            ublib::match(*w.expr)(
+                [&](Ast::Lambda const& e) {
+                  todo.push_back(Make_lambda{&e});
+                  todo.push_back(
+                      Quote_body{&e.expression(), w.env, w.depth + 1});
+                },
+                [&](Ast::Call const& e) {
+                  todo.push_back(Make_call{});
+                  todo.push_back(Quote_body{&e.argument(), w.env, w.depth});
+                  todo.push_back(Quote_body{&e.callee(), w.env, w.depth});
+                },
+                [&](Ast::Variable const& e) {
+                  if (e.index() < w.depth) {
+                    done.push_back(Ast(e));
+                  } else if (
+                      auto thunk = lookup(w.env, e.index() - w.depth)) {
+                    todo.push_back(Quote_thunk{thunk->get()});
+                  } else {
+                    done.push_back(Ast(e));
+                  }
+                },
+                [&](Ast::Free_variable const& e) { done.push_back(Ast(e)); });
+          },
+          [&](Make_lambda const& w) {
+            auto body = std::move(done.back());
+            done.pop_back();
+            done.push_back(
+                Ast(Ast::Lambda(w.lambda->variable(), std::move(body))));
+          },
+          [&](Make_call const&) {
+            auto argument = std::move(done.back());
+            done.pop_back();
+            auto callee = std::move(done.back());
+            done.pop_back();
+            done.push_back(
+                Ast(Ast::Call(std::move(callee), std::move(argument))));
+          },
+          [&](Remember const& w) { w.thunk->quoted = done.back(); });
+    }
+
+    return std::move(done.back());
+  }
+} // namespace
+
+Ast eval_lazy(Ast const& ast) { return quote(Machine().run(ast)); }
+
+} // namespace lambda
@@ -0,0 +1,277 @@
+#include <lambda/machine.h>
+
+#include "release.h"
+
+#include <ublib/failure.h>
+#include <ublib/utility.h>
+
+#include <memory>
+#include <optional>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace lambda {
+
+namespace {
+  // NOTE(ubsan): all of the `Ast const*`s in here point into the ast passed to
+  // `eval_cek`, which outlives the machine, so they're never dangling
+
+  struct Env_node;
+  using Environment = std::shared_ptr<Env_node const>;
+
+  struct Neutral_node;
+  using Neutral = std::shared_ptr<Neutral_node const>;
+
+  // a lambda, along with the arguments that its free variables refer to
+  struct Closure {
+    Ast::Lambda const* lambda;
+    Environment env;
+  };
+
+  // a value which can't be called any further; either a free variable, or a
+  // call of a neutral value
+  using Value = std::variant<Closure, Neutral>;
+
+  void release_value(Value& value) noexcept {
+    if (auto closure = std::get_if<Closure>(&value)) {
+      release(std::move(closure->env));
+    } else {
+      release(std::move(std::get<Neutral>(value)));
+    }
+  }
+
+  // NOTE(ubsan): values can be far deeper than the native stack, so the
+  // nodes are freed through `release`
+  struct Neutral_node {
+    struct Stuck_call {
+      Neutral callee;
+      Value argument;
+    };
+
+    // the `Ast const*` is the original free variable node
+    std::variant<Ast const*, Stuck_call> underlying;
+
+    Neutral_node(Neutral_node&&) = default;
+    ~Neutral_node() {
+      if (auto call = std::get_if<Stuck_call>(&underlying)) {
+        release(std::move(call->callee));
+        release_value(call->argument);
+      }
+    }
+  };
+
+  struct Env_node {
+    Value value;
+    Environment next;
+    // the value read back into an `Ast`;
+    // cached so that every use of a variable shares the same `Ast`,
+    // like `eval` does when it substitutes
+    mutable std::optional<Ast> quoted;
+
+    Env_node(Env_node&&) = default;
+    ~Env_node() {
+      release_value(value);
+      release(std::move(next));
+    }
+  };
+
+  // @return nullptr if the index isn't bound in env
+  Env_node const* lookup(Env_node const* node, int index) noexcept {
+    for (; node and index > 0; --index) {
+      node = node->next.get();
+    }
+    return node;
+  }
+
+  struct Machine {
+    // evaluate the argument of a call, with the callee on the side
+    struct Eval_argument {
+      Ast const* argument;
+      Environment env;
+    };
+    // call the callee with the value we just got
+    struct Apply {
+      Value callee;
+    };
+    using Frame = std::variant<Eval_argument, Apply>;
+
+    std::vector<Frame> kont;
+
+    Value run(Ast const& ast) {
+      auto control = &ast;
+      auto env = Environment();
+
+      for (;;) {
+        auto value = ublib::match(*control)(
+            [&](Ast::Call const& e) -> std::optional<Value> {
+              kont.push_back(Eval_argument{&e.argument(), env});
+              control = &e.callee();
+              return std::nullopt;
+            },
+            [&](Ast::Variable const& e) -> std::optional<Value> {
+              if (auto node = lookup(env.get(), e.index())) {
+                return node->value;
+              } else {
+                return ublib::throw_as<Value>(
+                    Eval_error("evaluation found an unbound non-free variable"));
+              }
+            },
+            [&](Ast::Free_variable const&) -> std::optional<Value> {
+              return Value(std::make_shared<Neutral_node const>(
+                  Neutral_node{control}));
+            },
+            [&](Ast::Lambda const& e) -> std::optional<Value> {
+              return Value(Closure{&e, env});
+            });
+
+        while (value) {
+          if (kont.empty()) {
+            return std::move(*value);
+          }
+
+          auto frame = std::move(kont.back());
+          kont.pop_back();
+
+          ublib::match(frame)(
+              [&](Eval_argument& f) {
+                kont.push_back(Apply{std::move(*value)});
+                value.reset();
+                control = f.argument;
+                env = std::move(f.env);
+              },
+              [&](Apply& f) {
+                ublib::match(f.callee)(
+                    [&](Closure& c) {
+                      env = std::make_shared<Env_node const>(
+                          Env_node{std::move(*value), std::move(c.env), {}});
+                      value.reset();
+                      control = &c.lambda->expression();
+                    },
+                    [&](Neutral& n) {
+                      value = Value(std::make_shared<Neutral_node const>(
+                          Neutral_node{Neutral_node::Stuck_call{
+                              std::move(n), std::move(*value)}}));
+                    });
+              });
+        }
+      }
+    }
+  };
+
+  // NOTE(ubsan): reads the value back without recursing, like the
+  // traversals in ast.cpp; values can be far deeper than the native stack
+  Ast quote(Value const& value) {
+    // read back a value
+    struct Quote_value {
+      Value const* value;
+    };
+    // read back a stuck call, or a free variable
+    struct Quote_neutral {
+      Neutral_node const* neutral;
+    };
+    // read back the body of a closure, `depth` lambdas in
+    struct Quote_body {
+      Ast const* expr;
+      Env_node const* env;
+      int depth;
+    };
+    // wrap the term we just got in a lambda like this one
+    struct Make_lambda {
+      Ast::Lambda const* lambda;
+    };
+    // call the callee we got with the argument we got after it
+    struct Make_call {};
+    // cache the term we just got as the value of this variable
+    struct Remember {
+      Env_node const* node;
+    };
+    using Work = std::variant<
+        Quote_value,
+        Quote_neutral,
+        Quote_body,
+        Make_lambda,
+        Make_call,
+        Remember>;
+
+    auto todo = std::vector<Work>{Quote_value{&value}};
+    auto done = std::vector<Ast>();
+
+    while (not todo.empty()) {
+      auto const work = todo.back();
+      todo.pop_back();
+
+      ublib::match(work)(
+          [&](Quote_value const& w) {
+            ublib::match(*w.value)(
+                [&](Closure const& c) {
+                  todo.push_back(Make_lambda{c.lambda});
+                  todo.push_back(
+                      Quote_body{&c.lambda->expression(), c.env.get(), 1});
+                },
+                [&](Neutral const& n) {
+                  todo.push_back(Quote_neutral{n.get()});
+                });
+          },
+          [&](Quote_neutral const& w) {
+            ublib::match(w.neutral->underlying)(
+                [&](Ast const* free) { done.push_back(*free); },
+                [&](Neutral_node::Stuck_call const& call) {
+                  todo.push_back(Make_call{});
+                  todo.push_back(Quote_value{&call.argument});
+                  todo.push_back(Quote_neutral{call.callee.get()});
+                });
+          },
+          [&](Quote_body const& w) {
+            ublib::match(*w.expr)(
+                [&](Ast::Lambda const& e) {
+                  todo.push_back(Make_lambda{&e});
+                  todo.push_back(
+                      Quote_body{&e.expression(), w.env, w.depth + 1});
+                },
+                [&](Ast::Call const& e) {
+                  todo.push_back(Make_call{});
+                  todo.push_back(Quote_body{&e.argument(), w.env, w.depth});
+                  todo.push_back(Quote_body{&e.callee(), w.env, w.depth});
+                },
+                [&](Ast::Variable const& e) {
+                  if (e.index() < w.depth) {
+                    done.push_back(Ast(e));
+                  } else if (
+                      auto node = lookup(w.env, e.index() - w.depth)) {
+                    if (node->quoted) {
+                      done.push_back(*node->quoted);
+                    } else {
+                      todo.push_back(Remember{node});
+                      todo.push_back(Quote_value{&node->value});
+                    }
+                  } else {
+                    done.push_back(Ast(e));
+                  }
+                },
+                [&](Ast::Free_variable const& e) { done.push_back(Ast(e)); });
+          },
+          [&](Make_lambda const& w) {
+            auto body = std::move(done.back());
+            done.pop_back();
+            done.push_back(
+                Ast(Ast::Lambda(w.lambda->variable(), std::move(body))));
+          },
+          [&](Make_call const&) {
+            auto argument = std::move(done.back());
+            done.pop_back();
+            auto callee = std::move(done.back());
+            done.pop_back();
+            done.push_back(
+                Ast(Ast::Call(std::move(callee), std::move(argument))));
+          },
+          [&](Remember const& w) { w.node->quoted = done.back(); });
+    }
+
+    return std::move(done.back());
+  }
+} // namespace
+
+Ast eval_cek(Ast const& ast) { return quote(Machine().run(ast)); }
+
+} // namespace lambda
@@ -0,0 +1,276 @@
+#include <lambda/normalize.h>
+
+#include "release.h"
+
+#include <ublib/failure.h>
+#include <ublib/utility.h>
+
+#include <memory>
+#include <optional>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace lambda {
+
+namespace {
+  // NOTE(ubsan): normalization by evaluation
+  // terms are evaluated lazily, with the same machine as `eval_lazy`, into
+  // values: closures, or neutral terms (a variable applied to arguments).
+  // Reading a value back into an `Ast` is what goes under binders; a closure
+  // is read back by calling it with a fresh neutral variable.
+  // Variables made while reading back are numbered by de Bruijn *level*,
+  // counting from the outside, so they don't need shifting; they're turned
+  // back into indices in the output.
+
+  struct Env_node;
+  using Environment = std::shared_ptr<Env_node const>;
+
+  struct Thunk;
+  using Thunk_ptr = std::shared_ptr<Thunk>;
+
+  struct Value_node;
+  using Value = std::shared_ptr<Value_node const>;
+
+  // NOTE(ubsan): values and environments can be far deeper than the native
+  // stack, like a long chain of stuck calls, so the nodes are freed through
+  // `release`, like in `eval_lazy`
+  struct Value_node {
+    struct Closure {
+      Ast::Lambda const* lambda;
+      Environment env;
+    };
+    // a variable bound while reading back
+    struct Level {
+      int level;
+    };
+    // the `Ast const*` is the original free variable node
+    struct Free {
+      Ast const* node;
+    };
+    struct Stuck_call {
+      Value callee;
+      Thunk_ptr argument;
+    };
+
+    std::variant<Closure, Level, Free, Stuck_call> underlying;
+
+    Value_node(Value_node&&) = default;
+    ~Value_node() {
+      if (auto closure = std::get_if<Closure>(&underlying)) {
+        release(std::move(closure->env));
+      } else if (auto call = std::get_if<Stuck_call>(&underlying)) {
+        release(std::move(call->callee));
+        release(std::move(call->argument));
+      }
+    }
+  };
+
+  struct Thunk {
+    struct Suspended {
+      Ast const* code;
+      Environment env;
+    };
+
+    std::variant<Suspended, Value> state;
+
+    Thunk(Thunk&&) = default;
+    ~Thunk() {
+      if (auto suspended = std::get_if<Suspended>(&state)) {
+        release(std::move(suspended->env));
+      } else {
+        release(std::move(std::get<Value>(state)));
+      }
+    }
+  };
+
+  struct Env_node {
+    Thunk_ptr thunk;
+    Environment next;
+
+    Env_node(Env_node&&) = default;
+    ~Env_node() {
+      release(std::move(thunk));
+      release(std::move(next));
+    }
+  };
+
+  template <typename T>
+  Value make_value(T t) {
+    return std::make_shared<Value_node const>(Value_node{std::move(t)});
+  }
+
+  Thunk_ptr make_thunk(Value value) {
+    return std::make_shared<Thunk>(Thunk{std::move(value)});
+  }
+
+  Thunk_ptr const& lookup(Environment const& env, int index) {
+    auto node = env.get();
+    for (; node and index > 0; --index) {
+      node = node->next.get();
+    }
+    if (not node) {
+      throw Eval_error("evaluation found an unbound non-free variable");
+    }
+    return node->thunk;
+  }
+
+  // evaluates `code` to weak head normal form
+  Value evaluate(Ast const& code, Environment env) {
+    // call the value we just got with the argument
+    struct Apply_to {
+      Thunk_ptr argument;
+    };
+    // overwrite the thunk with the value we just got
+    struct Update {
+      Thunk_ptr thunk;
+    };
+    using Frame = std::variant<Apply_to, Update>;
+
+    auto kont = std::vector<Frame>();
+    auto control = &code;
+
+    for (;;) {
+      auto value = ublib::match(*control)(
+          [&](Ast::Call const& e) -> Value {
+            auto argument = ublib::match(e.argument())(
+                [&](Ast::Variable const& v) { return lookup(env, v.index()); },
+                [&](Ast::Lambda const& l) {
+                  return make_thunk(make_value(Value_node::Closure{&l, env}));
+                },
+                [&](Ast::Free_variable const&) {
+                  return make_thunk(make_value(Value_node::Free{&e.argument()}));
+                },
+                [&](Ast::Call const&) {
+                  return std::make_shared<Thunk>(
+                      Thunk{Thunk::Suspended{&e.argument(), env}});
+                });
+            kont.push_back(Apply_to{std::move(argument)});
+            control = &e.callee();
+            return nullptr;
+          },
+          [&](Ast::Variable const& e) -> Value {
+            auto const& thunk = lookup(env, e.index());
+            return ublib::match(thunk->state)(
+                [&](Thunk::Suspended const& s) -> Value {
+                  kont.push_back(Update{thunk});
+                  control = s.code;
+                  // NOTE(ubsan): `s` is kept alive by the `Update`
+                  env = s.env;
+                  return nullptr;
+                },
+                [&](Value const& v) { return v; });
+          },
+          [&](Ast::Free_variable const&) -> Value {
+            return make_value(Value_node::Free{control});
+          },
+          [&](Ast::Lambda const& e) -> Value {
+            return make_value(Value_node::Closure{&e, env});
+          });
+
+      while (value) {
+        if (kont.empty()) {
+          return value;
+        }
+
+        auto frame = std::move(kont.back());
+        kont.pop_back();
+
+        ublib::match(frame)(
+            [&](Update& f) { f.thunk->state = value; },
+            [&](Apply_to& f) {
+              ublib::match(value->underlying)(
+                  [&](Value_node::Closure const& c) {
+                    env = std::make_shared<Env_node const>(
+                        Env_node{std::move(f.argument), c.env});
+                    control = &c.lambda->expression();
+                    value = nullptr;
+                  },
+                  [&](auto const&) {
+                    value = make_value(
+                        Value_node::Stuck_call{value, std::move(f.argument)});
+                  });
+            });
+      }
+    }
+  }
+
+  Value force(Thunk& thunk) {
+    return ublib::match(thunk.state)(
+        [&](Thunk::Suspended const& s) {
+          // NOTE(ubsan): copy out before `state` is overwritten
+          auto code = s.code;
+          auto env = s.env;
+          auto value = evaluate(*code, std::move(env));
+          thunk.state = value;
+          return value;
+        },
+        [&](Value const& v) { return v; });
+  }
+
+  Ast read_back(Value const& value) {
+    // read back `value`, under `level` binders, and push it to `done`
+    struct Quote {
+      Value value;
+      int level;
+    };
+    struct Build_lambda {
+      ublib::Shared_string variable;
+    };
+    struct Build_call {};
+    using Task = std::variant<Quote, Build_lambda, Build_call>;
+
+    auto todo = std::vector<Task>{Quote{value, 0}};
+    auto done = std::vector<Ast>();
+
+    while (not todo.empty()) {
+      auto task = std::move(todo.back());
+      todo.pop_back();
+
+      ublib::match(task)(
+          [&](Quote& t) {
+            ublib::match(t.value->underlying)(
+                [&](Value_node::Closure const& c) {
+                  auto fresh = make_thunk(make_value(Value_node::Level{t.level}));
+                  auto env = std::make_shared<Env_node const>(
+                      Env_node{std::move(fresh), c.env});
+                  todo.push_back(Build_lambda{c.lambda->variable()});
+                  todo.push_back(Quote{
+                      evaluate(c.lambda->expression(), std::move(env)),
+                      t.level + 1});
+                },
+                [&](Value_node::Level const& l) {
+                  done.push_back(Ast(Ast::Variable(t.level - l.level - 1)));
+                },
+                [&](Value_node::Free const& f) { done.push_back(*f.node); },
+                [&](Value_node::Stuck_call const& c) {
+                  todo.push_back(Build_call{});
+                  todo.push_back(Quote{force(*c.argument), t.level});
+                  todo.push_back(Quote{c.callee, t.level});
+                });
+          },
+          [&](Build_lambda& t) {
+            auto body = std::move(done.back());
+            done.pop_back();
+            done.push_back(
+                Ast(Ast::Lambda(std::move(t.variable), std::move(body))));
+          },
+          [&](Build_call&) {
+            auto argument = std::move(done.back());
+            done.pop_back();
+            auto callee = std::move(done.back());
+            done.pop_back();
+            done.push_back(
+                Ast(Ast::Call(std::move(callee), std::move(argument))));
+          });
+    }
+
+    return std::move(done.back());
+  }
+} // namespace
+
+Ast normalize_nbe(Ast const& ast) {
+  return read_back(evaluate(ast, Environment()));
+}
+
+} // namespace lambda
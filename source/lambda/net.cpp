@@ -0,0 +1,740 @@
+#include <lambda/net.h>
+
+#include <ublib/failure.h>
+#include <ublib/utility.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace lambda {
+
+namespace {
+  // NOTE(ubsan): a port is the index of its agent, and which of the agent's
+  // ports it is, packed together; port 0 is the principal port.
+  // A lambda's ports are (principal, body, variable); a call's are
+  // (callee, argument, result); a fan's are (principal, first copy, second
+  // copy); and a croissant's or bracket's are (principal, other side).
+  using Port = std::uint32_t;
+  using Agent_index = std::uint32_t;
+
+  constexpr Agent_index max_agents = Agent_index(1) << 30;
+
+  constexpr Port port(Agent_index agent, std::uint32_t slot) noexcept {
+    return agent << 2 | slot;
+  }
+  constexpr Agent_index agent_of(Port p) noexcept { return p >> 2; }
+  constexpr std::uint32_t slot_of(Port p) noexcept { return p & 3; }
+
+  enum class Kind : std::uint8_t {
+    // where the term is; it's connected through port 1, so it never
+    // interacts
+    root,
+    lambda,
+    call,
+    // shares what's on its principal side between its other two ports
+    fan,
+    // takes one off the level of what goes through it
+    croissant,
+    // adds one to the level of what goes through it
+    bracket,
+    eraser,
+    free_variable,
+  };
+
+  bool is_control(Kind kind) noexcept {
+    return kind == Kind::fan or kind == Kind::croissant or
+        kind == Kind::bracket;
+  }
+
+  std::uint32_t arity(Kind kind) noexcept {
+    switch (kind) {
+    case Kind::root:
+    case Kind::croissant:
+    case Kind::bracket:
+      return 1;
+    case Kind::lambda:
+    case Kind::call:
+    case Kind::fan:
+      return 2;
+    case Kind::eraser:
+    case Kind::free_variable:
+      return 0;
+    }
+    return ublib::unreachable<std::uint32_t>();
+  }
+
+  struct Agent {
+    Kind kind;
+    std::uint32_t level;
+    // the name of a lambda or a free variable
+    std::uint32_t name;
+    Port ports[3];
+  };
+
+  class Net {
+  public:
+    explicit Net(Ast const& ast);
+
+    // the most agents in the net at once, so far
+    std::size_t max_live() const noexcept { return max_live_; }
+
+    // @return false if the fuel ran out first
+    bool reduce(std::size_t fuel, Net_stats& stats);
+
+    // unshares what's left, then reads the term off the net; every step of
+    // either takes one fuel
+    // @return nothing if the fuel ran out first
+    // @throw Eval_error if the net doesn't make a term
+    std::optional<Ast> read_back(std::size_t fuel, Net_stats& stats);
+
+  private:
+    Kind kind(Agent_index agent) const noexcept {
+      return agents_[agent].kind;
+    }
+    std::uint32_t level(Agent_index agent) const noexcept {
+      return agents_[agent].level;
+    }
+    Port peer(Port p) const noexcept {
+      return agents_[agent_of(p)].ports[slot_of(p)];
+    }
+
+    Agent_index make(Kind kind, std::uint32_t level, std::uint32_t name = 0);
+    void destroy(Agent_index agent);
+
+    // NOTE(ubsan): when a pair interacts, the new agents are linked to what
+    // the old ones were linked to before the old ones are destroyed; a port
+    // of the old pair is just the end of a wire, until it's relinked.
+    // So linking through them in any order connects the right ports.
+    void link(Port lhs, Port rhs);
+    // connects whatever's on the other sides of `lhs` and `rhs`
+    void rewire(Port lhs, Port rhs) { link(peer(lhs), peer(rhs)); }
+
+    void interact(Agent_index lhs, Agent_index rhs, Net_stats& stats);
+    // `lower` goes through `upper`, leaving a copy of itself on each of
+    // `upper`'s other ports; `upper`'s copies are at the level on the other
+    // side of `lower`
+    void commute(Agent_index lower, Agent_index upper);
+    void erase(Agent_index eraser, Agent_index agent);
+
+    // whether `agent`, a fan, croissant, or bracket, is stuck on the result
+    // of a call at `other`, which `unshare` can push it through
+    bool can_unshare(Agent_index agent, Port other) const noexcept;
+    void unshare(Agent_index agent);
+
+    std::vector<Agent> agents_;
+    std::vector<Agent_index> free_list_;
+    std::size_t live_ = 0;
+    std::size_t max_live_ = 0;
+    // pairs connected by their principal ports
+    std::vector<std::pair<Agent_index, Agent_index>> active_;
+    // agents which may be stuck; see `can_unshare`
+    std::vector<Agent_index> stuck_;
+    std::vector<ublib::Shared_string> names_;
+    Agent_index root_;
+  };
+
+  bool has_rule(Kind lhs, Kind rhs) noexcept {
+    if (lhs > rhs) {
+      std::swap(lhs, rhs);
+    }
+    switch (lhs) {
+    case Kind::root:
+      return false;
+    case Kind::lambda:
+      return rhs == Kind::call or is_control(rhs) or rhs == Kind::eraser;
+    case Kind::call:
+      // a free variable in the callee is stuck
+      return is_control(rhs) or rhs == Kind::eraser;
+    case Kind::fan:
+    case Kind::croissant:
+    case Kind::bracket:
+    case Kind::eraser:
+      return true;
+    case Kind::free_variable:
+      return false;
+    }
+    return ublib::unreachable<bool>();
+  }
+
+  Net::Net(Ast const& ast) {
+    // NOTE(ubsan): an argument is a level deeper than the call it's in.
+    // Each use of a variable gets a croissant at the use's level; the uses
+    // inside one argument are shared by a tree of fans at its level, then
+    // leave it through one bracket, to be shared with the uses outside of
+    // it at the level of the call, and so on out to the lambda. So there's
+    // a bracket for each argument a variable is used inside of, instead of
+    // one for each use and each argument around it, which for a numeral's
+    // body, `f (f (f ... x))`, would be quadratic in its size.
+    //
+    // the bracket a variable leaves an argument through is made when it's
+    // first used in it; where it goes is only known once the argument has
+    // been translated, and we know whether it was used around it too.
+
+    // translates `ast` at `level`, with its output linked to `at`
+    struct Task {
+      enum class Step : std::uint8_t {
+        translate,
+        // starts translating an argument
+        enter_argument,
+        // after the argument at `level`
+        leave_argument,
+        // after the body of the innermost lambda
+        unbind,
+      };
+
+      Step step;
+      Ast const* ast;
+      std::uint32_t level;
+      Port at;
+    };
+    struct Binder {
+      Agent_index lambda;
+      // the port on the lambda's side which the last use at `level` is
+      // linked to; none, while it's unused
+      std::optional<Port> last_use;
+      // the level of the argument we're in, if it's used in it; otherwise,
+      // of the innermost one around it that it's used in, or of the lambda
+      std::uint32_t level;
+    };
+    // a variable used in an argument we're in, but not in the one around it
+    struct Crossing {
+      std::size_t binder;
+      // the bracket its uses leave the argument through; its principal port
+      // isn't linked yet
+      Agent_index bracket;
+      // what the binder had before it was used in the argument
+      std::optional<Port> outer_use;
+      std::uint32_t outer_level;
+    };
+
+    // links `end`, which some uses of `binder` at `binder.level` leave
+    // through, to the ones before them
+    auto const share = [&](Binder& binder, Port end) {
+      if (not binder.last_use) {
+        binder.last_use = port(binder.lambda, 2);
+        link(*binder.last_use, end);
+        return;
+      }
+      auto const fan = make(Kind::fan, binder.level);
+      auto const last = peer(*binder.last_use);
+      link(*binder.last_use, port(fan, 0));
+      link(port(fan, 1), last);
+      link(port(fan, 2), end);
+      binder.last_use = port(fan, 2);
+    };
+
+    root_ = make(Kind::root, 0);
+    auto todo = std::vector<Task>{
+        Task{Task::Step::translate, &ast, 0, port(root_, 1)}};
+    auto binders = std::vector<Binder>();
+    auto crossings = std::vector<Crossing>();
+    // for each argument we're in, where its crossings start
+    auto arguments = std::vector<std::size_t>();
+
+    while (not todo.empty()) {
+      auto const task = todo.back();
+      todo.pop_back();
+
+      switch (task.step) {
+      case Task::Step::translate:
+        break;
+      case Task::Step::enter_argument:
+        arguments.push_back(crossings.size());
+        todo.push_back(
+            Task{Task::Step::leave_argument, nullptr, task.level, 0});
+        todo.push_back(
+            Task{Task::Step::translate, task.ast, task.level, task.at});
+        continue;
+      case Task::Step::leave_argument: {
+        // each crossing either ends at the level around this argument, or
+        // crosses into the next argument out, through another bracket
+        auto const outer = task.level - 1;
+        auto const first = arguments.back();
+        arguments.pop_back();
+        auto kept = first;
+        for (auto i = first; i < crossings.size(); ++i) {
+          auto crossing = crossings[i];
+          auto& binder = binders[crossing.binder];
+          auto const end = port(crossing.bracket, 0);
+          binder.level = outer;
+          if (crossing.outer_level == outer) {
+            binder.last_use = crossing.outer_use;
+            share(binder, end);
+            continue;
+          }
+          crossing.bracket = make(Kind::bracket, outer - 1);
+          link(port(crossing.bracket, 1), end);
+          binder.last_use = port(crossing.bracket, 1);
+          crossings[kept++] = crossing;
+        }
+        crossings.resize(kept);
+        continue;
+      }
+      case Task::Step::unbind: {
+        auto const& binder = binders.back();
+        if (not binder.last_use) {
+          link(port(binder.lambda, 2), port(make(Kind::eraser, 0), 0));
+        }
+        binders.pop_back();
+        continue;
+      }
+      }
+
+      ublib::match(*task.ast)(
+          [&](Ast::Variable const& e) {
+            auto const idx = static_cast<std::size_t>(e.index());
+            if (e.index() < 0 or idx >= binders.size()) {
+              throw Eval_error("evaluation found an unbound non-free variable");
+            }
+            auto const which = binders.size() - 1 - idx;
+            auto& binder = binders[which];
+
+            auto const use = make(Kind::croissant, task.level);
+            link(port(use, 1), task.at);
+            if (binder.level == task.level) {
+              share(binder, port(use, 0));
+              return;
+            }
+            // the first use in this argument
+            auto const bracket = make(Kind::bracket, task.level - 1);
+            link(port(bracket, 1), port(use, 0));
+            crossings.push_back(
+                Crossing{which, bracket, binder.last_use, binder.level});
+            binder.last_use = port(bracket, 1);
+            binder.level = task.level;
+          },
+          [&](Ast::Free_variable const& e) {
+            auto const name = static_cast<std::uint32_t>(names_.size());
+            names_.push_back(e.name());
+            link(task.at, port(make(Kind::free_variable, 0, name), 0));
+          },
+          [&](Ast::Call const& e) {
+            auto const call = make(Kind::call, task.level);
+            link(task.at, port(call, 2));
+            todo.push_back(Task{
+                Task::Step::enter_argument,
+                &e.argument(),
+                task.level + 1,
+                port(call, 1)});
+            todo.push_back(Task{
+                Task::Step::translate, &e.callee(), task.level, port(call, 0)});
+          },
+          [&](Ast::Lambda const& e) {
+            auto const name = static_cast<std::uint32_t>(names_.size());
+            names_.push_back(e.variable());
+            auto const lambda = make(Kind::lambda, task.level, name);
+            link(task.at, port(lambda, 0));
+            binders.push_back(Binder{lambda, std::nullopt, task.level});
+            todo.push_back(Task{Task::Step::unbind, nullptr, 0, 0});
+            todo.push_back(Task{
+                Task::Step::translate,
+                &e.expression(),
+                task.level,
+                port(lambda, 1)});
+          });
+    }
+  }
+
+  Agent_index Net::make(Kind kind, std::uint32_t level, std::uint32_t name) {
+    auto agent = Agent_index();
+    if (not free_list_.empty()) {
+      agent = free_list_.back();
+      free_list_.pop_back();
+    } else if (agents_.size() == max_agents) {
+      throw std::length_error("the interaction net is full");
+    } else {
+      agent = static_cast<Agent_index>(agents_.size());
+      agents_.emplace_back();
+    }
+    agents_[agent] = Agent{kind, level, name, {0, 0, 0}};
+    max_live_ = std::max(max_live_, ++live_);
+    return agent;
+  }
+
+  void Net::destroy(Agent_index agent) {
+    // so that an old entry in `stuck_` isn't taken for a live agent
+    agents_[agent].kind = Kind::eraser;
+    free_list_.push_back(agent);
+    --live_;
+  }
+
+  void Net::link(Port lhs, Port rhs) {
+    agents_[agent_of(lhs)].ports[slot_of(lhs)] = rhs;
+    agents_[agent_of(rhs)].ports[slot_of(rhs)] = lhs;
+
+    auto const lhs_agent = agent_of(lhs);
+    auto const rhs_agent = agent_of(rhs);
+    if (slot_of(lhs) == 0 and slot_of(rhs) == 0) {
+      if (has_rule(kind(lhs_agent), kind(rhs_agent))) {
+        active_.emplace_back(lhs_agent, rhs_agent);
+      }
+    } else if (slot_of(lhs) == 0 and is_control(kind(lhs_agent))) {
+      if (can_unshare(lhs_agent, rhs)) {
+        stuck_.push_back(lhs_agent);
+      }
+    } else if (slot_of(rhs) == 0 and is_control(kind(rhs_agent))) {
+      if (can_unshare(rhs_agent, lhs)) {
+        stuck_.push_back(rhs_agent);
+      }
+    }
+  }
+
+  bool Net::reduce(std::size_t fuel, Net_stats& stats) {
+    while (not active_.empty()) {
+      if (stats.interactions == fuel) {
+        stats.max_agents = max_live_;
+        return false;
+      }
+      auto const [lhs, rhs] = active_.back();
+      active_.pop_back();
+      interact(lhs, rhs, stats);
+    }
+    stats.max_agents = max_live_;
+    return true;
+  }
+
+  void Net::interact(Agent_index lhs, Agent_index rhs, Net_stats& stats) {
+    if (kind(lhs) > kind(rhs)) {
+      std::swap(lhs, rhs);
+    }
+    ++stats.interactions;
+
+    auto const wrong_levels = [] {
+      return Eval_error("agents of the interaction net met at the wrong levels");
+    };
+
+    if (kind(lhs) == Kind::eraser) {
+      ++stats.erasures;
+      erase(lhs, rhs);
+    } else if (kind(rhs) == Kind::eraser) {
+      ++stats.erasures;
+      erase(rhs, lhs);
+    } else if (kind(rhs) == Kind::free_variable) {
+      // `lhs` is a fan, croissant, or bracket; a free variable doesn't have
+      // a level, so it only needs copying
+      if (kind(lhs) == Kind::fan) {
+        ++stats.duplications;
+        for (std::uint32_t i = 1; i <= 2; ++i) {
+          auto const copy = make(Kind::free_variable, 0, agents_[rhs].name);
+          link(port(copy, 0), peer(port(lhs, i)));
+        }
+        destroy(rhs);
+      } else {
+        ++stats.level_changes;
+        link(port(rhs, 0), peer(port(lhs, 1)));
+      }
+      destroy(lhs);
+    } else if (kind(lhs) == Kind::lambda and kind(rhs) == Kind::call) {
+      if (level(lhs) != level(rhs)) {
+        throw wrong_levels();
+      }
+      ++stats.betas;
+      rewire(port(lhs, 1), port(rhs, 2));
+      rewire(port(lhs, 2), port(rhs, 1));
+      destroy(lhs);
+      destroy(rhs);
+    } else if (kind(lhs) == kind(rhs) and level(lhs) == level(rhs)) {
+      // two fans, croissants, or brackets cancel out
+      if (kind(lhs) == Kind::fan) {
+        ++stats.annihilations;
+      } else {
+        ++stats.level_changes;
+      }
+      for (std::uint32_t i = 1; i <= arity(kind(lhs)); ++i) {
+        rewire(port(lhs, i), port(rhs, i));
+      }
+      destroy(lhs);
+      destroy(rhs);
+    } else {
+      // at least `rhs` is a fan, croissant, or bracket; whichever is lower
+      // goes through the other
+      if (level(lhs) == level(rhs)) {
+        throw wrong_levels();
+      }
+      auto const lower = level(lhs) < level(rhs) ? lhs : rhs;
+      auto const upper = lower == lhs ? rhs : lhs;
+      if (not is_control(kind(lower))) {
+        throw wrong_levels();
+      }
+      if (kind(lower) == Kind::fan) {
+        ++stats.duplications;
+      } else {
+        ++stats.level_changes;
+      }
+      commute(lower, upper);
+    }
+  }
+
+  void Net::commute(Agent_index lower, Agent_index upper) {
+    auto upper_level = level(upper);
+    if (kind(lower) == Kind::croissant) {
+      --upper_level;
+    } else if (kind(lower) == Kind::bracket) {
+      ++upper_level;
+    }
+
+    auto const lower_arity = arity(kind(lower));
+    auto const upper_arity = arity(kind(upper));
+    Agent_index lower_copies[2];
+    Agent_index upper_copies[2];
+    for (std::uint32_t i = 0; i < upper_arity; ++i) {
+      lower_copies[i] = make(kind(lower), level(lower));
+    }
+    for (std::uint32_t j = 0; j < lower_arity; ++j) {
+      upper_copies[j] = make(kind(upper), upper_level, agents_[upper].name);
+    }
+
+    for (std::uint32_t i = 0; i < upper_arity; ++i) {
+      for (std::uint32_t j = 0; j < lower_arity; ++j) {
+        link(port(lower_copies[i], j + 1), port(upper_copies[j], i + 1));
+      }
+    }
+    for (std::uint32_t i = 0; i < upper_arity; ++i) {
+      link(port(lower_copies[i], 0), peer(port(upper, i + 1)));
+    }
+    for (std::uint32_t j = 0; j < lower_arity; ++j) {
+      link(port(upper_copies[j], 0), peer(port(lower, j + 1)));
+    }
+    destroy(lower);
+    destroy(upper);
+  }
+
+  void Net::erase(Agent_index eraser, Agent_index agent) {
+    for (std::uint32_t i = 1; i <= arity(kind(agent)); ++i) {
+      link(port(make(Kind::eraser, 0), 0), peer(port(agent, i)));
+    }
+    destroy(eraser);
+    destroy(agent);
+  }
+
+  bool Net::can_unshare(Agent_index agent, Port other) const noexcept {
+    // NOTE(ubsan): like any other interaction, it only goes through what's
+    // above it
+    return kind(agent_of(other)) == Kind::call and slot_of(other) == 2 and
+        level(agent_of(other)) > level(agent);
+  }
+
+  void Net::unshare(Agent_index agent) {
+    // NOTE(ubsan): this is the commutation of `agent` and the call, as if
+    // the call's result were its principal port; so the call is copied for
+    // each of `agent`'s other ports, and `agent` onto the callee and the
+    // argument
+    auto const call = agent_of(peer(port(agent, 0)));
+    auto call_level = level(call);
+    if (kind(agent) == Kind::croissant) {
+      --call_level;
+    } else if (kind(agent) == Kind::bracket) {
+      ++call_level;
+    }
+
+    auto const agent_arity = arity(kind(agent));
+    Agent_index call_copies[2];
+    Agent_index agent_copies[2];
+    for (std::uint32_t i = 0; i < agent_arity; ++i) {
+      call_copies[i] = make(Kind::call, call_level);
+    }
+    for (std::uint32_t j = 0; j < 2; ++j) {
+      agent_copies[j] = make(kind(agent), level(agent));
+    }
+
+    for (std::uint32_t i = 0; i < agent_arity; ++i) {
+      for (std::uint32_t j = 0; j < 2; ++j) {
+        link(port(agent_copies[j], i + 1), port(call_copies[i], j));
+      }
+    }
+    for (std::uint32_t i = 0; i < agent_arity; ++i) {
+      link(port(call_copies[i], 2), peer(port(agent, i + 1)));
+    }
+    for (std::uint32_t j = 0; j < 2; ++j) {
+      link(port(agent_copies[j], 0), peer(port(call, j)));
+    }
+    destroy(agent);
+    destroy(call);
+  }
+
+  std::optional<Ast> Net::read_back(std::size_t fuel, Net_stats& stats) {
+    // NOTE(ubsan): once the net is reduced, a fan can still be sharing a
+    // term that's stuck, like a free variable applied to something; so
+    // first, those are pushed down through the calls, along with the
+    // croissants and brackets in their way, until all a fan shares is the
+    // uses of some variable. Then every lambda is in the net once, and the
+    // term is read by walking down from the root, and up from each use to
+    // its lambda.
+    auto const spend = [&] { return stats.read_back_steps++ != fuel; };
+
+    while (not active_.empty() or not stuck_.empty()) {
+      if (not spend()) {
+        return std::nullopt;
+      }
+      if (not active_.empty()) {
+        auto const [lhs, rhs] = active_.back();
+        active_.pop_back();
+        // these aren't counted as interactions; those are what reducing took
+        auto ignored = Net_stats();
+        interact(lhs, rhs, ignored);
+        continue;
+      }
+
+      auto const agent = stuck_.back();
+      stuck_.pop_back();
+      // it may have moved since it was pushed
+      auto const other = peer(port(agent, 0));
+      if (is_control(kind(agent)) and peer(other) == port(agent, 0) and
+          can_unshare(agent, other)) {
+        unshare(agent);
+      }
+    }
+    stats.max_agents = max_live_;
+
+    // reads the term on the other side of `from`, and pushes it to `done`
+    struct Read {
+      Port from;
+    };
+    // pops the body, and pushes the lambda
+    struct Build_lambda {
+      std::uint32_t name;
+    };
+    // pops the argument and the callee, and pushes the call
+    struct Build_call {};
+    // leaves the innermost lambda
+    struct Unbind {};
+    using Task = std::variant<Read, Build_lambda, Build_call, Unbind>;
+
+    auto const cannot_read = [] {
+      return Eval_error("the interaction net can't be read back as a term");
+    };
+
+    // the lambdas we're inside of; the innermost is at the back
+    auto binders = std::vector<Agent_index>();
+    auto todo = std::vector<Task>{Read{port(root_, 1)}};
+    auto done = std::vector<Ast>();
+    auto ran_out = false;
+
+    while (not todo.empty() and not ran_out) {
+      auto const task = todo.back();
+      todo.pop_back();
+
+      ublib::match(task)(
+          [&](Read const& t) {
+            for (auto p = peer(t.from);; p = peer(p)) {
+              if (not spend()) {
+                ran_out = true;
+                return;
+              }
+              auto const agent = agent_of(p);
+              auto const slot = slot_of(p);
+              switch (kind(agent)) {
+              case Kind::fan:
+                // by now, a fan only joins the uses of a variable
+                if (slot == 0) {
+                  throw cannot_read();
+                }
+                p = port(agent, 0);
+                continue;
+              case Kind::croissant:
+              case Kind::bracket:
+                p = port(agent, slot == 0 ? 1 : 0);
+                continue;
+              case Kind::lambda:
+                if (slot == 0) {
+                  binders.push_back(agent);
+                  todo.push_back(Unbind{});
+                  todo.push_back(Build_lambda{agents_[agent].name});
+                  todo.push_back(Read{port(agent, 1)});
+                } else if (slot == 2) {
+                  auto const it =
+                      std::find(binders.rbegin(), binders.rend(), agent);
+                  if (it == binders.rend()) {
+                    throw cannot_read();
+                  }
+                  done.push_back(Ast(
+                      Ast::Variable(static_cast<int>(it - binders.rbegin()))));
+                } else {
+                  throw cannot_read();
+                }
+                return;
+              case Kind::call:
+                if (slot != 2) {
+                  throw cannot_read();
+                }
+                todo.push_back(Build_call{});
+                todo.push_back(Read{port(agent, 1)});
+                todo.push_back(Read{port(agent, 0)});
+                return;
+              case Kind::free_variable:
+                done.push_back(
+                    Ast(Ast::Free_variable(names_[agents_[agent].name])));
+                return;
+              case Kind::root:
+              case Kind::eraser:
+                throw cannot_read();
+              }
+            }
+          },
+          [&](Build_lambda const& t) {
+            auto body = std::move(done.back());
+            done.pop_back();
+            done.push_back(Ast(Ast::Lambda(names_[t.name], std::move(body))));
+          },
+          [&](Build_call const&) {
+            auto argument = std::move(done.back());
+            done.pop_back();
+            auto callee = std::move(done.back());
+            done.pop_back();
+            done.push_back(
+                Ast(Ast::Call(std::move(callee), std::move(argument))));
+          },
+          [&](Unbind const&) { binders.pop_back(); });
+    }
+
+    if (ran_out) {
+      return std::nullopt;
+    }
+    return std::move(done.back());
+  }
+} // namespace
+
+std::ostream& operator<<(std::ostream& os, Net_stats const& stats) {
+  return os << "interactions: " << stats.interactions
+            << "\nbetas: " << stats.betas
+            << "\nduplications: " << stats.duplications
+            << "\nannihilations: " << stats.annihilations
+            << "\nlevel changes: " << stats.level_changes
+            << "\nerasures: " << stats.erasures
+            << "\nmax agents: " << stats.max_agents
+            << "\nread back steps: " << stats.read_back_steps;
+}
+
+Net_result normalize_net(Ast const& ast, std::size_t fuel) {
+  auto net = std::optional<Net>();
+  auto stats = Net_stats();
+  try {
+    net.emplace(ast);
+    if (not net->reduce(fuel, stats)) {
+      return Net_result{Net_result::Status::out_of_fuel, ast, stats};
+    }
+    auto term = net->read_back(fuel - stats.interactions, stats);
+    if (not term) {
+      return Net_result{Net_result::Status::out_of_fuel, ast, stats};
+    }
+    return Net_result{Net_result::Status::normal_form, std::move(*term), stats};
+  } catch (std::bad_alloc const&) {
+  } catch (std::length_error const&) {
+  }
+  // NOTE(ubsan): the net is freed before anything else is allocated
+  if (net) {
+    stats.max_agents = net->max_live();
+    net.reset();
+  }
+  return Net_result{Net_result::Status::out_of_memory, ast, stats};
+}
+
+} // namespace lambda
@@ -0,0 +1,228 @@
+#include <lambda/normalize.h>
+
+#include <ublib/failure.h>
+#include <ublib/utility.h>
+
+#include <memory>
+#include <optional>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace lambda {
+
+namespace {
+  // NOTE(ubsan): explicit substitutions
+  // a beta reduction doesn't rebuild the body; it suspends it, with the
+  // argument recorded as the substitution still to be done on it. That
+  // substitution is only pushed down a node at a time, as the node is
+  // looked at: a call passes it to its callee and argument, and a variable
+  // looks itself up in it. Nothing that isn't looked at is ever copied.
+  //
+  // lambdas that we go under are recorded in the substitution too, by their
+  // de Bruijn *level*, counting from the outside; so a term never needs
+  // shifting as it's moved under binders, and the levels are turned back
+  // into indices in the output.
+
+  struct Subst_node;
+  // a variable with index `i` is replaced by the `i`th entry in the list;
+  // past its end, the variable is unbound
+  using Substitution = std::shared_ptr<Subst_node const>;
+
+  // a term, with a substitution still to be done on it
+  struct Suspension {
+    Ast const* term;
+    Substitution subst;
+  };
+
+  struct Subst_node {
+    // a variable bound by a lambda that we went under, at this level
+    struct Level {
+      int level;
+    };
+
+    std::variant<Suspension, Level> entry;
+    Substitution next;
+  };
+
+  // a closed term is the same under any substitution, so it doesn't keep
+  // one alive
+  Suspension suspend(Ast const& term, Substitution subst) {
+    if (term.max_free_index() < 0) {
+      subst = nullptr;
+    }
+    return Suspension{&term, std::move(subst)};
+  }
+
+  Substitution extend(Subst_node::Level level, Substitution next) {
+    return std::make_shared<Subst_node const>(
+        Subst_node{level, std::move(next)});
+  }
+  Substitution extend(Suspension argument, Substitution next) {
+    return std::make_shared<Subst_node const>(
+        Subst_node{std::move(argument), std::move(next)});
+  }
+
+  Subst_node const& lookup(Substitution const& subst, int index) {
+    auto node = subst.get();
+    for (; node and index > 0; --index) {
+      node = node->next.get();
+    }
+    if (not node) {
+      throw Eval_error("evaluation found an unbound non-free variable");
+    }
+    return *node;
+  }
+} // namespace
+
+Normalize_result normalize(Ast const& ast, std::size_t fuel) {
+  // NOTE(ubsan): a term is normalized by reducing its head until it isn't a
+  // redex; then, if it's a lambda, we normalize its body, and otherwise it's
+  // a variable applied to arguments, and we normalize each of those.
+  // once the fuel runs out, terms are passed through as they are, with
+  // their substitutions done.
+
+  // normalize `term`, under `depth` lambdas, and push it to `done`
+  struct Normalize {
+    Suspension term;
+    int depth;
+  };
+  // pop the body from `done`, and push the lambda
+  struct Build_lambda {
+    ublib::Shared_string variable;
+  };
+  // pop `arguments` arguments from `done`, and push them applied to `head`;
+  // if there's no `head`, it's popped from `done` before the arguments
+  struct Build_call {
+    std::optional<Ast> head;
+    std::size_t arguments;
+  };
+  using Task = std::variant<Normalize, Build_lambda, Build_call>;
+
+  auto steps = std::size_t(0);
+  auto ran_out = false;
+  auto todo = std::vector<Task>{Normalize{suspend(ast, nullptr), 0}};
+  auto done = std::vector<Ast>();
+  // the arguments of the spine we're reducing; the first one is at the back
+  auto spine = std::vector<Suspension>();
+
+  while (not todo.empty()) {
+    auto task = std::move(todo.back());
+    todo.pop_back();
+
+    ublib::match(task)(
+        [&](Normalize& t) {
+          auto head = std::move(t.term);
+          if (ran_out and not head.subst) {
+            // closed, and nothing in it will be reduced
+            done.push_back(*head.term);
+            return;
+          }
+
+          // if the head turns out to be a variable bound by a lambda that
+          // we went under, its level
+          auto level = std::optional<int>();
+          for (auto more = true; more;) {
+            more = ublib::match(*head.term)(
+                [&](Ast::Call const& e) {
+                  // unwind the spine; the arguments applied last are pushed
+                  // first
+                  spine.push_back(suspend(e.argument(), head.subst));
+                  head.term = &e.callee();
+                  return true;
+                },
+                [&](Ast::Variable const& e) {
+                  return ublib::match(lookup(head.subst, e.index()).entry)(
+                      [&](Suspension const& s) {
+                        // copied out first; `s` belongs to `head.subst`
+                        auto next = s;
+                        head = std::move(next);
+                        return true;
+                      },
+                      [&](Subst_node::Level const& l) {
+                        level = l.level;
+                        return false;
+                      });
+                },
+                [](Ast::Free_variable const&) { return false; },
+                [&](Ast::Lambda const& e) {
+                  if (spine.empty()) {
+                    return false;
+                  }
+                  if (steps == fuel) {
+                    // keep going, to build the rest of the term, but don't
+                    // reduce
+                    ran_out = true;
+                    return false;
+                  }
+
+                  ++steps;
+                  auto subst =
+                      extend(std::move(spine.back()), std::move(head.subst));
+                  spine.pop_back();
+                  head = suspend(e.expression(), std::move(subst));
+                  return true;
+                });
+          }
+
+          // a lambda is only left with arguments if we ran out of fuel;
+          // then it's normalized like the arguments are, without reducing
+          // anything
+          auto const lambda = ublib::match(*head.term)(
+              [](Ast::Lambda const& e) { return &e; },
+              [](auto const&) -> Ast::Lambda const* { return nullptr; });
+          auto neutral = std::optional<Ast>();
+          if (level) {
+            neutral = Ast(Ast::Variable(t.depth - *level - 1));
+          } else if (not lambda) {
+            neutral = *head.term;
+          }
+
+          auto const arguments = spine.size();
+          if (arguments == 0) {
+            if (neutral) {
+              done.push_back(std::move(*neutral));
+            } else {
+              todo.push_back(Build_lambda{lambda->variable()});
+              todo.push_back(Normalize{
+                  suspend(
+                      lambda->expression(),
+                      extend(Subst_node::Level{t.depth}, std::move(head.subst))),
+                  t.depth + 1});
+            }
+            return;
+          }
+
+          // the head can't be reduced any further (or we're out of fuel);
+          // normalize each of the arguments, first one first
+          todo.push_back(Build_call{std::move(neutral), arguments});
+          for (auto& arg : spine) {
+            todo.push_back(Normalize{std::move(arg), t.depth});
+          }
+          spine.clear();
+          if (lambda) {
+            todo.push_back(Normalize{std::move(head), t.depth});
+          }
+        },
+        [&](Build_lambda& t) {
+          auto body = std::move(done.back());
+          done.pop_back();
+          done.push_back(Ast(Ast::Lambda(std::move(t.variable), std::move(body))));
+        },
+        [&](Build_call& t) {
+          auto const first = done.end() - static_cast<std::ptrdiff_t>(t.arguments);
+          auto ret = t.head ? std::move(*t.head) : std::move(*(first - 1));
+          for (auto it = first; it != done.end(); ++it) {
+            ret = Ast(Ast::Call(std::move(ret), std::move(*it)));
+          }
+          done.erase(t.head ? first : first - 1, done.end());
+          done.push_back(std::move(ret));
+        });
+  }
+
+  auto const status = ran_out ? Normalize_result::Status::out_of_fuel
+                              : Normalize_result::Status::normal_form;
+  return Normalize_result{status, std::move(done.back()), steps};
+}
+
+} // namespace lambda
@@ -1,196 +1,88 @@
 ﻿#include <lambda/parse_ast.h>
+#include <lambda/print.h>
+
+#include "parser.h"
 
 #include <ublib/utility.h>
 
 #include <cassert>
-#include <cctype>
 #include <iostream>
-#include <optional>
+#include <iterator>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
 
 using namespace ublib::prelude;
 
 namespace lambda {
 
-std::ostream& operator<<(std::ostream& os, Parse_ast const& ast) noexcept {
-  return match(ast)(
-      [&](Parse_ast::Variable const& v) -> std::ostream& { return os << v.name(); },
-      [&](Parse_ast::Call const& v) -> std::ostream& {
-        return os << v.callee() << ' ' << v.argument();
-      },
-      [&](Parse_ast::Lambda const& v) -> std::ostream& {
-        return os << '(' << '/' << v.parameter() << '.' << v.expression()
-                  << ')';
-      });
+void Parse_ast::free_unique(std::unique_ptr<Parse_ast> ast) noexcept {
+  // NOTE(ubsan): shallow trees are freed recursively, as usual;
+  // past `max_depth`, nodes are pushed to `pending` instead, and freed in a
+  // loop by the first call to get that deep
+  constexpr static int max_depth = 256;
+  thread_local auto depth = 0;
+  thread_local auto pending = std::vector<std::unique_ptr<Parse_ast>>();
+  thread_local auto draining = false;
+
+  if (depth < max_depth) {
+    ++depth;
+    ast.reset();
+    --depth;
+    return;
+  }
+
+  pending.push_back(std::move(ast));
+  if (draining) {
+    return;
+  }
+
+  draining = true;
+  while (not pending.empty()) {
+    // the children get pushed to `pending` when this is freed
+    auto node = std::move(pending.back());
+    pending.pop_back();
+    node.reset();
+  }
+  draining = false;
 }
 
-Parse_ast parse_from(std::istream& inp) {
-  // modified from my tapl-re reason project
-  constexpr static auto eof = std::char_traits<char>::eof();
-
-  struct helper {
-    std::istream& inp;
-
-    void eat_whitespace() {
-      while (std::isspace(inp.peek())) {
-        inp.get();
-      }
-    }
+std::ostream& operator<<(std::ostream& os, Parse_ast const& ast) noexcept {
+  return print(os, ast);
+}
 
-    [[noreturn]] void unexpected_thing() {
-      if (inp.peek() == eof) {
-        throw Parse_error("unexpected end of file");
-      } else {
-        throw Parse_error("unexpected character");
-      }
-    }
+namespace {
+  struct Parse_ast_sink {
+    using Term = Parse_ast;
 
-    void comment() {
-      auto ch = inp.get();
-      for (;;) {
-        if (ch == '*' and inp.peek() == ')') {
-          inp.get();
-          return;
-        } else if (ch == '(' and inp.peek() == '*') {
-          inp.get();
-          comment();
-        } else {
-          ch = inp.get();
-          if (ch == eof) {
-            throw Parse_error("unexpected end of file");
-          }
-        }
-      }
+    Term variable(std::string_view name) {
+      return Parse_ast::Variable(std::string(name));
     }
-
-    std::string get_var() {
-      eat_whitespace();
-      auto ch = inp.get();
-
-      if (ch == '(' and inp.peek() == '*') {
-        inp.get();
-        comment();
-        return get_var();
-      }
-
-      if (not(std::isalpha(ch) or ch == '_')) {
-        throw Parse_error("expected a variable");
-      }
-
-      std::string buffer;
-      buffer.push_back(static_cast<char>(ch));
-      for (;;) {
-        ch = inp.peek();
-        if (std::isalnum(ch) or ch == '_' or ch == '\'') {
-          inp.get();
-          buffer.push_back(static_cast<char>(ch));
-        } else {
-          break;
-        }
-      }
-      return buffer;
+    void bind(std::string_view) const noexcept {}
+    Term lambda(std::string_view name, Term body) {
+      return Parse_ast::Lambda(std::string(name), std::move(body));
     }
-
-    void get_dot() {
-      eat_whitespace();
-	  auto ch = inp.get();
-      if (ch == '(' and inp.peek() == '*') {
-        inp.get();
-        comment();
-        return get_dot();
-      }
-
-      if (ch == '.') {
-        inp.get();
-      } else {
-        unexpected_thing();
-      }
-    }
-
-    void get_close_paren() {
-      eat_whitespace();
-	  auto ch = inp.get();
-
-      if (ch == '(' and inp.peek() == '*') {
-        inp.get();
-        comment();
-        return get_close_paren();
-      }
-
-      if (ch == ')') {
-        inp.get();
-      } else {
-        unexpected_thing();
-      }
+    Term call(Term callee, Term argument) {
+      return Parse_ast::Call(std::move(callee), std::move(argument));
     }
+  };
+} // namespace
 
-    Parse_ast parse_app_list(Parse_ast fst) {
-      eat_whitespace();
-      auto ch = inp.peek();
-
-      switch (ch) {
-      case ')':
-      case eof:
-        return fst;
-      case '(': {
-        return parse_app_list(Parse_ast::Call(std::move(fst), parse_term()));
-      }
-      case '/':
-      case '\\':
-        throw Parse_error("attempted to define a lambda in a callee");
-      default:
-        if (std::isalpha(ch) or ch == '_') {
-          return parse_app_list(
-              Parse_ast::Call(std::move(fst), Parse_ast::Variable(get_var())));
-        } else {
-          unexpected_thing();
-        }
-      }
-    }
+Result<Parse_ast> try_parse_from(std::string_view source) {
+  auto sink = Parse_ast_sink();
+  return Parser(source, sink).parse_term();
+}
 
-    std::optional<Parse_ast> maybe_parse_term() {
-      eat_whitespace();
-      auto ch = inp.peek();
-      switch (ch) {
-      case eof:
-      case ')':
-        return std::nullopt;
-      case '/':
-      case '\\': {
-        inp.get();
-        auto name = get_var();
-        get_dot();
-        return Parse_ast::Lambda(std::move(name), parse_term());
-      }
-      case '(': {
-        inp.get();
-        if (inp.peek() == '*') {
-          inp.get();
-          comment();
-          return maybe_parse_term();
-        }
-        auto fst = parse_term();
-        get_close_paren();
-        return parse_app_list(std::move(fst));
-      }
-      default:
-        if (std::isalpha(ch) or ch == '_') {
-          return parse_app_list(Parse_ast::Variable(get_var()));
-        } else {
-          unexpected_thing();
-        }
-      }
-    }
+Parse_ast parse_from(std::string_view source) {
+  return value_or_throw(try_parse_from(source));
+}
 
-    Parse_ast parse_term() {
-      if (auto tm = maybe_parse_term()) {
-        return std::move(*tm);
-      } else {
-        unexpected_thing();
-      }
-    }
-  };
-  return helper{inp}.parse_term();
+Parse_ast parse_from(std::istream& inp) {
+  auto const buffer = std::string(
+      std::istreambuf_iterator<char>(inp), std::istreambuf_iterator<char>());
+  return parse_from(std::string_view(buffer));
 }
 
 std::ostream& operator<<(std::ostream& os, Parse_error const& e) {
@@ -0,0 +1,331 @@
+#pragma once
+
+// NOTE(ubsan): the parser is shared between `parse_from`, which builds a
+// `Parse_ast`, and `parse_to_ast`, which builds the `Ast` straight away.
+// What it builds is up to the `Sink`, which has:
+//
+//   using Term = ...;
+//   Term variable(std::string_view name);
+//   // called when the body of a lambda binding `name` starts
+//   void bind(std::string_view name);
+//   // called when that body is done
+//   Term lambda(std::string_view name, Term body);
+//   Term call(Term callee, Term argument);
+//
+// every name points into the source buffer. Errors are given back, not
+// thrown; the first one stops the parse.
+
+#include <lambda/error.h>
+#include <lambda/parse_ast.h>
+
+#include <ublib/utility.h>
+
+#include <cctype>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace lambda {
+
+inline bool is_identifier_start(char ch) noexcept {
+  return std::isalpha(static_cast<unsigned char>(ch)) or ch == '_';
+}
+inline bool is_identifier_continue(char ch) noexcept {
+  return std::isalnum(static_cast<unsigned char>(ch)) or ch == '_' or
+      ch == '\'';
+}
+
+// NOTE(ubsan): the identifiers this gives out point into the source buffer
+// comments are skipped, like whitespace; one that isn't closed is an
+// `unclosed_comment` token, at the end of the source
+class Lexer {
+public:
+  struct Token {
+    enum class Kind {
+      eof,
+      lambda,
+      dot,
+      open_paren,
+      close_paren,
+      identifier,
+      unknown,
+      unclosed_comment,
+    };
+
+    Kind kind;
+    std::string_view text;
+    // in bytes, from the start of the source
+    std::size_t offset;
+  };
+
+  explicit Lexer(std::string_view source) noexcept : source_(source) {}
+
+  Token peek() {
+    if (not peeked_) {
+      peeked_ = lex();
+    }
+    return *peeked_;
+  }
+
+  Token next() {
+    auto ret = peek();
+    peeked_.reset();
+    return ret;
+  }
+
+private:
+  bool at_end() const noexcept { return position_ == source_.size(); }
+  bool looking_at(char ch, std::size_t offset = 0) const noexcept {
+    return position_ + offset < source_.size() and
+        source_[position_ + offset] == ch;
+  }
+
+  // we've already eaten the "(*"; comments nest, and `depth` counts how
+  // many are open, so that a deep nest doesn't recurse
+  // @return false if the source ends first
+  bool comment() {
+    auto depth = std::size_t(1);
+    for (;;) {
+      if (at_end()) {
+        return false;
+      } else if (looking_at('*') and looking_at(')', 1)) {
+        position_ += 2;
+        if (--depth == 0) {
+          return true;
+        }
+      } else if (looking_at('(') and looking_at('*', 1)) {
+        position_ += 2;
+        ++depth;
+      } else {
+        ++position_;
+      }
+    }
+  }
+
+  // @return false if a comment isn't closed
+  bool eat_whitespace() {
+    for (;;) {
+      if (at_end()) {
+        return true;
+      } else if (std::isspace(static_cast<unsigned char>(source_[position_]))) {
+        ++position_;
+      } else if (looking_at('(') and looking_at('*', 1)) {
+        position_ += 2;
+        if (not comment()) {
+          return false;
+        }
+      } else {
+        return true;
+      }
+    }
+  }
+
+  Token lex() {
+    using Kind = Token::Kind;
+
+    if (not eat_whitespace()) {
+      return Token{Kind::unclosed_comment, {}, position_};
+    }
+    if (at_end()) {
+      return Token{Kind::eof, {}, position_};
+    }
+
+    auto const first = position_;
+    auto const single = [&](Kind kind) {
+      ++position_;
+      return Token{kind, source_.substr(first, 1), first};
+    };
+
+    auto const ch = source_[position_];
+    switch (ch) {
+    case '/':
+    case '\\':
+      return single(Kind::lambda);
+    case '.':
+      return single(Kind::dot);
+    case '(':
+      return single(Kind::open_paren);
+    case ')':
+      return single(Kind::close_paren);
+    default:
+      if (is_identifier_start(ch)) {
+        ++position_;
+        while (not at_end() and is_identifier_continue(source_[position_])) {
+          ++position_;
+        }
+        return Token{Kind::identifier,
+                     source_.substr(first, position_ - first),
+                     first};
+      } else {
+        return single(Kind::unknown);
+      }
+    }
+  }
+
+  std::string_view source_;
+  std::size_t position_ = 0;
+  std::optional<Token> peeked_;
+};
+
+// modified from my tapl-re reason project
+// NOTE(ubsan): written as a loop with an explicit stack of what to do with
+// each term once it's parsed, so deep nesting can't overflow the stack
+template <typename Sink>
+class Parser {
+public:
+  using Term = typename Sink::Term;
+
+  Parser(std::string_view source, Sink& sink) noexcept
+      : lex_(source), sink_(sink) {}
+
+  // @return the term, or the first error, if the input is invalid lambda
+  // calculus
+  Result<Term> parse_term() {
+    for (;;) {
+      auto term = start_term();
+      if (term) {
+        term = parse_app_list(std::move(*term));
+      }
+
+      // pass finished terms up to whatever was waiting on them
+      while (term) {
+        if (kont_.empty()) {
+          return std::move(*term);
+        }
+
+        auto next = std::move(kont_.back());
+        kont_.pop_back();
+
+        term = ublib::match(next)(
+            [&](Lambda_body& k) -> std::optional<Term> {
+              return sink_.lambda(k.name, std::move(*term));
+            },
+            [&](Parenthesized&) -> std::optional<Term> {
+              if (not expect(Kind::close_paren)) {
+                return std::nullopt;
+              }
+              return parse_app_list(std::move(*term));
+            },
+            [&](Call_argument& k) {
+              return parse_app_list(
+                  sink_.call(std::move(k.callee), std::move(*term)));
+            });
+      }
+
+      // NOTE(ubsan): no term means either a new one to start, or an error
+      if (error_) {
+        return ublib::Unexpected<Error>{*error_};
+      }
+    }
+  }
+
+private:
+  using Kind = Lexer::Token::Kind;
+
+  // @return nullopt, to give back from whatever found the error
+  std::nullopt_t error(Error_code code, std::size_t offset) noexcept {
+    error_ = Error{code, offset};
+    return std::nullopt;
+  }
+
+  std::nullopt_t unexpected_thing() {
+    auto const tok = lex_.peek();
+    if (tok.kind == Kind::eof or tok.kind == Kind::unclosed_comment) {
+      return error(Error_code::unexpected_end_of_file, tok.offset);
+    } else {
+      return error(Error_code::unexpected_character, tok.offset);
+    }
+  }
+
+  std::optional<std::string_view> get_var() {
+    if (lex_.peek().kind == Kind::unclosed_comment) {
+      return unexpected_thing();
+    }
+    auto tok = lex_.next();
+    if (tok.kind != Kind::identifier) {
+      return error(Error_code::expected_variable, tok.offset);
+    }
+    return tok.text;
+  }
+
+  // @return false if the next token isn't a `kind`
+  bool expect(Kind kind) {
+    if (lex_.peek().kind == kind) {
+      lex_.next();
+      return true;
+    } else {
+      unexpected_thing();
+      return false;
+    }
+  }
+
+  // `/name. <term>`
+  struct Lambda_body {
+    std::string_view name;
+  };
+  // `( <term> ) ...`
+  struct Parenthesized {};
+  // `callee ( <term> ...`; the argument term takes the rest of the list
+  struct Call_argument {
+    Term callee;
+  };
+  using Continuation = std::variant<Lambda_body, Parenthesized, Call_argument>;
+
+  // parses the start of a term, up to the first thing which can be
+  // followed by an application list
+  // @return nullopt if it pushed a continuation, and a new term must be
+  // started, or if it found an error
+  std::optional<Term> start_term() {
+    switch (lex_.peek().kind) {
+    case Kind::lambda: {
+      lex_.next();
+      auto const name = get_var();
+      if (not name or not expect(Kind::dot)) {
+        return std::nullopt;
+      }
+      sink_.bind(*name);
+      kont_.push_back(Lambda_body{*name});
+      return std::nullopt;
+    }
+    case Kind::open_paren:
+      lex_.next();
+      kont_.push_back(Parenthesized{});
+      return std::nullopt;
+    case Kind::identifier:
+      return sink_.variable(lex_.next().text);
+    default:
+      return unexpected_thing();
+    }
+  }
+
+  // @return nullopt if the argument is a new term to start, or if it found
+  // an error
+  std::optional<Term> parse_app_list(Term fst) {
+    for (;;) {
+      switch (lex_.peek().kind) {
+      case Kind::close_paren:
+      case Kind::eof:
+        return fst;
+      case Kind::open_paren:
+        kont_.push_back(Call_argument{std::move(fst)});
+        return std::nullopt;
+      case Kind::lambda:
+        return error(Error_code::lambda_in_callee, lex_.peek().offset);
+      case Kind::identifier:
+        fst = sink_.call(std::move(fst), sink_.variable(lex_.next().text));
+        break;
+      default:
+        return unexpected_thing();
+      }
+    }
+  }
+
+  Lexer lex_;
+  Sink& sink_;
+  std::vector<Continuation> kont_;
+  std::optional<Error> error_;
+};
+
+} // namespace lambda
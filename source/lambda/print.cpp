@@ -0,0 +1,303 @@
+#include <lambda/print.h>
+
+#include <ublib/failure.h>
+#include <ublib/utility.h>
+
+#include <charconv>
+#include <iostream>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+using namespace std::literals;
+
+namespace lambda {
+
+namespace {
+  // NOTE(ubsan): the renderer walks a tree through a `Node`, which is a
+  // pointer for the trees made of pointers; an `Arena_ast` has no pointers
+  // into it, so its nodes are the arena and an index
+  struct Arena_node {
+    Arena_ast const* arena;
+    Arena_ast::Index idx;
+  };
+
+  // the parts of a node the printer cares about
+  template <typename Node>
+  struct View {
+    enum class Kind {
+      // a name on its own
+      name,
+      // a de Bruijn index, printed with the name of its binder
+      variable,
+      call,
+      lambda,
+    };
+
+    Kind kind;
+    // the name, or the lambda's parameter
+    std::string_view name;
+    int index;
+    // the callee, or the lambda's body
+    Node first;
+    Node second;
+  };
+
+  View<Ast const*> view(Ast const* ast) {
+    using Kind = View<Ast const*>::Kind;
+    return ublib::match(*ast)(
+        [](Ast::Variable const& e) {
+          return View<Ast const*>{
+              Kind::variable, {}, e.index(), nullptr, nullptr};
+        },
+        [](Ast::Free_variable const& e) {
+          return View<Ast const*>{Kind::name, e.name(), 0, nullptr, nullptr};
+        },
+        [](Ast::Call const& e) {
+          return View<Ast const*>{
+              Kind::call, {}, 0, &e.callee(), &e.argument()};
+        },
+        [](Ast::Lambda const& e) {
+          return View<Ast const*>{
+              Kind::lambda, e.variable(), 0, &e.expression(), nullptr};
+        });
+  }
+
+  View<Parse_ast const*> view(Parse_ast const* ast) {
+    using Kind = View<Parse_ast const*>::Kind;
+    return ublib::match(*ast)(
+        [](Parse_ast::Variable const& e) {
+          return View<Parse_ast const*>{
+              Kind::name, e.name(), 0, nullptr, nullptr};
+        },
+        [](Parse_ast::Call const& e) {
+          return View<Parse_ast const*>{
+              Kind::call, {}, 0, &e.callee(), &e.argument()};
+        },
+        [](Parse_ast::Lambda const& e) {
+          return View<Parse_ast const*>{
+              Kind::lambda, e.parameter(), 0, &e.expression(), nullptr};
+        });
+  }
+
+  View<Arena_node> view(Arena_node node) {
+    using Kind = View<Arena_node>::Kind;
+    using Tag = Arena_ast::Tag;
+    auto const& arena = *node.arena;
+    auto const idx = node.idx;
+    switch (arena.tag(idx)) {
+    case Tag::variable:
+      return View<Arena_node>{Kind::variable, {}, arena.index(idx), {}, {}};
+    case Tag::free_variable:
+      return View<Arena_node>{Kind::name, arena.name(idx), 0, {}, {}};
+    case Tag::call:
+      return View<Arena_node>{
+          Kind::call,
+          {},
+          0,
+          Arena_node{&arena, arena.callee(idx)},
+          Arena_node{&arena, arena.argument(idx)}};
+    case Tag::lambda:
+      return View<Arena_node>{
+          Kind::lambda,
+          arena.name(idx),
+          0,
+          Arena_node{&arena, arena.expression(idx)},
+          {}};
+    }
+    return ublib::unreachable<View<Arena_node>>();
+  }
+
+  // where a term is, which decides whether it needs parentheses
+  enum class Position {
+    // the whole term, a lambda's body, or inside parentheses
+    top,
+    callee,
+    argument,
+  };
+
+  template <typename Node>
+  class Renderer {
+  public:
+    Renderer(std::string& out, Print_options const& opts)
+        : out_(out), opts_(opts) {}
+
+    void render(Node root) {
+      out_.clear();
+      todo_.push_back(Task{Task::Kind::term, root, Position::top, 1, {}});
+
+      while (not todo_.empty() and not full_) {
+        auto const task = todo_.back();
+        todo_.pop_back();
+
+        switch (task.kind) {
+        case Task::Kind::text:
+          append(task.text);
+          break;
+        case Task::Kind::close_lambda:
+          binders_.pop_back();
+          append(task.text);
+          break;
+        case Task::Kind::term:
+          term(task);
+          break;
+        }
+      }
+    }
+
+  private:
+    struct Task {
+      enum class Kind {
+        term,
+        text,
+        // leaves a lambda's scope, then prints `text`
+        close_lambda,
+      };
+
+      Kind kind;
+      Node tree;
+      Position position;
+      std::size_t depth;
+      std::string_view text;
+    };
+
+    void push_text(std::string_view text) {
+      todo_.push_back(Task{Task::Kind::text, {}, Position::top, 0, text});
+    }
+
+    // goes straight down the leftmost path; only pushes what comes after
+    void term(Task task) {
+      using Kind = typename View<Node>::Kind;
+
+      while (not full_) {
+        if (opts_.max_depth != 0 and task.depth > opts_.max_depth) {
+          append("..."sv);
+          return;
+        }
+
+        auto const node = view(task.tree);
+        auto const depth = task.depth + 1;
+        switch (node.kind) {
+        case Kind::name:
+          append(node.name);
+          return;
+        case Kind::variable:
+          variable(node.index);
+          return;
+        case Kind::call: {
+          auto const parens = opts_.minimal_parens and
+              (task.position == Position::argument or
+               (task.position == Position::callee and
+                not is_atom(node.second)));
+          if (parens) {
+            append('(');
+            push_text(")"sv);
+          }
+          todo_.push_back(
+              Task{Task::Kind::term, node.second, Position::argument, depth, {}});
+          push_text(" "sv);
+          task = Task{Task::Kind::term, node.first, Position::callee, depth, {}};
+          break;
+        }
+        case Kind::lambda: {
+          auto const parens =
+              not opts_.minimal_parens or task.position != Position::top;
+          append(parens ? "(/"sv : "/"sv);
+          append(node.name);
+          append('.');
+          binders_.push_back(node.name);
+          todo_.push_back(Task{
+              Task::Kind::close_lambda,
+              {},
+              Position::top,
+              0,
+              parens ? ")"sv : ""sv});
+          task = Task{Task::Kind::term, node.first, Position::top, depth, {}};
+          break;
+        }
+        }
+      }
+    }
+
+    // NOTE(ubsan): index 0 is the innermost binder, at the back
+    void variable(int index) {
+      auto const idx = static_cast<std::size_t>(index);
+      if (index < 0 or idx >= binders_.size()) {
+        throw std::out_of_range("variable is not bound in the printed term");
+      }
+      append(binders_[binders_.size() - 1 - idx]);
+      append('_');
+
+      char digits[16];
+      auto const end = std::to_chars(std::begin(digits), std::end(digits), index).ptr;
+      append(std::string_view(digits, static_cast<std::size_t>(end - digits)));
+    }
+
+    static bool is_atom(Node tree) {
+      using Kind = typename View<Node>::Kind;
+      auto const kind = view(tree).kind;
+      return kind == Kind::name or kind == Kind::variable;
+    }
+
+    void append(char ch) { append(std::string_view(&ch, 1)); }
+    void append(std::string_view s) {
+      if (full_) {
+        return;
+      }
+      if (opts_.max_length != 0 and out_.size() + s.size() > opts_.max_length) {
+        out_.append(s.substr(0, opts_.max_length - out_.size()));
+        out_.append("..."sv);
+        full_ = true;
+        return;
+      }
+      out_.append(s);
+    }
+
+    std::string& out_;
+    Print_options const& opts_;
+    std::vector<Task> todo_;
+    // the names of the lambdas we're inside; innermost at the back
+    std::vector<std::string_view> binders_;
+    // whether we've hit `max_length`
+    bool full_ = false;
+  };
+
+  // NOTE(ubsan): the buffer is kept around, one for each thread, so that
+  // printing to a stream only allocates when a term is longer than any that
+  // thread has printed before; the memory is kept until the thread exits
+  template <typename Tree>
+  std::ostream&
+  print_to(std::ostream& os, Tree const& tree, Print_options const& opts) {
+    thread_local auto buffer = std::string();
+    print(buffer, tree, opts);
+    return os.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+  }
+} // namespace
+
+void print(std::string& out, Ast const& ast, Print_options const& opts) {
+  Renderer<Ast const*>(out, opts).render(&ast);
+}
+
+void print(std::string& out, Parse_ast const& ast, Print_options const& opts) {
+  Renderer<Parse_ast const*>(out, opts).render(&ast);
+}
+
+void print(std::string& out, Arena_ast const& ast, Print_options const& opts) {
+  Renderer<Arena_node>(out, opts).render(Arena_node{&ast, ast.root()});
+}
+
+std::ostream& print(std::ostream& os, Ast const& ast, Print_options const& opts) {
+  return print_to(os, ast, opts);
+}
+
+std::ostream&
+print(std::ostream& os, Parse_ast const& ast, Print_options const& opts) {
+  return print_to(os, ast, opts);
+}
+
+std::ostream&
+print(std::ostream& os, Arena_ast const& ast, Print_options const& opts) {
+  return print_to(os, ast, opts);
+}
+
+} // namespace lambda
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace lambda {
+
+// NOTE(ubsan): drops a reference to a node that's shared between values,
+// like an environment, without recursing. The nodes of the machines call
+// this from their destructors, for each pointer they hold; shallow chains
+// are freed recursively, as usual, and past `max_depth`, nodes are pushed
+// to `pending` instead, and freed in a loop by the first call to get that
+// deep, like `Ast::free_unique` does.
+inline void release(std::shared_ptr<void const> node) noexcept {
+  constexpr static int max_depth = 256;
+  thread_local auto depth = 0;
+  thread_local auto pending = std::vector<std::shared_ptr<void const>>();
+  thread_local auto draining = false;
+
+  if (not node or node.use_count() > 1) {
+    return;
+  }
+
+  if (depth < max_depth) {
+    ++depth;
+    node.reset();
+    --depth;
+    return;
+  }
+
+  pending.push_back(std::move(node));
+  if (draining) {
+    return;
+  }
+
+  draining = true;
+  while (not pending.empty()) {
+    // the children get pushed to `pending` when this is freed
+    auto next = std::move(pending.back());
+    pending.pop_back();
+    next.reset();
+  }
+  draining = false;
+}
+
+} // namespace lambda
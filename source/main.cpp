@@ -1,15 +1,40 @@
 ﻿#include <lambda/parse_ast.h>
 #include <lambda/ast.h>
+#include <lambda/ast_factory.h>
+#include <lambda/arena_ast.h>
+#include <lambda/binary.h>
+#include <lambda/emit_c.h>
+#include <lambda/eval_cache.h>
+#include <lambda/bytecode.h>
+#include <lambda/environment.h>
+#include <lambda/instrument.h>
+#include <lambda/jets.h>
+#include <lambda/machine.h>
+#include <lambda/net.h>
+#include <lambda/normalize.h>
+#include <lambda/parallel.h>
+#include <lambda/print.h>
 
 #include <ublib/failure.h>
+#include <ublib/thread_pool.h>
 
+#include <algorithm>
+#include <charconv>
+#include <condition_variable>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <mutex>
 #include <optional>
 #include <sstream>
+#include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
+using namespace std::literals;
+
 constexpr static auto default_program = R"(
 (/fix./z.
   (/fib.fib z)
@@ -19,33 +44,667 @@ constexpr static auto default_program = R"(
 z
 )";
 
-std::unique_ptr<std::istream> get_program(int argc, char const* const* argv) {
-  if (argc > 2) {
-    auto const program_name = (argc > 0) ? argv[0] : "[program]";
-    ublib::failwith("Usage: ", program_name, " [filename=code.lc]");
-  } else if (argc == 2) {
-    return std::make_unique<std::fstream>(argv[1], std::ios_base::in);
+enum class Engine {
+  substitution,
+  cek,
+  lazy,
+  normal,
+  nbe,
+  net,
+  arena,
+  bytecode,
+};
+
+struct Options {
+  Engine engine = Engine::substitution;
+  bool hash_cons = false;
+  bool disassemble = false;
+  bool stats = false;
+  bool parse_dump = true;
+  // recognize Church numerals, and compute them natively; `--stats` and
+  // `--trace` never do
+  bool jets = true;
+  // the input is a term written by `--emit-binary`, not source code
+  bool load_binary = false;
+  std::optional<std::string_view> emit_binary;
+  // write the term out as a C program, instead of evaluating it
+  std::optional<std::string_view> emit_c;
+  // remember the values of closed terms, in memory, and in this file
+  // between runs; substitution engine only
+  std::optional<std::string_view> cache_file;
+  std::optional<std::size_t> cache_size;
+  std::optional<std::string_view> trace;
+  std::size_t fuel = lambda::unlimited_fuel;
+  // evaluate many programs, and print only their results
+  bool batch = false;
+  // read definitions and terms a line at a time
+  bool repl = false;
+  // evaluate large arguments on other threads; substitution engine only
+  bool parallel = false;
+  std::size_t fork_threshold = lambda::default_fork_threshold;
+  // the threads to evaluate a batch, or a `--parallel` program, on;
+  // zero means one per core
+  std::size_t jobs = 0;
+  // how terms are printed
+  lambda::Print_options print;
+  std::optional<std::string_view> filename;
+};
+
+[[noreturn]] void usage(int argc, char const* const* argv) {
+  auto const program_name = (argc > 0) ? argv[0] : "[program]";
+  ublib::failwith(
+      "Usage: ",
+      program_name,
+      " [--engine=substitution|cek|lazy|normal|nbe|net|arena|bytecode]"
+      " [--fuel=steps] [--hash-cons] [--disassemble] [--stats]"
+      " [--trace=file] [--no-parse-dump] [--no-jets] [--emit-binary=file]"
+      " [--emit-c=file] [--cache=file] [--cache-size=entries]"
+      " [--load-binary] [--batch] [--repl] [--parallel [--fork-threshold=nodes]]"
+      " [--jobs=threads] [--print-depth=levels] [--print-length=chars]"
+      " [--minimal-parens] [filename=code.lc]");
+}
+
+std::size_t
+parse_count(std::string_view s, int argc, char const* const* argv) {
+  auto ret = std::size_t(0);
+  auto const last = s.data() + s.size();
+  auto const [ptr, ec] = std::from_chars(s.data(), last, ret);
+  if (s.empty() or ec != std::errc() or ptr != last) {
+    usage(argc, argv);
+  }
+  return ret;
+}
+
+Options get_options(int argc, char const* const* argv) {
+  auto ret = Options();
+  for (int i = 1; i < argc; ++i) {
+    auto const arg = std::string_view(argv[i]);
+    if (arg == "--engine=substitution"sv) {
+      ret.engine = Engine::substitution;
+    } else if (arg == "--engine=cek"sv) {
+      ret.engine = Engine::cek;
+    } else if (arg == "--engine=lazy"sv) {
+      ret.engine = Engine::lazy;
+    } else if (arg == "--engine=normal"sv) {
+      ret.engine = Engine::normal;
+    } else if (arg == "--engine=nbe"sv) {
+      ret.engine = Engine::nbe;
+    } else if (arg == "--engine=net"sv) {
+      ret.engine = Engine::net;
+    } else if (arg == "--engine=arena"sv) {
+      ret.engine = Engine::arena;
+    } else if (arg == "--engine=bytecode"sv) {
+      ret.engine = Engine::bytecode;
+    } else if (arg.substr(0, 7) == "--fuel="sv) {
+      ret.fuel = parse_count(arg.substr(7), argc, argv);
+    } else if (arg == "--hash-cons"sv) {
+      ret.hash_cons = true;
+    } else if (arg == "--disassemble"sv) {
+      ret.disassemble = true;
+    } else if (arg == "--stats"sv) {
+      ret.stats = true;
+    } else if (arg == "--no-parse-dump"sv) {
+      ret.parse_dump = false;
+    } else if (arg == "--no-jets"sv) {
+      ret.jets = false;
+    } else if (arg.substr(0, 14) == "--emit-binary="sv and arg.size() > 14) {
+      ret.emit_binary = arg.substr(14);
+    } else if (arg.substr(0, 9) == "--emit-c="sv and arg.size() > 9) {
+      ret.emit_c = arg.substr(9);
+    } else if (arg.substr(0, 8) == "--cache="sv and arg.size() > 8) {
+      ret.cache_file = arg.substr(8);
+    } else if (arg.substr(0, 13) == "--cache-size="sv) {
+      ret.cache_size = parse_count(arg.substr(13), argc, argv);
+    } else if (arg == "--load-binary"sv) {
+      ret.load_binary = true;
+    } else if (arg == "--batch"sv) {
+      ret.batch = true;
+    } else if (arg == "--repl"sv) {
+      ret.repl = true;
+    } else if (arg == "--parallel"sv) {
+      ret.parallel = true;
+    } else if (arg.substr(0, 17) == "--fork-threshold="sv) {
+      ret.fork_threshold = parse_count(arg.substr(17), argc, argv);
+    } else if (arg.substr(0, 7) == "--jobs="sv) {
+      ret.jobs = parse_count(arg.substr(7), argc, argv);
+    } else if (arg.substr(0, 14) == "--print-depth="sv) {
+      ret.print.max_depth = parse_count(arg.substr(14), argc, argv);
+    } else if (arg.substr(0, 15) == "--print-length="sv) {
+      ret.print.max_length = parse_count(arg.substr(15), argc, argv);
+    } else if (arg == "--minimal-parens"sv) {
+      ret.print.minimal_parens = true;
+    } else if (arg.substr(0, 8) == "--trace="sv and arg.size() > 8) {
+      ret.trace = arg.substr(8);
+    } else if (arg.substr(0, 2) == "--"sv or ret.filename) {
+      usage(argc, argv);
+    } else {
+      ret.filename = arg;
+    }
+  }
+  // the default program isn't a binary term
+  if (ret.load_binary and not ret.filename) {
+    usage(argc, argv);
+  }
+  // a batch only prints results, and evaluates each program independently
+  if (ret.batch and
+      (ret.hash_cons or ret.disassemble or ret.stats or ret.trace or
+       ret.emit_binary or ret.emit_c or ret.load_binary or ret.parallel or
+       ret.cache_file or ret.cache_size)) {
+    usage(argc, argv);
+  }
+  // the REPL keeps `Ast`s around, and only prints results
+  if (ret.repl and
+      (ret.batch or ret.engine == Engine::arena or ret.hash_cons or
+       ret.stats or ret.trace or ret.emit_binary or ret.emit_c or
+       ret.load_binary or ret.cache_file or ret.cache_size)) {
+    usage(argc, argv);
+  }
+  // the parallel evaluator doesn't build through a factory, or record
+  if (ret.parallel and
+      (ret.engine != Engine::substitution or ret.hash_cons or ret.stats or
+       ret.trace or not ret.jets)) {
+    usage(argc, argv);
+  }
+  // the cache is `eval`'s, and it's never used when recording
+  if ((ret.cache_file or ret.cache_size) and
+      (ret.engine != Engine::substitution or ret.parallel or ret.hash_cons or
+       ret.stats or ret.trace or not ret.jets)) {
+    usage(argc, argv);
+  }
+  return ret;
+}
+
+// reads the whole file in at once, so the parser can work on a buffer
+// NOTE(ubsan): a regular file is read in one go, at the size it says it
+// is; whatever that misses is read as a stream, which is all of it for a
+// pipe like `/dev/stdin`, since those can't seek
+std::string read_file(std::string const& filename) {
+  auto file = std::ifstream(filename, std::ios_base::in | std::ios_base::binary);
+  if (not file) {
+    ublib::failwith("Couldn't open ", filename);
+  }
+
+  auto buffer = std::string();
+  if (file.seekg(0, std::ios_base::end)) {
+    auto const size = file.tellg();
+    if (size != std::streampos(-1) and file.seekg(0, std::ios_base::beg)) {
+      buffer.resize(static_cast<std::size_t>(size));
+      file.read(buffer.data(), static_cast<std::streamsize>(size));
+      buffer.resize(static_cast<std::size_t>(file.gcount()));
+    }
+  }
+  file.clear();
+  buffer.append(
+      std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  return buffer;
+}
+
+std::string get_program(Options const& opts) {
+  if (opts.filename) {
+    return read_file(std::string(*opts.filename));
   } else {
-    return std::make_unique<std::stringstream>(default_program);
+    return default_program;
+  }
+}
+
+struct Batch_program {
+  std::string name;
+  std::string source;
+};
+
+// a directory gives every `.lc` file in it, in order of their names;
+// a file (or stdin, if there isn't one) is split into programs at every
+// line that's just `;;`, and they're named by their position
+std::vector<Batch_program> get_batch(Options const& opts) {
+  namespace fs = std::filesystem;
+
+  auto ret = std::vector<Batch_program>();
+  if (opts.filename and fs::is_directory(*opts.filename)) {
+    for (auto const& entry : fs::directory_iterator(*opts.filename)) {
+      if (entry.is_regular_file() and entry.path().extension() == ".lc") {
+        ret.push_back(Batch_program{
+            entry.path().filename().string(),
+            read_file(entry.path().string())});
+      }
+    }
+    std::sort(ret.begin(), ret.end(), [](auto const& lhs, auto const& rhs) {
+      return lhs.name < rhs.name;
+    });
+    return ret;
+  }
+
+  auto const stream = opts.filename
+      ? read_file(std::string(*opts.filename))
+      : std::string(
+            std::istreambuf_iterator<char>(std::cin),
+            std::istreambuf_iterator<char>());
+
+  auto const add = [&](std::string_view source) {
+    // skip empty programs, like after a trailing `;;`
+    if (source.find_first_not_of(" \t\r\n") != std::string_view::npos) {
+      ret.push_back(
+          Batch_program{std::to_string(ret.size() + 1), std::string(source)});
+    }
+  };
+
+  auto const all = std::string_view(stream);
+  auto start = std::size_t(0);
+  for (auto line = std::size_t(0); line < all.size();) {
+    auto end = all.find('\n', line);
+    if (end == std::string_view::npos) {
+      end = all.size();
+    }
+    auto text = all.substr(line, end - line);
+    if (not text.empty() and text.back() == '\r') {
+      text.remove_suffix(1);
+    }
+    if (text == ";;"sv) {
+      add(all.substr(start, line - start));
+      start = end + 1;
+    }
+    line = end + 1;
+  }
+  if (start < all.size()) {
+    add(all.substr(start));
+  }
+  return ret;
+}
+
+// if factory is non-null, the result is built out of its nodes
+// only the substitution engine is instrumented
+lambda::Ast run(
+    Options const& opts,
+    lambda::Ast const& ast,
+    lambda::Ast_factory* factory,
+    std::optional<lambda::Instrumentation> inst) {
+  switch (opts.engine) {
+  case Engine::substitution:
+    if (opts.parallel) {
+      auto pool = ublib::Thread_pool(opts.jobs);
+      return lambda::eval_parallel(ast, pool, opts.fork_threshold);
+    }
+    if (inst) {
+      return lambda::eval(ast, *inst, factory);
+    }
+    if (not opts.jets) {
+      auto ret = lambda::eval_without_jets(ast);
+      return factory ? factory->intern(ret) : ret;
+    }
+    return factory ? lambda::eval(ast, *factory) : lambda::eval(ast);
+  case Engine::cek: {
+    auto ret = lambda::eval_cek(ast);
+    return factory ? factory->intern(ret) : ret;
+  }
+  case Engine::lazy: {
+    auto ret = lambda::eval_lazy(ast);
+    return factory ? factory->intern(ret) : ret;
+  }
+  case Engine::normal: {
+    auto ret = lambda::normalize(ast, opts.fuel);
+    if (ret.status == lambda::Normalize_result::Status::out_of_fuel) {
+      std::cerr << "ran out of fuel after " << ret.steps << " steps\n";
+    }
+    return factory ? factory->intern(ret.term) : ret.term;
+  }
+  case Engine::nbe: {
+    auto ret = lambda::normalize_nbe(ast);
+    return factory ? factory->intern(ret) : ret;
+  }
+  case Engine::net: {
+    auto ret = lambda::normalize_net(ast, opts.fuel);
+    if (ret.status == lambda::Net_result::Status::out_of_fuel) {
+      std::cerr << "ran out of fuel after " << ret.stats.interactions
+                << " interactions and " << ret.stats.read_back_steps
+                << " steps reading back\n";
+    } else if (ret.status == lambda::Net_result::Status::out_of_memory) {
+      std::cerr << "ran out of memory after " << ret.stats.interactions
+                << " interactions and " << ret.stats.read_back_steps
+                << " steps reading back\n";
+    }
+    if (opts.stats) {
+      std::cerr << ret.stats << '\n';
+    }
+    return factory ? factory->intern(ret.term) : ret.term;
+  }
+  case Engine::bytecode: {
+    auto const program = lambda::Bytecode(ast);
+    if (opts.disassemble) {
+      lambda::disassemble(std::cout, program);
+      std::cout << '\n';
+    }
+    auto ret = lambda::eval(program);
+    return factory ? factory->intern(ret) : ret;
+  }
+  case Engine::arena:
+    break; // doesn't use `Ast`; handled in main
+  }
+  return ublib::unreachable<lambda::Ast>();
+}
+
+// evaluates one program of a batch, and renders what to print for it into
+// `out`; errors are printed instead of a result, and don't stop the batch. A
+// parse error is given back rather than thrown, with where it was found; in
+// a batch, they can be most of the programs.
+void evaluate(Options const& opts, std::string_view source, std::string& out) {
+  // errors are rare enough that they can go through a stream
+  auto const error = [&](auto const& e) {
+    auto os = std::ostringstream();
+    os << e;
+    out = std::move(os).str();
+  };
+  try {
+    if (opts.engine == Engine::arena) {
+      if (auto parsed = lambda::try_parse_from(source)) {
+        lambda::print(
+            out, lambda::eval(lambda::reduce_to_arena(*parsed)), opts.print);
+      } else {
+        error(parsed.error());
+      }
+    } else {
+      if (auto ast = lambda::try_parse_to_ast(source)) {
+        lambda::print(out, run(opts, *ast, nullptr, std::nullopt), opts.print);
+      } else {
+        error(ast.error());
+      }
+    }
+  } catch (std::exception const& e) {
+    out = "Error: ";
+    out += e.what();
+  }
+}
+
+// NOTE(ubsan): programs are evaluated on a pool of threads, as independent
+// terms; nothing in the library is shared between them. Results are
+// printed in the order of the input, as soon as all the results before
+// them are done.
+void run_batch(Options const& opts) {
+  auto const programs = get_batch(opts);
+
+  auto results = std::vector<std::optional<std::string>>(programs.size());
+  auto mutex = std::mutex();
+  auto finished = std::condition_variable();
+
+  auto pool = ublib::Thread_pool(opts.jobs);
+  for (std::size_t i = 0; i < programs.size(); ++i) {
+    pool.submit([&, i] {
+      // rendered into a buffer each worker reuses, then copied out at its
+      // final size, since the results are kept until they're printed in
+      // order
+      thread_local auto buffer = std::string();
+      evaluate(opts, programs[i].source, buffer);
+      {
+        auto lock = std::lock_guard(mutex);
+        results[i] = buffer;
+      }
+      finished.notify_one();
+    });
+  }
+
+  for (std::size_t i = 0; i < programs.size(); ++i) {
+    auto const ready = [&] { return results[i].has_value(); };
+    // help out while waiting, instead of just blocking
+    for (;;) {
+      {
+        auto lock = std::unique_lock(mutex);
+        if (ready()) {
+          break;
+        }
+      }
+      if (not pool.run_one()) {
+        // what's done so far shouldn't wait on a slow program
+        std::cout.flush();
+        auto lock = std::unique_lock(mutex);
+        finished.wait(lock, ready);
+        break;
+      }
+    }
+
+    // nothing else touches `results[i]` once it's been set
+    std::cout << programs[i].name << ": " << *results[i] << '\n';
+    results[i].reset();
+  }
+}
+
+// runs one line of the REPL: a definition is added to `env`, and a term is
+// evaluated; either way, the value is rendered into `out`, which the REPL
+// reuses for every line
+// @throw Parse_error, or whatever evaluating throws
+void run_line(
+    Options const& opts,
+    lambda::Environment& env,
+    std::string_view line,
+    std::string& out) {
+  auto const definition = lambda::parse_definition(line);
+  auto const source = definition ? definition->term : line;
+  auto value =
+      run(opts, env.resolve(lambda::parse_to_ast(source)), nullptr, std::nullopt);
+  lambda::print(out, value, opts.print);
+  if (definition) {
+    out.insert(0, " = ").insert(0, definition->name);
+    env.define(ublib::Shared_string(definition->name), std::move(value));
+  }
+}
+
+// NOTE(ubsan): every line is either `let name = term`, or a term to
+// evaluate. Definitions are evaluated once, and later lines use the cached
+// value, so a prelude costs nothing once it's loaded. The file, if there is
+// one, is loaded as a prelude before reading from stdin: its lines are run
+// the same way, but only errors are printed, and they're fatal.
+void run_repl(Options const& opts) {
+  auto env = lambda::Environment();
+  auto out = std::string();
+
+  if (opts.filename) {
+    auto const filename = std::string(*opts.filename);
+    auto file = std::ifstream(filename);
+    if (not file) {
+      ublib::failwith("Couldn't open ", filename);
+    }
+    auto line = std::string();
+    for (auto number = 1; std::getline(file, line); ++number) {
+      try {
+        if (not lambda::is_blank(line)) {
+          run_line(opts, env, line, out);
+        }
+      } catch (lambda::Parse_error const& e) {
+        ublib::failwith(filename, ":", number, ": ", e);
+      } catch (std::exception const& e) {
+        ublib::failwith(filename, ":", number, ": Error: ", e.what());
+      }
+    }
+  }
+
+  auto line = std::string();
+  for (;;) {
+    std::cout << "> " << std::flush;
+    if (not std::getline(std::cin, line)) {
+      std::cout << '\n';
+      return;
+    }
+    try {
+      if (not lambda::is_blank(line)) {
+        run_line(opts, env, line, out);
+        std::cout << out << '\n';
+      }
+    } catch (lambda::Parse_error const& e) {
+      std::cout << e << '\n';
+    } catch (std::exception const& e) {
+      std::cout << "Error: " << e.what() << '\n';
+    }
   }
 }
 
 int main(int argc, char** argv) {
-  auto file = get_program(argc, argv);
+  auto const opts = get_options(argc, argv);
+  if (opts.batch) {
+    run_batch(opts);
+    return 0;
+  }
+  if (opts.repl) {
+    run_repl(opts);
+    return 0;
+  }
+
+  auto const program = get_program(opts);
+
+  // exits on a parse error
+  auto const parse = [&] {
+    try {
+      return lambda::parse_from(std::string_view(program));
+    } catch (lambda::Parse_error const& e) {
+      ublib::failwith(e);
+    }
+  };
+
+  // exits if the input isn't a binary term
+  auto const load = [&](auto read) {
+    try {
+      return read(std::string_view(program));
+    } catch (lambda::Binary_error const& e) {
+      ublib::failwith(e);
+    }
+  };
+
+  // `--emit-binary` and `--emit-c` write out an `Ast`, so they go the usual
+  // way
+  if (opts.engine == Engine::arena and not opts.emit_binary and
+      not opts.emit_c) {
+    // skip the pointer tree altogether
+    auto const pre_eval = [&] {
+      if (opts.load_binary) {
+        return load(lambda::read_binary_arena);
+      }
+      auto const parsed = parse();
+      if (opts.parse_dump) {
+        std::cout << "parse: ";
+        lambda::print(std::cout, parsed, opts.print) << "\n\n";
+      }
+      return lambda::reduce_to_arena(parsed);
+    }();
+    std::cout << "typed: ";
+    lambda::print(std::cout, pre_eval, opts.print) << "\n\n";
+    std::cout << "eval'd: ";
+    lambda::print(std::cout, lambda::eval(pre_eval), opts.print) << '\n';
+    return 0;
+  }
+
+  auto factory = std::optional<lambda::Ast_factory>();
+  if (opts.hash_cons) {
+    factory.emplace();
+  }
 
-  auto parse = [&] {
+  auto stats = lambda::Eval_stats();
+  auto trace = std::ofstream();
+  auto inst = std::optional<lambda::Instrumentation>();
+  if (opts.stats or opts.trace) {
+    inst.emplace();
+    // the trace numbers the steps, so it needs the counters
+    inst->stats = &stats;
+    if (opts.trace) {
+      auto const filename = std::string(*opts.trace);
+      trace.open(filename);
+      if (not trace) {
+        ublib::failwith("Couldn't open ", filename);
+      }
+      inst->trace = &trace;
+    }
+  }
+
+  auto const pre_eval = [&] {
+    auto const factory_ptr = factory ? &*factory : nullptr;
+    if (opts.load_binary) {
+      // already reduced
+      auto ret = load(lambda::read_binary);
+      return factory ? factory->intern(ret) : ret;
+    }
+    if (opts.parse_dump) {
+      auto const parsed = parse();
+      std::cout << "parse: ";
+      lambda::print(std::cout, parsed, opts.print) << "\n\n";
+      if (inst) {
+        return lambda::reduce(parsed, *inst, factory_ptr);
+      }
+      return factory ? lambda::reduce(parsed, *factory)
+                     : lambda::reduce(parsed);
+    }
+
+    // nothing needs the `Parse_ast`; build the `Ast` while parsing
     try {
-      return lambda::parse_from(*file);
+      auto const source = std::string_view(program);
+      if (inst) {
+        return lambda::parse_to_ast(source, *inst, factory_ptr);
+      }
+      return factory ? lambda::parse_to_ast(source, *factory)
+                     : lambda::parse_to_ast(source);
     } catch (lambda::Parse_error const& e) {
       ublib::failwith(e);
     }
   }();
+  std::cout << "typed: ";
+  lambda::print(std::cout, pre_eval, opts.print) << "\n\n";
+
+  if (opts.emit_binary) {
+    auto const filename = std::string(*opts.emit_binary);
+    auto file = std::ofstream(filename, std::ios_base::out | std::ios_base::binary);
+    if (not file) {
+      ublib::failwith("Couldn't open ", filename);
+    }
+    lambda::write_binary(file, pre_eval);
+    return 0;
+  }
+
+  if (opts.emit_c) {
+    auto const filename = std::string(*opts.emit_c);
+    auto file = std::ofstream(filename);
+    if (not file) {
+      ublib::failwith("Couldn't open ", filename);
+    }
+    lambda::emit_c(file, pre_eval);
+    return 0;
+  }
 
-  std::cout << "parse: " << parse << "\n\n";
+  auto cache = std::optional<lambda::Eval_cache>();
+  if (opts.cache_file or opts.cache_size) {
+    cache.emplace(
+        opts.cache_size.value_or(lambda::Eval_cache::default_capacity));
+  }
+  // a cache file that can't be read is started over
+  if (opts.cache_file and std::filesystem::exists(*opts.cache_file)) {
+    try {
+      cache->load(read_file(std::string(*opts.cache_file)));
+    } catch (lambda::Binary_error const& e) {
+      std::cerr << "ignoring the cache: " << e << '\n';
+    }
+  }
 
-  auto const pre_eval = lambda::reduce(parse);
-  std::cout << "typed: " << pre_eval << "\n\n";   
+  auto const post_eval = cache
+      ? lambda::eval(pre_eval, *cache)
+      : run(opts, pre_eval, factory ? &*factory : nullptr, inst);
+  std::cout << "eval'd: ";
+  lambda::print(std::cout, post_eval, opts.print) << '\n';
 
-  auto const post_eval = eval(pre_eval);
-  std::cout << "eval'd: " << post_eval << '\n';
+  // the net prints its own counts
+  if (opts.stats and opts.engine != Engine::net) {
+    std::cerr << stats << '\n';
+  }
+
+  if (cache) {
+    std::cerr << cache->stats() << '\n';
+  }
+  if (opts.cache_file) {
+    auto const filename = std::string(*opts.cache_file);
+    auto file = std::ofstream(filename, std::ios_base::out | std::ios_base::binary);
+    if (not file) {
+      ublib::failwith("Couldn't open ", filename);
+    }
+    cache->save(file);
+  }
+
+  if (factory) {
+    auto const& stats = factory->stats();
+    std::cerr << "hash-cons: " << stats.requested << " nodes requested, "
+              << stats.created << " created (sharing ratio "
+              << stats.sharing_ratio() << ", " << stats.bytes_saved()
+              << " bytes saved)\n";
+  }
 }
@@ -1,31 +1,124 @@
 #include <ublib/shared_string.h>
 
+#include <atomic>
+#include <mutex>
+#include <new>
 #include <string_view>
+#include <unordered_map>
 
 namespace ublib {
 
+struct Shared_string::Heap {
+#if defined(UBLIB_SHARED_STRING_ATOMIC)
+  std::atomic<std::size_t> refcount;
+#else
+  std::size_t refcount;
+#endif
+  // only set for an interned string; those aren't refcounted
+  std::size_t hash;
+  // followed by the characters, and a nul
+};
+
+char const* Shared_string::heap_data(Heap* heap) noexcept {
+  return reinterpret_cast<char const*>(heap + 1);
+}
+
+std::size_t Shared_string::heap_hash(Heap* heap) noexcept {
+  return heap->hash;
+}
+
+void Shared_string::retain(Heap* heap) noexcept {
+#if defined(UBLIB_SHARED_STRING_ATOMIC)
+  heap->refcount.fetch_add(1, std::memory_order_relaxed);
+#else
+  ++heap->refcount;
+#endif
+}
+
+void Shared_string::release(Heap* heap) noexcept {
+#if defined(UBLIB_SHARED_STRING_ATOMIC)
+  auto const last =
+      heap->refcount.fetch_sub(1, std::memory_order_acq_rel) == 1;
+#else
+  auto const last = --heap->refcount == 0;
+#endif
+  if (last) {
+    heap->~Heap();
+    ::operator delete(heap);
+  }
+}
+
 Shared_string::Shared_string(std::string_view s) : Shared_string() {
-  if (not s.empty()) {
-    auto sz = s.size();
-    std::shared_ptr<char[]> tmp(new char[sz + 1]());
+  auto const sz = s.size();
+  if (sz <= inline_capacity) {
     std::copy(
-        s.begin(), s.end(), ublib::make_checked_iterator(tmp.get(), sz + 1));
-    underlying_ = std::move(tmp);
-    length_ = sz;
+        s.begin(),
+        s.end(),
+        ublib::make_checked_iterator(inline_, inline_capacity + 1));
+    inline_[sz] = '\0';
+  } else {
+    auto const memory = ::operator new(sizeof(Heap) + sz + 1);
+    auto const heap = new (memory) Heap{{1}, 0};
+    auto const data = reinterpret_cast<char*>(heap + 1);
+    std::copy(s.begin(), s.end(), ublib::make_checked_iterator(data, sz + 1));
+    data[sz] = '\0';
+    heap_ = heap;
   }
+  length_ = sz;
+}
+
+Shared_string Shared_string::interned(std::string_view s) {
+  // NOTE(ubsan): the strings are allocated like long ones, and then leaked;
+  // the keys point into them
+  static auto mutex = std::mutex();
+  static auto table = std::unordered_map<std::string_view, Heap*>();
+
+  auto const lock = std::lock_guard(mutex);
+  auto it = table.find(s);
+  if (it == table.end()) {
+    auto const sz = s.size();
+    auto const memory = ::operator new(sizeof(Heap) + sz + 1);
+    auto const heap =
+        new (memory) Heap{{0}, std::hash<std::string_view>()(s)};
+    auto const data = reinterpret_cast<char*>(heap + 1);
+    std::copy(s.begin(), s.end(), ublib::make_checked_iterator(data, sz + 1));
+    data[sz] = '\0';
+    it = table.emplace(std::string_view(data, sz), heap).first;
+  }
+
+  auto ret = Shared_string();
+  ret.heap_ = it->second;
+  ret.length_ = s.size() | interned_bit;
+  return ret;
+}
+
+std::size_t Shared_string::hash() const noexcept {
+  if (is_interned()) {
+    return heap_hash(heap_);
+  }
+  return std::hash<std::string_view>()(*this);
 }
 
 void swap(Shared_string& lhs, Shared_string& rhs) noexcept {
-  using std::swap;
-  swap(lhs.underlying_, rhs.underlying_);
-  swap(lhs.length_, rhs.length_);
+  auto tmp = Shared_string(std::move(lhs));
+  lhs.take(rhs);
+  rhs.take(tmp);
 }
 
+// NOTE(ubsan): there's one interned copy of each string, so two interned
+// strings are equal exactly when they're the same one; copies of a long
+// string share their data, and don't need to look at the characters either
 bool operator==(Shared_string const& lhs, Shared_string const& rhs) noexcept {
+  if (lhs.is_interned() and rhs.is_interned()) {
+    return lhs.heap_ == rhs.heap_;
+  }
+  if (lhs.data() == rhs.data()) {
+    return true;
+  }
   return std::string_view(lhs) == std::string_view(rhs);
 }
 bool operator!=(Shared_string const& lhs, Shared_string const& rhs) noexcept {
-  return std::string_view(lhs) != std::string_view(rhs);
+  return not(lhs == rhs);
 }
 bool operator<(Shared_string const& lhs, Shared_string const& rhs) noexcept {
   return std::string_view(lhs) < std::string_view(rhs);
@@ -44,4 +137,13 @@ std::ostream& operator<<(std::ostream& os, Shared_string const& rhs) {
   return os << std::string_view(rhs);
 }
 
+Shared_string const& Interner::intern(std::string_view s) {
+  if (auto it = table_.find(s); it != table_.end()) {
+    return it->second;
+  }
+  auto str = Shared_string::interned(s);
+  auto const key = std::string_view(str);
+  return table_.emplace(key, std::move(str)).first->second;
+}
+
 } // namespace ublib
\ No newline at end of file
@@ -0,0 +1,117 @@
+#include <ublib/thread_pool.h>
+
+#include <utility>
+
+namespace ublib {
+
+namespace {
+  // which pool, and which worker of it, this thread is
+  thread_local Thread_pool const* current_pool = nullptr;
+  thread_local std::size_t current_worker = 0;
+} // namespace
+
+Thread_pool::Thread_pool(std::size_t threads) {
+  if (threads == 0) {
+    threads = std::thread::hardware_concurrency();
+  }
+  if (threads == 0) {
+    threads = 1;
+  }
+
+  queues_.reserve(threads);
+  for (std::size_t i = 0; i < threads; ++i) {
+    queues_.push_back(std::make_unique<Queue>());
+  }
+  workers_.reserve(threads);
+  for (std::size_t i = 0; i < threads; ++i) {
+    workers_.emplace_back([this, i] { work(i); });
+  }
+}
+
+Thread_pool::~Thread_pool() {
+  {
+    auto lock = std::lock_guard(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+void Thread_pool::submit(Task task) {
+  auto self = current_worker;
+  {
+    auto lock = std::lock_guard(mutex_);
+    if (current_pool != this) {
+      self = next_queue_;
+      next_queue_ = (next_queue_ + 1) % queues_.size();
+    }
+    // NOTE(ubsan): counted before it's queued, so a worker can't take it
+    // before it's been counted
+    ++pending_;
+  }
+  {
+    auto& queue = *queues_[self];
+    auto lock = std::lock_guard(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+  }
+  wake_.notify_one();
+}
+
+bool Thread_pool::run_one() {
+  auto const self = current_pool == this ? current_worker : queues_.size();
+  if (auto task = take(self)) {
+    (*task)();
+    return true;
+  }
+  return false;
+}
+
+std::optional<Thread_pool::Task> Thread_pool::take(std::size_t self) {
+  auto found = std::optional<Task>();
+
+  if (self < queues_.size()) {
+    auto& queue = *queues_[self];
+    auto lock = std::lock_guard(queue.mutex);
+    if (not queue.tasks.empty()) {
+      found = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+    }
+  }
+  // start with the queue after ours, so thieves spread out
+  for (std::size_t i = 1; not found and i <= queues_.size(); ++i) {
+    auto& queue = *queues_[(self + i) % queues_.size()];
+    auto lock = std::lock_guard(queue.mutex);
+    if (not queue.tasks.empty()) {
+      found = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+    }
+  }
+
+  if (found) {
+    auto lock = std::lock_guard(mutex_);
+    --pending_;
+  }
+  return found;
+}
+
+void Thread_pool::work(std::size_t self) {
+  current_pool = this;
+  current_worker = self;
+
+  for (;;) {
+    if (auto task = take(self)) {
+      (*task)();
+      continue;
+    }
+
+    auto lock = std::unique_lock(mutex_);
+    wake_.wait(lock, [&] { return pending_ != 0 or stopping_; });
+    if (stopping_ and pending_ == 0) {
+      return;
+    }
+  }
+}
+
+} // namespace ublib